@@ -36,12 +36,31 @@ SOURCES += \
     script/lexer.cpp \
     script/astwalker.cpp \
     frameSelector/selectframewidget.cpp \
+    image/convert.cpp \
+    image/damagetracker.cpp \
+    image/imageloader.cpp \
+    image/imagesaver.cpp \
+    image/incrementalcapture.cpp \
+    image/qoi.cpp \
+    image/scale.cpp \
+    image/statistics.cpp \
     image/image.cpp \
     image/imageviewer.cpp \
     video/decoder.cpp \
     video/encoder.cpp \
+    video/framequeue.cpp \
     video/player.cpp \
-    video/recorder.cpp
+    video/recorder.cpp \
+    video/remux.cpp \
+    video/segmentring.cpp \
+    video/transcode.cpp \
+    video/transcodequeue.cpp \
+    video/videofile.cpp \
+    utils/bufferpool.cpp \
+    utils/framepacer.cpp \
+    utils/memorysampler.cpp \
+    utils/parallel.cpp \
+    utils/spillfile.cpp
 
 HEADERS += \
     mainWindow/mainwindow.h \
@@ -54,14 +73,31 @@ HEADERS += \
     script/parameter.h \
     script/types.h \
     frameSelector/selectframewidget.h \
+    image/convert.h \
+    image/damagetracker.h \
+    image/imageloader.h \
+    image/imagesaver.h \
+    image/incrementalcapture.h \
+    image/qoi.h \
+    image/statistics.h \
     image/image.h \
     image/imageviewer.h \
     utils/circularqueue.hpp \
     utils/memoryusage.h \
+    utils/bufferpool.h \
+    utils/framepacer.h \
+    utils/memorysampler.h \
+    utils/parallel.h \
+    utils/spillfile.h \
     video/decoder.h \
     video/encoder.h \
+    video/framequeue.h \
     video/player.h \
     video/recorder.h \
+    video/remux.h \
+    video/segmentring.h \
+    video/transcode.h \
+    video/transcodequeue.h \
     video/videofile.h
 
 win32 {
@@ -70,7 +106,8 @@ win32 {
         utils/memoryusage_win.cpp
 
     LIBS += \
-        -lgdi32
+        -lgdi32 \
+        -lwinmm
 }
 
 macx {
@@ -82,8 +119,26 @@ macx {
         -framework ApplicationServices
 }
 
+unix:!macx {
+    SOURCES += \
+        image/image_x11.cpp \
+        utils/memoryusage_linux.cpp
+
+    LIBS += \
+        -lX11 \
+        -lXext
+
+    # Without XDamage, captures are compared tile by tile
+    CONFIG += link_pkgconfig
+    packagesExist(xdamage xfixes) {
+        DEFINES += HAVE_XDAMAGE
+        PKGCONFIG += xdamage xfixes
+    }
+}
+
 include(external/QHotkey/qhotkey.pri)
 include(external/FFmpeg.pri)
+include(external/lz4.pri)
 
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
@@ -0,0 +1,20 @@
+LZ4_DIR = $$PWD/lz4
+
+win32 {
+    INCLUDEPATH += \
+        $$LZ4_DIR/include
+
+    LIBS += \
+        -L$$LZ4_DIR/lib
+}
+
+macx {
+    INCLUDEPATH += \
+        /usr/local/include
+
+    LIBS += \
+        -L/usr/local/lib
+}
+
+LIBS += \
+    -llz4
@@ -0,0 +1,816 @@
+#include "convert.h"
+
+#include "utils/parallel.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CONV_X86
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#define TARGET_SSE2  __attribute__((target("sse2")))
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#endif
+
+namespace conv
+{
+
+// Kernels converting a single row (or two rows for 4:2:0 subsampling)
+struct Kernels
+{
+    void (*bgraToRgb24)(const uint8_t *src, uint8_t *dst, int width);
+    void (*rgb24ToBgra)(const uint8_t *src, uint8_t *dst, int width);
+    void (*bgraToGray8)(const uint8_t *src, uint8_t *dst, int width);
+    void (*gray8ToBgra)(const uint8_t *src, uint8_t *dst, int width);
+    void (*bgraToI420)(const uint8_t *src0, const uint8_t *src1, uint8_t *y0, uint8_t *y1,
+                       uint8_t *u, uint8_t *v, int width);
+    void (*bgraToNv12)(const uint8_t *src0, const uint8_t *src1, uint8_t *y0, uint8_t *y1,
+                       uint8_t *uv, uint8_t *, int width);
+    void (*i420ToBgra)(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int width);
+    void (*nv12ToBgra)(const uint8_t *y, const uint8_t *uv, const uint8_t *, uint8_t *dst, int width);
+    void (*bgraToGbrp)(const uint8_t *src, uint8_t *g, uint8_t *b, uint8_t *r, int width);
+    void (*gbrpToBgra)(const uint8_t *g, const uint8_t *b, const uint8_t *r, uint8_t *dst, int width);
+    bool (*equalBgrx)(const uint8_t *src1, const uint8_t *src2, int width);
+};
+
+// ---------------------------------------------------------------------------
+// Scalar kernels
+// -> They also process the remaining pixels of the vectorized kernels
+// ---------------------------------------------------------------------------
+
+static inline uint8_t clamp(int val)
+{
+    return static_cast<uint8_t>(val < 0 ? 0 : (val > 255 ? 255 : val));
+}
+
+static inline uint8_t lumaY(int b, int g, int r)
+{
+    return static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+// Arguments are the sums of 2x2 pixels
+static inline uint8_t chromaU(int b4, int g4, int r4)
+{
+    return static_cast<uint8_t>(((112 * b4 - 74 * g4 - 38 * r4 + 512) >> 10) + 128);
+}
+
+static inline uint8_t chromaV(int b4, int g4, int r4)
+{
+    return static_cast<uint8_t>(((-18 * b4 - 94 * g4 + 112 * r4 + 512) >> 10) + 128);
+}
+
+static inline void yuvToBgra(int y, int u, int v, uint8_t *dst)
+{
+    int c = y - 16;
+    int d = u - 128;
+    int e = v - 128;
+
+    dst[0] = clamp((298 * c + 516 * d + 128) >> 8);
+    dst[1] = clamp((298 * c - 100 * d - 208 * e + 128) >> 8);
+    dst[2] = clamp((298 * c + 409 * e + 128) >> 8);
+    dst[3] = 255;
+}
+
+static void bgraToRgb24Scalar(const uint8_t *src, uint8_t *dst, int width)
+{
+    int x;
+    for (x = 0; x < width; x++, src += 4, dst += 3) {
+        dst[0] = src[2];
+        dst[1] = src[1];
+        dst[2] = src[0];
+    }
+}
+
+static void rgb24ToBgraScalar(const uint8_t *src, uint8_t *dst, int width)
+{
+    int x;
+    for (x = 0; x < width; x++, src += 3, dst += 4) {
+        dst[0] = src[2];
+        dst[1] = src[1];
+        dst[2] = src[0];
+        dst[3] = 255;
+    }
+}
+
+static void bgraToGray8Scalar(const uint8_t *src, uint8_t *dst, int width)
+{
+    int x;
+    for (x = 0; x < width; x++, src += 4)
+        dst[x] = static_cast<uint8_t>((29 * src[0] + 150 * src[1] + 77 * src[2] + 128) >> 8);
+}
+
+static void gray8ToBgraScalar(const uint8_t *src, uint8_t *dst, int width)
+{
+    int x;
+    for (x = 0; x < width; x++, dst += 4) {
+        dst[0] = src[x];
+        dst[1] = src[x];
+        dst[2] = src[x];
+        dst[3] = 255;
+    }
+}
+
+// Converts pixels [begin, width) of two rows, u_step is 1 for I420 and 2 for NV12
+static inline void bgraTo420Tail(const uint8_t *src0, const uint8_t *src1, uint8_t *y0, uint8_t *y1,
+                                 uint8_t *u, uint8_t *v, int u_step, int begin, int width)
+{
+    int x;
+    for (x = begin; x + 1 < width; x += 2) {
+        const uint8_t *p00 = src0 + x * 4;
+        const uint8_t *p01 = p00 + 4;
+        const uint8_t *p10 = src1 + x * 4;
+        const uint8_t *p11 = p10 + 4;
+
+        y0[x]     = lumaY(p00[0], p00[1], p00[2]);
+        y0[x + 1] = lumaY(p01[0], p01[1], p01[2]);
+        y1[x]     = lumaY(p10[0], p10[1], p10[2]);
+        y1[x + 1] = lumaY(p11[0], p11[1], p11[2]);
+
+        int b4 = p00[0] + p01[0] + p10[0] + p11[0];
+        int g4 = p00[1] + p01[1] + p10[1] + p11[1];
+        int r4 = p00[2] + p01[2] + p10[2] + p11[2];
+
+        u[(x / 2) * u_step] = chromaU(b4, g4, r4);
+        v[(x / 2) * u_step] = chromaV(b4, g4, r4);
+    }
+}
+
+static void bgraToI420Scalar(const uint8_t *src0, const uint8_t *src1, uint8_t *y0, uint8_t *y1,
+                             uint8_t *u, uint8_t *v, int width)
+{
+    bgraTo420Tail(src0, src1, y0, y1, u, v, 1, 0, width);
+}
+
+static void bgraToNv12Scalar(const uint8_t *src0, const uint8_t *src1, uint8_t *y0, uint8_t *y1,
+                             uint8_t *uv, uint8_t *, int width)
+{
+    bgraTo420Tail(src0, src1, y0, y1, uv, uv + 1, 2, 0, width);
+}
+
+static inline void yuv420ToBgraTail(const uint8_t *y, const uint8_t *u, const uint8_t *v, int u_step,
+                                    uint8_t *dst, int begin, int width)
+{
+    int x;
+    for (x = begin; x < width; x++)
+        yuvToBgra(y[x], u[(x / 2) * u_step], v[(x / 2) * u_step], dst + x * 4);
+}
+
+static void i420ToBgraScalar(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int width)
+{
+    yuv420ToBgraTail(y, u, v, 1, dst, 0, width);
+}
+
+static void nv12ToBgraScalar(const uint8_t *y, const uint8_t *uv, const uint8_t *, uint8_t *dst, int width)
+{
+    yuv420ToBgraTail(y, uv, uv + 1, 2, dst, 0, width);
+}
+
+static void bgraToGbrpScalar(const uint8_t *src, uint8_t *g, uint8_t *b, uint8_t *r, int width)
+{
+    int x;
+    for (x = 0; x < width; x++, src += 4) {
+        b[x] = src[0];
+        g[x] = src[1];
+        r[x] = src[2];
+    }
+}
+
+static void gbrpToBgraScalar(const uint8_t *g, const uint8_t *b, const uint8_t *r, uint8_t *dst, int width)
+{
+    int x;
+    for (x = 0; x < width; x++, dst += 4) {
+        dst[0] = b[x];
+        dst[1] = g[x];
+        dst[2] = r[x];
+        dst[3] = 255;
+    }
+}
+
+static bool equalBgrxScalar(const uint8_t *src1, const uint8_t *src2, int width)
+{
+    int x;
+    for (x = 0; x < width; x++, src1 += 4, src2 += 4) {
+        if (src1[0] != src2[0] || src1[1] != src2[1] || src1[2] != src2[2])
+            return false;
+    }
+    return true;
+}
+
+#ifdef CONV_X86
+
+// ---------------------------------------------------------------------------
+// SSE2 kernels
+// ---------------------------------------------------------------------------
+
+// Weighted sum of the channels of 4 BGRA pixels -> 4 x int32
+TARGET_SSE2 static inline __m128i weightedSum(__m128i px, __m128i coef)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(px, zero), coef);
+    __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(px, zero), coef);
+
+    __m128i even = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(2, 0, 2, 0)));
+    __m128i odd  = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(3, 1, 3, 1)));
+
+    return _mm_add_epi32(even, odd);
+}
+
+// Weighted sum of 4 quads of int16 channel sums -> 4 x int32
+TARGET_SSE2 static inline __m128i weightedQuadSum(__m128i q0, __m128i q1, __m128i coef)
+{
+    __m128i lo = _mm_madd_epi16(q0, coef);
+    __m128i hi = _mm_madd_epi16(q1, coef);
+
+    __m128i even = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(2, 0, 2, 0)));
+    __m128i odd  = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(3, 1, 3, 1)));
+
+    return _mm_add_epi32(even, odd);
+}
+
+// Sums of 2x2 blocks for 4 pixels of two rows -> 2 x (B, G, R, A) as int16
+TARGET_SSE2 static inline __m128i quadSums(__m128i row0, __m128i row1)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(row0, zero), _mm_unpacklo_epi8(row1, zero));
+    __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(row0, zero), _mm_unpackhi_epi8(row1, zero));
+
+    lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+    hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+
+    return _mm_unpacklo_epi64(lo, hi);
+}
+
+TARGET_SSE2 static inline __m128i lumaY4(__m128i px)
+{
+    const __m128i coef   = _mm_setr_epi16(25, 129, 66, 0, 25, 129, 66, 0);
+    const __m128i round  = _mm_set1_epi32(128);
+    const __m128i offset = _mm_set1_epi32(16);
+
+    return _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(weightedSum(px, coef), round), 8), offset);
+}
+
+TARGET_SSE2 static void bgraToGray8Sse2(const uint8_t *src, uint8_t *dst, int width)
+{
+    const __m128i coef  = _mm_setr_epi16(29, 150, 77, 0, 29, 150, 77, 0);
+    const __m128i round = _mm_set1_epi32(128);
+
+    int x;
+    for (x = 0; x + 16 <= width; x += 16) {
+        const __m128i *p = reinterpret_cast<const __m128i *>(src + x * 4);
+
+        __m128i g0 = _mm_srai_epi32(_mm_add_epi32(weightedSum(_mm_loadu_si128(p), coef), round), 8);
+        __m128i g1 = _mm_srai_epi32(_mm_add_epi32(weightedSum(_mm_loadu_si128(p + 1), coef), round), 8);
+        __m128i g2 = _mm_srai_epi32(_mm_add_epi32(weightedSum(_mm_loadu_si128(p + 2), coef), round), 8);
+        __m128i g3 = _mm_srai_epi32(_mm_add_epi32(weightedSum(_mm_loadu_si128(p + 3), coef), round), 8);
+
+        __m128i gray = _mm_packus_epi16(_mm_packs_epi32(g0, g1), _mm_packs_epi32(g2, g3));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x), gray);
+    }
+
+    bgraToGray8Scalar(src + x * 4, dst + x, width - x);
+}
+
+TARGET_SSE2 static void gray8ToBgraSse2(const uint8_t *src, uint8_t *dst, int width)
+{
+    const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xff000000));
+
+    int x;
+    for (x = 0; x + 16 <= width; x += 16) {
+        __m128i gray = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x));
+        __m128i lo = _mm_unpacklo_epi8(gray, gray);
+        __m128i hi = _mm_unpackhi_epi8(gray, gray);
+
+        __m128i *p = reinterpret_cast<__m128i *>(dst + x * 4);
+        _mm_storeu_si128(p,     _mm_or_si128(_mm_unpacklo_epi16(lo, lo), alpha));
+        _mm_storeu_si128(p + 1, _mm_or_si128(_mm_unpackhi_epi16(lo, lo), alpha));
+        _mm_storeu_si128(p + 2, _mm_or_si128(_mm_unpacklo_epi16(hi, hi), alpha));
+        _mm_storeu_si128(p + 3, _mm_or_si128(_mm_unpackhi_epi16(hi, hi), alpha));
+    }
+
+    gray8ToBgraScalar(src + x, dst + x * 4, width - x);
+}
+
+// Converts 16 pixels of two rows, luma is stored directly
+// -> chroma is returned as 8 x U and 8 x V in the lower halves of u_out and v_out
+TARGET_SSE2 static inline void bgraTo420Block(const uint8_t *src0, const uint8_t *src1, uint8_t *y0, uint8_t *y1,
+                                              __m128i &u_out, __m128i &v_out)
+{
+    const __m128i coef_u = _mm_setr_epi16(112, -74, -38, 0, 112, -74, -38, 0);
+    const __m128i coef_v = _mm_setr_epi16(-18, -94, 112, 0, -18, -94, 112, 0);
+    const __m128i round  = _mm_set1_epi32(512);
+    const __m128i offset = _mm_set1_epi32(128);
+
+    const __m128i *p0 = reinterpret_cast<const __m128i *>(src0);
+    const __m128i *p1 = reinterpret_cast<const __m128i *>(src1);
+
+    __m128i a0 = _mm_loadu_si128(p0);
+    __m128i a1 = _mm_loadu_si128(p0 + 1);
+    __m128i a2 = _mm_loadu_si128(p0 + 2);
+    __m128i a3 = _mm_loadu_si128(p0 + 3);
+    __m128i b0 = _mm_loadu_si128(p1);
+    __m128i b1 = _mm_loadu_si128(p1 + 1);
+    __m128i b2 = _mm_loadu_si128(p1 + 2);
+    __m128i b3 = _mm_loadu_si128(p1 + 3);
+
+    __m128i ya = _mm_packus_epi16(_mm_packs_epi32(lumaY4(a0), lumaY4(a1)), _mm_packs_epi32(lumaY4(a2), lumaY4(a3)));
+    __m128i yb = _mm_packus_epi16(_mm_packs_epi32(lumaY4(b0), lumaY4(b1)), _mm_packs_epi32(lumaY4(b2), lumaY4(b3)));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(y0), ya);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(y1), yb);
+
+    __m128i q0 = quadSums(a0, b0);
+    __m128i q1 = quadSums(a1, b1);
+    __m128i q2 = quadSums(a2, b2);
+    __m128i q3 = quadSums(a3, b3);
+
+    __m128i u0 = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(weightedQuadSum(q0, q1, coef_u), round), 10), offset);
+    __m128i u1 = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(weightedQuadSum(q2, q3, coef_u), round), 10), offset);
+    __m128i v0 = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(weightedQuadSum(q0, q1, coef_v), round), 10), offset);
+    __m128i v1 = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(weightedQuadSum(q2, q3, coef_v), round), 10), offset);
+
+    __m128i u16 = _mm_packs_epi32(u0, u1);
+    __m128i v16 = _mm_packs_epi32(v0, v1);
+
+    u_out = _mm_packus_epi16(u16, u16);
+    v_out = _mm_packus_epi16(v16, v16);
+}
+
+TARGET_SSE2 static void bgraToI420Sse2(const uint8_t *src0, const uint8_t *src1, uint8_t *y0, uint8_t *y1,
+                                       uint8_t *u, uint8_t *v, int width)
+{
+    __m128i u8, v8;
+
+    int x;
+    for (x = 0; x + 16 <= width; x += 16) {
+        bgraTo420Block(src0 + x * 4, src1 + x * 4, y0 + x, y1 + x, u8, v8);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(u + x / 2), u8);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(v + x / 2), v8);
+    }
+
+    bgraTo420Tail(src0, src1, y0, y1, u, v, 1, x, width);
+}
+
+TARGET_SSE2 static void bgraToNv12Sse2(const uint8_t *src0, const uint8_t *src1, uint8_t *y0, uint8_t *y1,
+                                       uint8_t *uv, uint8_t *, int width)
+{
+    __m128i u8, v8;
+
+    int x;
+    for (x = 0; x + 16 <= width; x += 16) {
+        bgraTo420Block(src0 + x * 4, src1 + x * 4, y0 + x, y1 + x, u8, v8);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(uv + x), _mm_unpacklo_epi8(u8, v8));
+    }
+
+    bgraTo420Tail(src0, src1, y0, y1, uv, uv + 1, 2, x, width);
+}
+
+// Converts 8 pixels, u16 and v16 hold the chroma value for each pixel as int16
+TARGET_SSE2 static inline void yuvToBgra8(__m128i y8, __m128i u16, __m128i v16, uint8_t *dst)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i coef_r  = _mm_setr_epi16(298, 409, 298, 409, 298, 409, 298, 409);
+    const __m128i coef_g1 = _mm_setr_epi16(298, -100, 298, -100, 298, -100, 298, -100);
+    const __m128i coef_g2 = _mm_setr_epi16(-208, 0, -208, 0, -208, 0, -208, 0);
+    const __m128i coef_b  = _mm_setr_epi16(298, 516, 298, 516, 298, 516, 298, 516);
+    const __m128i round = _mm_set1_epi32(128);
+    const __m128i alpha = _mm_set1_epi8(static_cast<char>(0xff));
+
+    __m128i c = _mm_sub_epi16(_mm_unpacklo_epi8(y8, zero), _mm_set1_epi16(16));
+    __m128i d = _mm_sub_epi16(u16, _mm_set1_epi16(128));
+    __m128i e = _mm_sub_epi16(v16, _mm_set1_epi16(128));
+
+    __m128i ce_lo = _mm_unpacklo_epi16(c, e);
+    __m128i ce_hi = _mm_unpackhi_epi16(c, e);
+    __m128i cd_lo = _mm_unpacklo_epi16(c, d);
+    __m128i cd_hi = _mm_unpackhi_epi16(c, d);
+    __m128i e_lo  = _mm_unpacklo_epi16(e, zero);
+    __m128i e_hi  = _mm_unpackhi_epi16(e, zero);
+
+    __m128i r_lo = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(ce_lo, coef_r), round), 8);
+    __m128i r_hi = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(ce_hi, coef_r), round), 8);
+    __m128i g_lo = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(cd_lo, coef_g1),
+                                                              _mm_madd_epi16(e_lo, coef_g2)), round), 8);
+    __m128i g_hi = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(cd_hi, coef_g1),
+                                                              _mm_madd_epi16(e_hi, coef_g2)), round), 8);
+    __m128i b_lo = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(cd_lo, coef_b), round), 8);
+    __m128i b_hi = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(cd_hi, coef_b), round), 8);
+
+    __m128i r16 = _mm_packs_epi32(r_lo, r_hi);
+    __m128i g16 = _mm_packs_epi32(g_lo, g_hi);
+    __m128i b16 = _mm_packs_epi32(b_lo, b_hi);
+
+    __m128i bg = _mm_unpacklo_epi8(_mm_packus_epi16(b16, b16), _mm_packus_epi16(g16, g16));
+    __m128i ra = _mm_unpacklo_epi8(_mm_packus_epi16(r16, r16), alpha);
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst),      _mm_unpacklo_epi16(bg, ra));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 16), _mm_unpackhi_epi16(bg, ra));
+}
+
+TARGET_SSE2 static void i420ToBgraSse2(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int width)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    int x;
+    for (x = 0; x + 8 <= width; x += 8) {
+        int32_t u4, v4;
+        memcpy(&u4, u + x / 2, 4);
+        memcpy(&v4, v + x / 2, 4);
+
+        __m128i u8 = _mm_cvtsi32_si128(u4);
+        __m128i v8 = _mm_cvtsi32_si128(v4);
+
+        __m128i u16 = _mm_unpacklo_epi8(_mm_unpacklo_epi8(u8, u8), zero);
+        __m128i v16 = _mm_unpacklo_epi8(_mm_unpacklo_epi8(v8, v8), zero);
+
+        __m128i y8 = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(y + x));
+
+        yuvToBgra8(y8, u16, v16, dst + x * 4);
+    }
+
+    yuv420ToBgraTail(y, u, v, 1, dst, x, width);
+}
+
+TARGET_SSE2 static void nv12ToBgraSse2(const uint8_t *y, const uint8_t *uv, const uint8_t *, uint8_t *dst, int width)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    int x;
+    for (x = 0; x + 8 <= width; x += 8) {
+        // u0 v0 u1 v1 u2 v2 u3 v3 as int16
+        __m128i uv16 = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(uv + x)), zero);
+
+        __m128i u16 = _mm_shufflehi_epi16(_mm_shufflelo_epi16(uv16, _MM_SHUFFLE(2, 2, 0, 0)), _MM_SHUFFLE(2, 2, 0, 0));
+        __m128i v16 = _mm_shufflehi_epi16(_mm_shufflelo_epi16(uv16, _MM_SHUFFLE(3, 3, 1, 1)), _MM_SHUFFLE(3, 3, 1, 1));
+
+        __m128i y8 = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(y + x));
+
+        yuvToBgra8(y8, u16, v16, dst + x * 4);
+    }
+
+    yuv420ToBgraTail(y, uv, uv + 1, 2, dst, x, width);
+}
+
+TARGET_SSE2 static void gbrpToBgraSse2(const uint8_t *g, const uint8_t *b, const uint8_t *r, uint8_t *dst, int width)
+{
+    const __m128i alpha = _mm_set1_epi8(static_cast<char>(0xff));
+
+    int x;
+    for (x = 0; x + 16 <= width; x += 16) {
+        __m128i g16 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(g + x));
+        __m128i b16 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + x));
+        __m128i r16 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(r + x));
+
+        __m128i bg_lo = _mm_unpacklo_epi8(b16, g16);
+        __m128i bg_hi = _mm_unpackhi_epi8(b16, g16);
+        __m128i ra_lo = _mm_unpacklo_epi8(r16, alpha);
+        __m128i ra_hi = _mm_unpackhi_epi8(r16, alpha);
+
+        __m128i *p = reinterpret_cast<__m128i *>(dst + x * 4);
+        _mm_storeu_si128(p,     _mm_unpacklo_epi16(bg_lo, ra_lo));
+        _mm_storeu_si128(p + 1, _mm_unpackhi_epi16(bg_lo, ra_lo));
+        _mm_storeu_si128(p + 2, _mm_unpacklo_epi16(bg_hi, ra_hi));
+        _mm_storeu_si128(p + 3, _mm_unpackhi_epi16(bg_hi, ra_hi));
+    }
+
+    gbrpToBgraScalar(g + x, b + x, r + x, dst + x * 4, width - x);
+}
+
+TARGET_SSE2 static bool equalBgrxSse2(const uint8_t *src1, const uint8_t *src2, int width)
+{
+    const __m128i mask = _mm_set1_epi32(0x00ffffff);
+    const __m128i zero = _mm_setzero_si128();
+
+    int x;
+    for (x = 0; x + 4 <= width; x += 4) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src1 + x * 4));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src2 + x * 4));
+        __m128i diff = _mm_and_si128(_mm_xor_si128(a, b), mask);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(diff, zero)) != 0xffff)
+            return false;
+    }
+
+    return equalBgrxScalar(src1 + x * 4, src2 + x * 4, width - x);
+}
+
+// ---------------------------------------------------------------------------
+// SSSE3 kernels
+// ---------------------------------------------------------------------------
+
+TARGET_SSSE3 static void bgraToRgb24Ssse3(const uint8_t *src, uint8_t *dst, int width)
+{
+    const __m128i mask = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+    int x;
+    for (x = 0; x + 16 <= width; x += 16) {
+        const __m128i *p = reinterpret_cast<const __m128i *>(src + x * 4);
+
+        // Each register holds 12 valid bytes
+        __m128i s0 = _mm_shuffle_epi8(_mm_loadu_si128(p),     mask);
+        __m128i s1 = _mm_shuffle_epi8(_mm_loadu_si128(p + 1), mask);
+        __m128i s2 = _mm_shuffle_epi8(_mm_loadu_si128(p + 2), mask);
+        __m128i s3 = _mm_shuffle_epi8(_mm_loadu_si128(p + 3), mask);
+
+        __m128i *d = reinterpret_cast<__m128i *>(dst + x * 3);
+        _mm_storeu_si128(d,     _mm_or_si128(s0, _mm_slli_si128(s1, 12)));
+        _mm_storeu_si128(d + 1, _mm_or_si128(_mm_srli_si128(s1, 4), _mm_slli_si128(s2, 8)));
+        _mm_storeu_si128(d + 2, _mm_or_si128(_mm_srli_si128(s2, 8), _mm_slli_si128(s3, 4)));
+    }
+
+    bgraToRgb24Scalar(src + x * 4, dst + x * 3, width - x);
+}
+
+TARGET_SSSE3 static void rgb24ToBgraSsse3(const uint8_t *src, uint8_t *dst, int width)
+{
+    const __m128i mask  = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+    const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xff000000));
+
+    int x;
+    for (x = 0; x + 16 <= width; x += 16) {
+        const __m128i *p = reinterpret_cast<const __m128i *>(src + x * 3);
+
+        __m128i in0 = _mm_loadu_si128(p);
+        __m128i in1 = _mm_loadu_si128(p + 1);
+        __m128i in2 = _mm_loadu_si128(p + 2);
+
+        __m128i *d = reinterpret_cast<__m128i *>(dst + x * 4);
+        _mm_storeu_si128(d,     _mm_or_si128(_mm_shuffle_epi8(in0, mask), alpha));
+        _mm_storeu_si128(d + 1, _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(in1, in0, 12), mask), alpha));
+        _mm_storeu_si128(d + 2, _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(in2, in1, 8), mask), alpha));
+        _mm_storeu_si128(d + 3, _mm_or_si128(_mm_shuffle_epi8(_mm_srli_si128(in2, 4), mask), alpha));
+    }
+
+    rgb24ToBgraScalar(src + x * 3, dst + x * 4, width - x);
+}
+
+TARGET_SSSE3 static void bgraToGbrpSsse3(const uint8_t *src, uint8_t *g, uint8_t *b, uint8_t *r, int width)
+{
+    // Groups each register to B0-3 G0-3 R0-3 A0-3
+    const __m128i mask = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+
+    int x;
+    for (x = 0; x + 16 <= width; x += 16) {
+        const __m128i *p = reinterpret_cast<const __m128i *>(src + x * 4);
+
+        __m128i s0 = _mm_shuffle_epi8(_mm_loadu_si128(p),     mask);
+        __m128i s1 = _mm_shuffle_epi8(_mm_loadu_si128(p + 1), mask);
+        __m128i s2 = _mm_shuffle_epi8(_mm_loadu_si128(p + 2), mask);
+        __m128i s3 = _mm_shuffle_epi8(_mm_loadu_si128(p + 3), mask);
+
+        __m128i t0 = _mm_unpacklo_epi32(s0, s1);
+        __m128i t1 = _mm_unpacklo_epi32(s2, s3);
+        __m128i t2 = _mm_unpackhi_epi32(s0, s1);
+        __m128i t3 = _mm_unpackhi_epi32(s2, s3);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(b + x), _mm_unpacklo_epi64(t0, t1));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(g + x), _mm_unpackhi_epi64(t0, t1));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(r + x), _mm_unpacklo_epi64(t2, t3));
+    }
+
+    bgraToGbrpScalar(src + x * 4, g + x, b + x, r + x, width - x);
+}
+
+static Isa detectIsa()
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("ssse3"))
+        return SSSE3;
+    else if (__builtin_cpu_supports("sse2"))
+        return SSE2;
+    return Scalar;
+}
+
+#else
+
+static Isa detectIsa()
+{
+    return Scalar;
+}
+
+#endif // CONV_X86
+
+static Kernels kernelsFor(Isa isa)
+{
+    Kernels k = {
+        bgraToRgb24Scalar,
+        rgb24ToBgraScalar,
+        bgraToGray8Scalar,
+        gray8ToBgraScalar,
+        bgraToI420Scalar,
+        bgraToNv12Scalar,
+        i420ToBgraScalar,
+        nv12ToBgraScalar,
+        bgraToGbrpScalar,
+        gbrpToBgraScalar,
+        equalBgrxScalar
+    };
+
+#ifdef CONV_X86
+    if (isa >= SSE2) {
+        k.bgraToGray8 = bgraToGray8Sse2;
+        k.gray8ToBgra = gray8ToBgraSse2;
+        k.bgraToI420  = bgraToI420Sse2;
+        k.bgraToNv12  = bgraToNv12Sse2;
+        k.i420ToBgra  = i420ToBgraSse2;
+        k.nv12ToBgra  = nv12ToBgraSse2;
+        k.gbrpToBgra  = gbrpToBgraSse2;
+        k.equalBgrx   = equalBgrxSse2;
+    }
+    if (isa >= SSSE3) {
+        k.bgraToRgb24 = bgraToRgb24Ssse3;
+        k.rgb24ToBgra = rgb24ToBgraSsse3;
+        k.bgraToGbrp  = bgraToGbrpSsse3;
+    }
+#endif
+
+    return k;
+}
+
+static const Isa supported_isa = detectIsa();
+static Isa current_isa = supported_isa;
+static Kernels kernels = kernelsFor(supported_isa);
+
+static size_t parallel_threshold = 1 << 20;
+
+Isa isa()
+{
+    return current_isa;
+}
+
+void setIsa(Isa isa)
+{
+    current_isa = isa <= supported_isa ? isa : supported_isa;
+    kernels = kernelsFor(current_isa);
+}
+
+void setParallelThreshold(size_t num_pixels)
+{
+    parallel_threshold = num_pixels;
+}
+
+// Calls fnc(begin, end) for bands of row units (rows or row pairs)
+template<class Fnc>
+static inline void forRows(int width, int height, int rows_per_unit, const Fnc &fnc)
+{
+    int units = height / rows_per_unit;
+    size_t num_pixels = static_cast<size_t>(width) * static_cast<size_t>(height);
+
+    if (num_pixels < parallel_threshold || units < 2)
+        fnc(0, units);
+    else {
+        // Every band should have at least ~64k pixels
+        int min_band = std::max(1, (1 << 16) / std::max(1, width * rows_per_unit));
+        parallelFor(units, min_band, fnc);
+    }
+}
+
+void copyBgra(const uint8_t *src, int src_stride, uint8_t *dst, int dst_stride, int width, int height)
+{
+    size_t row_size = static_cast<size_t>(width) * 4;
+
+    forRows(width, height, 1, [&](int begin, int end) {
+        int line;
+        for (line = begin; line < end; line++)
+            memcpy(dst + line * dst_stride, src + line * src_stride, row_size);
+    });
+}
+
+void bgraToRgb24(const uint8_t *src, int src_stride, uint8_t *dst, int dst_stride, int width, int height)
+{
+    auto row_fnc = kernels.bgraToRgb24;
+
+    forRows(width, height, 1, [&](int begin, int end) {
+        int line;
+        for (line = begin; line < end; line++)
+            row_fnc(src + line * src_stride, dst + line * dst_stride, width);
+    });
+}
+
+void rgb24ToBgra(const uint8_t *src, int src_stride, uint8_t *dst, int dst_stride, int width, int height)
+{
+    auto row_fnc = kernels.rgb24ToBgra;
+
+    forRows(width, height, 1, [&](int begin, int end) {
+        int line;
+        for (line = begin; line < end; line++)
+            row_fnc(src + line * src_stride, dst + line * dst_stride, width);
+    });
+}
+
+void bgraToGray8(const uint8_t *src, int src_stride, uint8_t *dst, int dst_stride, int width, int height)
+{
+    auto row_fnc = kernels.bgraToGray8;
+
+    forRows(width, height, 1, [&](int begin, int end) {
+        int line;
+        for (line = begin; line < end; line++)
+            row_fnc(src + line * src_stride, dst + line * dst_stride, width);
+    });
+}
+
+void gray8ToBgra(const uint8_t *src, int src_stride, uint8_t *dst, int dst_stride, int width, int height)
+{
+    auto row_fnc = kernels.gray8ToBgra;
+
+    forRows(width, height, 1, [&](int begin, int end) {
+        int line;
+        for (line = begin; line < end; line++)
+            row_fnc(src + line * src_stride, dst + line * dst_stride, width);
+    });
+}
+
+void bgraToI420(const uint8_t *src, int src_stride,
+                uint8_t *y, int y_stride, uint8_t *u, int u_stride, uint8_t *v, int v_stride,
+                int width, int height)
+{
+    auto row_fnc = kernels.bgraToI420;
+
+    forRows(width, height, 2, [&](int begin, int end) {
+        int pair;
+        for (pair = begin; pair < end; pair++) {
+            const uint8_t *src0 = src + pair * 2 * src_stride;
+            uint8_t *y0 = y + pair * 2 * y_stride;
+            row_fnc(src0, src0 + src_stride, y0, y0 + y_stride, u + pair * u_stride, v + pair * v_stride, width);
+        }
+    });
+}
+
+void i420ToBgra(const uint8_t *y, int y_stride, const uint8_t *u, int u_stride, const uint8_t *v, int v_stride,
+                uint8_t *dst, int dst_stride, int width, int height)
+{
+    auto row_fnc = kernels.i420ToBgra;
+
+    forRows(width, height, 1, [&](int begin, int end) {
+        int line;
+        for (line = begin; line < end; line++)
+            row_fnc(y + line * y_stride, u + (line / 2) * u_stride, v + (line / 2) * v_stride,
+                    dst + line * dst_stride, width);
+    });
+}
+
+void bgraToNv12(const uint8_t *src, int src_stride, uint8_t *y, int y_stride, uint8_t *uv, int uv_stride,
+                int width, int height)
+{
+    auto row_fnc = kernels.bgraToNv12;
+
+    forRows(width, height, 2, [&](int begin, int end) {
+        int pair;
+        for (pair = begin; pair < end; pair++) {
+            const uint8_t *src0 = src + pair * 2 * src_stride;
+            uint8_t *y0 = y + pair * 2 * y_stride;
+            row_fnc(src0, src0 + src_stride, y0, y0 + y_stride, uv + pair * uv_stride, nullptr, width);
+        }
+    });
+}
+
+void nv12ToBgra(const uint8_t *y, int y_stride, const uint8_t *uv, int uv_stride,
+                uint8_t *dst, int dst_stride, int width, int height)
+{
+    auto row_fnc = kernels.nv12ToBgra;
+
+    forRows(width, height, 1, [&](int begin, int end) {
+        int line;
+        for (line = begin; line < end; line++)
+            row_fnc(y + line * y_stride, uv + (line / 2) * uv_stride, nullptr, dst + line * dst_stride, width);
+    });
+}
+
+void bgraToGbrp(const uint8_t *src, int src_stride,
+                uint8_t *g, int g_stride, uint8_t *b, int b_stride, uint8_t *r, int r_stride,
+                int width, int height)
+{
+    auto row_fnc = kernels.bgraToGbrp;
+
+    forRows(width, height, 1, [&](int begin, int end) {
+        int line;
+        for (line = begin; line < end; line++)
+            row_fnc(src + line * src_stride, g + line * g_stride, b + line * b_stride, r + line * r_stride, width);
+    });
+}
+
+void gbrpToBgra(const uint8_t *g, int g_stride, const uint8_t *b, int b_stride, const uint8_t *r, int r_stride,
+                uint8_t *dst, int dst_stride, int width, int height)
+{
+    auto row_fnc = kernels.gbrpToBgra;
+
+    forRows(width, height, 1, [&](int begin, int end) {
+        int line;
+        for (line = begin; line < end; line++)
+            row_fnc(g + line * g_stride, b + line * b_stride, r + line * r_stride, dst + line * dst_stride, width);
+    });
+}
+
+bool equalBgrx(const uint8_t *src1, int src1_stride, const uint8_t *src2, int src2_stride, int width, int height)
+{
+    // Comparing is usually aborted early, so it is not split into bands
+    int line;
+    for (line = 0; line < height; line++) {
+        if (!kernels.equalBgrx(src1 + line * src1_stride, src2 + line * src2_stride, width))
+            return false;
+    }
+
+    return true;
+}
+
+} // namespace conv
@@ -0,0 +1,99 @@
+#ifndef CONVERT_H
+#define CONVERT_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Pixel format conversion to and from BGRA (QImage::Format_RGB32 / AV_PIX_FMT_BGRA)
+//
+// All functions take a pointer to the first pixel of each plane and its stride
+// in bytes. The kernels are selected at runtime depending on the instruction sets
+// the CPU supports (scalar, SSE2, SSSE3) and large frames are split into bands of
+// rows, which are converted in parallel.
+//
+// The YUV conversions use BT.601 coefficients with limited range (16-235),
+// chroma is subsampled by averaging 2x2 pixels. Width and height for 4:2:0
+// conversions are expected to be even.
+
+namespace conv
+{
+
+enum Isa
+{
+    Scalar,
+    SSE2,
+    SSSE3
+};
+
+// Instruction set used by the dispatched kernels
+Isa isa();
+
+// Force a specific instruction set (if supported) -> used for testing and benchmarking
+void setIsa(Isa isa);
+
+// Threshold in pixels from which on rows are converted by multiple threads
+void setParallelThreshold(size_t num_pixels);
+
+void copyBgra(const uint8_t *src, int src_stride,
+              uint8_t *dst, int dst_stride,
+              int width, int height);
+
+void bgraToRgb24(const uint8_t *src, int src_stride,
+                 uint8_t *dst, int dst_stride,
+                 int width, int height);
+
+void rgb24ToBgra(const uint8_t *src, int src_stride,
+                 uint8_t *dst, int dst_stride,
+                 int width, int height);
+
+void bgraToGray8(const uint8_t *src, int src_stride,
+                 uint8_t *dst, int dst_stride,
+                 int width, int height);
+
+void gray8ToBgra(const uint8_t *src, int src_stride,
+                 uint8_t *dst, int dst_stride,
+                 int width, int height);
+
+void bgraToI420(const uint8_t *src, int src_stride,
+                uint8_t *y, int y_stride,
+                uint8_t *u, int u_stride,
+                uint8_t *v, int v_stride,
+                int width, int height);
+
+void i420ToBgra(const uint8_t *y, int y_stride,
+                const uint8_t *u, int u_stride,
+                const uint8_t *v, int v_stride,
+                uint8_t *dst, int dst_stride,
+                int width, int height);
+
+void bgraToNv12(const uint8_t *src, int src_stride,
+                uint8_t *y, int y_stride,
+                uint8_t *uv, int uv_stride,
+                int width, int height);
+
+void nv12ToBgra(const uint8_t *y, int y_stride,
+                const uint8_t *uv, int uv_stride,
+                uint8_t *dst, int dst_stride,
+                int width, int height);
+
+// Planar GBR as used by libx264rgb / AV_PIX_FMT_GBRP
+void bgraToGbrp(const uint8_t *src, int src_stride,
+                uint8_t *g, int g_stride,
+                uint8_t *b, int b_stride,
+                uint8_t *r, int r_stride,
+                int width, int height);
+
+void gbrpToBgra(const uint8_t *g, int g_stride,
+                const uint8_t *b, int b_stride,
+                const uint8_t *r, int r_stride,
+                uint8_t *dst, int dst_stride,
+                int width, int height);
+
+// Compares the color channels of two BGRA images, the alpha channel is ignored
+bool equalBgrx(const uint8_t *src1, int src1_stride,
+               const uint8_t *src2, int src2_stride,
+               int width, int height);
+
+} // namespace conv
+
+#endif // CONVERT_H
@@ -0,0 +1,118 @@
+#include "damagetracker.h"
+
+#if defined(__unix__) && !defined(__APPLE__) && defined(HAVE_XDAMAGE)
+
+#include <X11/Xlib.h>
+#include <X11/extensions/Xdamage.h>
+#include <X11/extensions/Xfixes.h>
+
+struct DamageTracker::Private
+{
+    Display *display;
+    Damage damage;
+    XserverRegion region;
+};
+
+DamageTracker::DamageTracker(const QRect &rect) :
+    rect(rect),
+    d(nullptr)
+{
+    Display *display = XOpenDisplay(nullptr);
+    if (display == nullptr)
+        return;
+
+    int event_base, error_base;
+    int major = 1, minor = 1;
+    if (!XDamageQueryExtension(display, &event_base, &error_base) ||
+            !XDamageQueryVersion(display, &major, &minor) ||
+            !XFixesQueryExtension(display, &event_base, &error_base)) {
+        XCloseDisplay(display);
+        return;
+    }
+
+    // Regions require XFixes 2.0
+    major = 2;
+    minor = 0;
+    XFixesQueryVersion(display, &major, &minor);
+    if (major < 2) {
+        XCloseDisplay(display);
+        return;
+    }
+
+    d = new Private;
+    d->display = display;
+
+    // Only the accumulated damage is read, a single event when the damage
+    // becomes non-empty keeps the event queue short
+    d->damage = XDamageCreate(display, DefaultRootWindow(display), XDamageReportNonEmpty);
+    d->region = XFixesCreateRegion(display, nullptr, 0);
+    XSync(display, False);
+}
+
+DamageTracker::~DamageTracker()
+{
+    if (d == nullptr)
+        return;
+
+    XFixesDestroyRegion(d->display, d->region);
+    XDamageDestroy(d->display, d->damage);
+    XCloseDisplay(d->display);
+
+    delete d;
+}
+
+bool DamageTracker::takeDamage(std::vector<QRect> &damage)
+{
+    damage.clear();
+
+    if (d == nullptr)
+        return false;
+
+    // Drop the notify events, they carry no information needed here
+    while (XPending(d->display) > 0) {
+        XEvent event;
+        XNextEvent(d->display, &event);
+    }
+
+    // Moves the damage into the region and resets it
+    XDamageSubtract(d->display, d->damage, None, d->region);
+
+    int count = 0;
+    XRectangle *rects = XFixesFetchRegion(d->display, d->region, &count);
+
+    int index;
+    for (index = 0; index < count; index++) {
+        QRect damaged = QRect(rects[index].x, rects[index].y, rects[index].width, rects[index].height).intersected(rect);
+        if (!damaged.isEmpty())
+            damage.push_back(damaged.translated(-rect.x(), -rect.y()));
+    }
+
+    if (rects != nullptr)
+        XFree(rects);
+
+    return true;
+}
+
+#else
+
+struct DamageTracker::Private
+{
+};
+
+DamageTracker::DamageTracker(const QRect &rect) :
+    rect(rect),
+    d(nullptr)
+{
+}
+
+DamageTracker::~DamageTracker()
+{
+}
+
+bool DamageTracker::takeDamage(std::vector<QRect> &damage)
+{
+    damage.clear();
+    return false;
+}
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef DAMAGETRACKER_H
+#define DAMAGETRACKER_H
+
+#include <QRect>
+
+#include <vector>
+
+// Reports which parts of a screen area were redrawn since the last call
+// -> implemented with the XDamage extension on Linux (if available at build
+//    time), on all other platforms isAvailable() returns false and callers
+//    have to assume, that the whole area might have changed
+class DamageTracker
+{
+public:
+    DamageTracker(const QRect &rect);
+    ~DamageTracker();
+
+    bool isAvailable() const { return d != nullptr; }
+
+    // Damaged regions relative to the top left corner of the rect, the list is
+    // empty if nothing changed. Returns false, if the damage is unknown.
+    bool takeDamage(std::vector<QRect> &damage);
+
+private:
+    QRect rect;
+
+    struct Private;
+    Private *d;
+};
+
+#endif // DAMAGETRACKER_H
@@ -1,4 +1,8 @@
 #include "image.h"
+#include "convert.h"
+#include "imageloader.h"
+
+#include "utils/bufferpool.h"
 
 Image::Image(int linesize_alignment) :
     _bits(nullptr),
@@ -14,8 +18,14 @@ Image::Image(int linesize_alignment) :
 Image::Image(const Image &src) :
     Image(src.linesize_alignment)
 {
+    if (src._bits == nullptr)
+        return;
+
     resize(src.size());
-    memcpy(_bits, src._bits, bpr * static_cast<size_t>(_height));
+
+    // The rows of the source may be padded differently (e.g. screen captures)
+    conv::copyBgra(src._bits, static_cast<int>(src.bpr),
+                   _bits, static_cast<int>(bpr), _width, _height);
 }
 
 Image::Image(Image &&src) :
@@ -37,15 +47,7 @@ Image::Image(Image &&src) :
 Image::Image(const QString &file_name) :
     Image(0)
 {
-    QImage *src = new QImage(file_name);
-
-    if (src->format() != QImage::Format_RGB32 && src->format() != QImage::Format_ARGB32) {
-        // Need to have 32bit format!
-        delete src;
-        return;
-    }
-
-    assign(src->bits(), src->width(), src->height(), [](void *ptr) { delete static_cast<QImage *>(ptr); }, src);
+    ImageLoader::load(file_name, *this);
 }
 
 void Image::clear()
@@ -60,6 +62,16 @@ void Image::clear()
     _height = 0;
 }
 
+void Image::discard()
+{
+    if (cleanup_fnc == bufferpool::release) {
+        bufferpool::discard(cleanup_info);
+        cleanup_fnc = nullptr;
+        cleanup_info = nullptr;
+    }
+    clear();
+}
+
 size_t Image::bytesPerRow(int width)
 {
     if (linesize_alignment == 0)
@@ -70,8 +82,6 @@ size_t Image::bytesPerRow(int width)
 
 void Image::assign(uint8_t *bits, int width, int height, ImageCleanupFunction cleanup_fnc, void *cleanup_info)
 {
-    emit reallocate(bits);
-
     clear();
 
     this->_bits = bits;
@@ -86,11 +96,11 @@ void Image::assign(uint8_t *bits, int width, int height, ImageCleanupFunction cl
 
 void Image::resize(int width, int height)
 {
-    uint8_t* buffer = new uint8_t[bytesPerRow(width) * static_cast<size_t>(height)];
+    uint8_t* buffer = bufferpool::acquire(bytesPerRow(width) * static_cast<size_t>(height));
 
     assign(buffer,
            width, height,
-           [](void *ptr) { delete [] static_cast<uint8_t *>(ptr); },
+           bufferpool::release,
            buffer);
 }
 
@@ -103,11 +113,8 @@ QImage Image::toQImage() const
         // New QImage is created that owns its image data
         QImage image = QImage(_width, _height, QImage::Format_RGB32);
 
-        size_t line;
-        for (line = 0; line < static_cast<size_t>(_height); line++)
-            memcpy(image.bits() + static_cast<size_t>(image.bytesPerLine()) * line,
-                   scanLine(line),
-                   static_cast<size_t>(image.bytesPerLine()));
+        conv::copyBgra(_bits, static_cast<int>(bpr),
+                       image.bits(), image.bytesPerLine(), _width, _height);
 
         return image;
     }
@@ -118,9 +125,8 @@ Image &Image::operator=(const Image &src)
     if (_width != src._width || _height != src._height)
         resize(src.size());
 
-    size_t line;
-    for (line = 0; line < static_cast<size_t>(_height); line++)
-        memcpy(scanLine(line), src.scanLine(line), static_cast<size_t>(_width * 4));
+    conv::copyBgra(src._bits, static_cast<int>(src.bpr),
+                   _bits, static_cast<int>(bpr), _width, _height);
 
     return *this;
 }
@@ -129,8 +135,6 @@ Image &Image::operator=(Image &&src)
 {
     clear();
 
-    emit reallocate(src._bits);
-
     _bits = src._bits;
     _width = src._width;
     _height = src._height;
@@ -153,11 +157,7 @@ bool Image::operator==(const Image &cmp) const
     if (_width != cmp._width || _height != cmp._height)
         return false;
 
-    size_t line;
-    for (line = 0; line < static_cast<size_t>(_height); line++) {
-        if (memcmp(scanLine(line), cmp.scanLine(line), static_cast<size_t>(_width * 4)) != 0)
-            return false;
-    }
-
-    return true;
+    // The fourth byte of Format_RGB32 is undefined, only colors are compared
+    return conv::equalBgrx(_bits, static_cast<int>(bpr),
+                           cmp._bits, static_cast<int>(cmp.bpr), _width, _height);
 }
@@ -13,6 +13,13 @@ class Image : public QObject
     Q_OBJECT
 
 public:
+    enum ScaleFilter
+    {
+        Box,
+        Bilinear,
+        Lanczos
+    };
+
     Image() : Image(0) {}
     Image(int linesize_alignment);
     Image(const Image &src);
@@ -22,6 +29,10 @@ public:
 
     void clear();
 
+    // Like clear(), but a buffer of the pool is freed instead of being kept
+    // for reuse
+    void discard();
+
     void assign(uint8_t *_bits, int _width, int _height,
                 ImageCleanupFunction cleanup_fnc = nullptr, void *cleanup_info = nullptr);
 
@@ -34,21 +45,29 @@ public:
     void captureDesktop();
     void captureRect(const QRect &rect);
 
+    // Reads the region (relative to the rect) of the screen area into the
+    // same place of the image, which holds a capture of the rect already
+    // -> the rest of the image is kept, where the platform cannot read
+    //    parts, the whole rect is read
+    bool captureRegion(const QRect &rect, const QRect &region);
+
     uint8_t *scanLine(size_t line) { return _bits + bpr * line; }
     const uint8_t *scanLine(size_t line) const { return _bits + bpr * line; }
     const uint8_t *bits() const { return _bits; }
+    size_t bytesPerLine() const { return bpr; }
 
     QImage toQImage() const;
 
+    // Implemented in scale.cpp
+    Image scaled(const QSize &new_size, ScaleFilter filter = Bilinear) const;
+    Image thumbnail(int max_size, ScaleFilter filter = Bilinear) const;
+
     Image &operator=(const Image &src);
     Image &operator=(Image &&src);
 
     bool operator==(const Image &cmp) const;
     bool operator!=(const Image &cmp) const { return !operator==(cmp); }
 
-signals:
-    void reallocate(uint8_t *bits);
-
 private:
     uint8_t *_bits;
     int _width;
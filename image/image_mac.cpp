@@ -48,4 +48,10 @@ void Image::captureRect(const QRect &rect)
     captureFromRef(*this, image_ref);
 }
 
+bool Image::captureRegion(const QRect &rect, const QRect &)
+{
+    captureRect(rect);
+    return _bits != nullptr;
+}
+
 #endif
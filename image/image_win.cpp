@@ -65,4 +65,29 @@ void Image::captureRect(const QRect &rect)
     ReleaseDC(nullptr, hScreenDC);
 }
 
+bool Image::captureRegion(const QRect &rect, const QRect &region)
+{
+    HBITMAP hbmp = reinterpret_cast<HBITMAP>(cleanup_info);
+    if (hbmp == nullptr || rect.size() != size()) {
+        captureRect(rect);
+        return _bits != nullptr;
+    }
+
+    QRect part = region.intersected(QRect(QPoint(0, 0), rect.size()));
+    if (part.isEmpty())
+        return true;
+
+    // The part is copied into its place of the bitmap
+    HDC hScreenDC = GetDC(nullptr);
+    HDC hMemoryDC = CreateCompatibleDC(hScreenDC);
+
+    HGDIOBJ hOldObj = SelectObject(hMemoryDC, static_cast<HGDIOBJ>(hbmp));
+    BitBlt(hMemoryDC, part.x(), part.y(), part.width(), part.height(), hScreenDC, rect.x() + part.x(), rect.y() + part.y(), SRCCOPY | CAPTUREBLT);
+    SelectObject(hMemoryDC, hOldObj);
+
+    DeleteDC(hMemoryDC);
+    ReleaseDC(nullptr, hScreenDC);
+    return true;
+}
+
 #endif
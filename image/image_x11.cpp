@@ -0,0 +1,330 @@
+#if defined(__unix__) && !defined(__APPLE__)
+
+#include "image.h"
+#include "convert.h"
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include <atomic>
+#include <cstdio>
+
+// Shared memory segment, into which the X server copies the screen content
+// -> the Image uses the segment as its buffer, so a capture needs no extra copy.
+//    The segment is kept as long as the size of the captured rect stays the same.
+struct ShmSegment
+{
+    Display *display;
+    XImage *ximage;
+    XShmSegmentInfo info;
+    QRect screen;
+
+    // Second segment for parts of the area (see captureRegion()), attached
+    // with the first part
+    XShmSegmentInfo part_info;
+};
+
+static void releaseSegment(void *ptr)
+{
+    ShmSegment *segment = static_cast<ShmSegment *>(ptr);
+
+    XShmDetach(segment->display, &segment->info);
+    if (segment->part_info.shmaddr != nullptr)
+        XShmDetach(segment->display, &segment->part_info);
+    XSync(segment->display, False);
+
+    if (segment->part_info.shmaddr != nullptr)
+        shmdt(segment->part_info.shmaddr);
+
+    // The data belongs to the segment and must not be freed by XDestroyImage
+    segment->ximage->data = nullptr;
+    XDestroyImage(segment->ximage);
+
+    shmdt(segment->info.shmaddr);
+    XCloseDisplay(segment->display);
+
+    delete segment;
+}
+
+static QRect screenRect(Display *display)
+{
+    Screen *screen = DefaultScreenOfDisplay(display);
+    return QRect(0, 0, WidthOfScreen(screen), HeightOfScreen(screen));
+}
+
+// Only 32 bit TrueColor visuals have the memory layout of QImage::Format_RGB32
+static bool isBgrx(const XImage *ximage)
+{
+    return ximage->bits_per_pixel == 32 && ximage->byte_order == LSBFirst &&
+           ximage->red_mask == 0xff0000 && ximage->green_mask == 0xff00 && ximage->blue_mask == 0xff;
+}
+
+// The default error handler of Xlib terminates the process -> requests, which
+// may fail (e.g. attaching shared memory on a remote display, or reading an
+// area, after the screen shrank), run with a handler, which only records the
+// error
+static std::atomic<bool> x_error(false);
+
+static int recordError(Display *, XErrorEvent *)
+{
+    x_error = true;
+    return 0;
+}
+
+class ErrorTrap
+{
+public:
+    ErrorTrap(Display *display) : display(display)
+    {
+        x_error = false;
+        previous = XSetErrorHandler(recordError);
+    }
+
+    ~ErrorTrap() { XSetErrorHandler(previous); }
+
+    // Requests with a reply (e.g. XShmGetImage) report their errors before
+    // they return, the others (e.g. XShmAttach) need a sync() first
+    bool failed() const { return x_error; }
+    void sync() const { XSync(display, False); }
+
+private:
+    Display *display;
+    int (*previous)(Display *, XErrorEvent *);
+};
+
+// Creates shared memory of the size and attaches it on both sides
+static bool attachMemory(Display *display, XShmSegmentInfo &info, size_t size)
+{
+    info.shmaddr = nullptr;
+    info.shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+    if (info.shmid < 0)
+        return false;
+
+    info.shmaddr = static_cast<char *>(shmat(info.shmid, nullptr, 0));
+    info.readOnly = False;
+
+    bool attached = false;
+    if (info.shmaddr != reinterpret_cast<char *>(-1)) {
+        ErrorTrap trap(display);
+        attached = XShmAttach(display, &info);
+        trap.sync();
+        attached = attached && !trap.failed();
+    }
+
+    // Marked for deletion right away -> the segment is removed, as soon as both
+    // sides detached, even if the process crashes
+    shmctl(info.shmid, IPC_RMID, nullptr);
+
+    if (!attached) {
+        if (info.shmaddr != reinterpret_cast<char *>(-1))
+            shmdt(info.shmaddr);
+        info.shmaddr = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+static ShmSegment *createSegment(Display *display, int width, int height)
+{
+    if (!XShmQueryExtension(display))
+        return nullptr;
+
+    int screen = DefaultScreen(display);
+
+    ShmSegment *segment = new ShmSegment;
+    segment->display = display;
+    segment->screen = screenRect(display);
+    segment->part_info.shmaddr = nullptr;
+    segment->ximage = XShmCreateImage(display, DefaultVisual(display, screen), static_cast<unsigned int>(DefaultDepth(display, screen)),
+                                      ZPixmap, nullptr, &segment->info, static_cast<unsigned int>(width), static_cast<unsigned int>(height));
+
+    if (segment->ximage == nullptr) {
+        delete segment;
+        return nullptr;
+    }
+
+    if (!isBgrx(segment->ximage)) {
+        XDestroyImage(segment->ximage);
+        delete segment;
+        return nullptr;
+    }
+
+    size_t size = static_cast<size_t>(segment->ximage->bytes_per_line) * static_cast<size_t>(height);
+
+    if (!attachMemory(display, segment->info, size)) {
+        XDestroyImage(segment->ximage);
+        delete segment;
+        return nullptr;
+    }
+
+    segment->ximage->data = segment->info.shmaddr;
+
+    return segment;
+}
+
+// Without MIT-SHM (e.g. remote displays) the image is transferred over the socket
+static bool captureWithoutShm(Image &dest, Display *display, const QRect &rect)
+{
+    XImage *ximage = XGetImage(display, DefaultRootWindow(display), rect.x(), rect.y(),
+                               static_cast<unsigned int>(rect.width()), static_cast<unsigned int>(rect.height()), AllPlanes, ZPixmap);
+    if (ximage == nullptr)
+        return false;
+
+    bool success = isBgrx(ximage);
+    if (success) {
+        if (dest.size() != rect.size())
+            dest.resize(rect.size());
+        conv::copyBgra(reinterpret_cast<const uint8_t *>(ximage->data), ximage->bytes_per_line,
+                       dest.scanLine(0), static_cast<int>(dest.bytesPerLine()), rect.width(), rect.height());
+    }
+
+    XDestroyImage(ximage);
+    return success;
+}
+
+void Image::captureDesktop()
+{
+    // The connection of an existing segment saves opening a new one
+    if (cleanup_fnc == releaseSegment) {
+        captureRect(static_cast<ShmSegment *>(cleanup_info)->screen);
+        return;
+    }
+
+    Display *display = XOpenDisplay(nullptr);
+    if (display == nullptr) {
+        fprintf(stderr, "Could not open X display\n");
+        clear();
+        return;
+    }
+
+    QRect screen = screenRect(display);
+    XCloseDisplay(display);
+
+    captureRect(screen);
+}
+
+void Image::captureRect(const QRect &rect)
+{
+    if (rect.width() < 1 || rect.height() < 1) {
+        // Target image is empty
+        clear();
+        return;
+    }
+
+    ShmSegment *segment = cleanup_fnc == releaseSegment ? static_cast<ShmSegment *>(cleanup_info) : nullptr;
+
+    if (segment == nullptr || rect.size() != size()) {
+        Display *display = XOpenDisplay(nullptr);
+        if (display == nullptr) {
+            fprintf(stderr, "Could not open X display\n");
+            clear();
+            return;
+        }
+
+        // Requests outside of the screen raise an X error, which terminates the application
+        if (!screenRect(display).contains(rect)) {
+            fprintf(stderr, "Capture area is outside of the screen\n");
+            XCloseDisplay(display);
+            clear();
+            return;
+        }
+
+        segment = createSegment(display, rect.width(), rect.height());
+        if (segment == nullptr) {
+            if (!captureWithoutShm(*this, display, rect)) {
+                fprintf(stderr, "Could not capture screen, only 32 bit visuals are supported\n");
+                clear();
+            }
+            XCloseDisplay(display);
+            return;
+        }
+
+        assign(reinterpret_cast<uint8_t *>(segment->info.shmaddr),
+               rect.width(),
+               rect.height(),
+               releaseSegment,
+               segment);
+
+        // The X server decides about the padding of the rows
+        bpr = static_cast<size_t>(segment->ximage->bytes_per_line);
+    } else if (!segment->screen.contains(rect)) {
+        fprintf(stderr, "Capture area is outside of the screen\n");
+        clear();
+        return;
+    }
+
+    bool success;
+    {
+        ErrorTrap trap(segment->display);
+        success = XShmGetImage(segment->display, DefaultRootWindow(segment->display), segment->ximage, rect.x(), rect.y(), AllPlanes) &&
+                  !trap.failed();
+    }
+
+    if (!success) {
+        fprintf(stderr, "XShmGetImage failed\n");
+        clear();
+    }
+}
+
+bool Image::captureRegion(const QRect &rect, const QRect &region)
+{
+    ShmSegment *segment = cleanup_fnc == releaseSegment ? static_cast<ShmSegment *>(cleanup_info) : nullptr;
+
+    // Parts are only read into a segment of the area
+    if (segment == nullptr || rect.size() != size() || !segment->screen.contains(rect)) {
+        captureRect(rect);
+        return _bits != nullptr;
+    }
+
+    QRect part = region.intersected(QRect(QPoint(0, 0), rect.size()));
+    if (part.isEmpty())
+        return true;
+
+    Display *display = segment->display;
+    int screen = DefaultScreen(display);
+
+    // The server writes the rows of the part without gaps -> they go into the
+    // second segment and are copied to their place from there
+    if (segment->part_info.shmaddr == nullptr && !attachMemory(display, segment->part_info, bpr * static_cast<size_t>(_height))) {
+        captureRect(rect);
+        return _bits != nullptr;
+    }
+
+    // Only the header, the data is in the segment
+    XImage *ximage = XShmCreateImage(display, DefaultVisual(display, screen), static_cast<unsigned int>(DefaultDepth(display, screen)),
+                                     ZPixmap, segment->part_info.shmaddr, &segment->part_info,
+                                     static_cast<unsigned int>(part.width()), static_cast<unsigned int>(part.height()));
+    if (ximage == nullptr) {
+        captureRect(rect);
+        return _bits != nullptr;
+    }
+
+    bool success;
+    {
+        ErrorTrap trap(display);
+        success = XShmGetImage(display, DefaultRootWindow(display), ximage, rect.x() + part.x(), rect.y() + part.y(), AllPlanes) &&
+                  !trap.failed();
+    }
+
+    if (success) {
+        conv::copyBgra(reinterpret_cast<const uint8_t *>(ximage->data), ximage->bytes_per_line,
+                       scanLine(static_cast<size_t>(part.y())) + static_cast<size_t>(part.x()) * 4, static_cast<int>(bpr),
+                       part.width(), part.height());
+    }
+
+    ximage->data = nullptr;
+    XDestroyImage(ximage);
+
+    if (!success) {
+        fprintf(stderr, "XShmGetImage failed\n");
+        clear();
+    }
+    return success;
+}
+
+#endif
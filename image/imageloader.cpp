@@ -0,0 +1,126 @@
+#include "imageloader.h"
+#include "convert.h"
+#include "image.h"
+#include "qoi.h"
+
+#include "utils/parallel.h"
+
+#include <QFile>
+#include <QImageReader>
+
+#include <atomic>
+
+static bool fail(Image &image, QString *error, const QString &msg)
+{
+    image.clear();
+    if (error != nullptr)
+        *error = msg;
+    return false;
+}
+
+static bool loadQoi(const QString &file_name, Image &image, QString *error)
+{
+    QFile file(file_name);
+    if (!file.open(QIODevice::ReadOnly))
+        return fail(image, error, file.errorString());
+
+    if (!qoi::decode(file.readAll(), image))
+        return fail(image, error, "Invalid QOI image");
+
+    return true;
+}
+
+// Copies a decoded QImage of any format into the image
+static void convertInto(const QImage &src, Image &image)
+{
+    switch (src.format()) {
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32:
+        image.resize(src.size());
+        conv::copyBgra(src.constBits(), src.bytesPerLine(),
+                       image.scanLine(0), static_cast<int>(image.bytesPerLine()), src.width(), src.height());
+        break;
+    case QImage::Format_RGB888:
+        image.resize(src.size());
+        conv::rgb24ToBgra(src.constBits(), src.bytesPerLine(),
+                          image.scanLine(0), static_cast<int>(image.bytesPerLine()), src.width(), src.height());
+        break;
+    case QImage::Format_Grayscale8:
+        image.resize(src.size());
+        conv::gray8ToBgra(src.constBits(), src.bytesPerLine(),
+                          image.scanLine(0), static_cast<int>(image.bytesPerLine()), src.width(), src.height());
+        break;
+    default: {
+        // Formats without a dedicated kernel (palette, 16bit, premultiplied...)
+        QImage converted = src.convertToFormat(QImage::Format_RGB32);
+        image.resize(converted.size());
+        conv::copyBgra(converted.constBits(), converted.bytesPerLine(),
+                       image.scanLine(0), static_cast<int>(image.bytesPerLine()), converted.width(), converted.height());
+        break;
+    }
+    }
+}
+
+bool ImageLoader::load(const QString &file_name, Image &image, QString *error)
+{
+    image.clear();
+
+    if (file_name.endsWith(".qoi", Qt::CaseInsensitive))
+        return loadQoi(file_name, image, error);
+
+    QImageReader reader(file_name);
+
+    QSize size = reader.size();
+    QImage::Format format = reader.imageFormat();
+
+    if (size.isValid() && (format == QImage::Format_RGB32 || format == QImage::Format_ARGB32)) {
+        // The decoders of Qt keep the buffer of the target, if size and format match
+        // -> the pixels are decoded directly into the image without any copy
+        image.resize(size);
+
+        QImage target(image.scanLine(0), size.width(), size.height(),
+                      static_cast<int>(image.bytesPerLine()), format);
+
+        if (!reader.read(&target))
+            return fail(image, error, reader.errorString());
+
+        // Some plugins allocate their own image anyway
+        if (target.constBits() != image.bits())
+            convertInto(target, image);
+
+        return true;
+    }
+
+    QImage decoded;
+    if (!reader.read(&decoded))
+        return fail(image, error, reader.errorString());
+
+    convertInto(decoded, image);
+
+    return true;
+}
+
+int ImageLoader::loadAll(const QStringList &file_names, std::vector<Image> &images)
+{
+    images.clear();
+    images.resize(static_cast<size_t>(file_names.size()));
+
+    std::atomic<int> num_loaded(0);
+
+    // Files are spread over the threads of the pool, nested conversions
+    // are safe, because parallelFor() lets the caller take part
+    parallelFor(file_names.size(), 1, [&](int begin, int end) {
+        int index;
+        for (index = begin; index < end; index++) {
+            if (load(file_names[index], images[static_cast<size_t>(index)]))
+                num_loaded++;
+        }
+    });
+
+    return num_loaded;
+}
+
+QString ImageLoader::fileFilter()
+{
+    return QObject::tr("Images (*.png *.jpg *.jpeg *.bmp *.qoi);;All files (*)");
+}
@@ -0,0 +1,28 @@
+#ifndef IMAGELOADER_H
+#define IMAGELOADER_H
+
+#include <QString>
+#include <QStringList>
+
+#include <vector>
+
+class Image;
+
+class ImageLoader
+{
+public:
+    // Decodes PNG, JPEG, BMP, QOI and every other format Qt supports into BGRA.
+    // Formats the decoders deliver as 32 bit are written directly into the buffer
+    // of the image, everything else is converted by the kernels of convert.h.
+    // Returns false and leaves the image empty, if the file cannot be decoded.
+    static bool load(const QString &file_name, Image &image, QString *error = nullptr);
+
+    // Decodes several files at the same time, images are in the order of the
+    // file names. Returns the number of files, which were loaded successfully.
+    static int loadAll(const QStringList &file_names, std::vector<Image> &images);
+
+    // Filter for file dialogs with all formats load() handles
+    static QString fileFilter();
+};
+
+#endif // IMAGELOADER_H
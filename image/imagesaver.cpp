@@ -0,0 +1,211 @@
+#include "imagesaver.h"
+#include "image.h"
+#include "qoi.h"
+
+#include <QFile>
+#include <QImageWriter>
+#include <QMutex>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThread>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+#include <algorithm>
+#include <cstring>
+
+struct SaveJob
+{
+    Image image;
+    QString file_name;
+    ImageSaver::Format format;
+    int compression;
+
+    mutable QMutex mutex;
+    mutable QWaitCondition condition;
+    bool finished;
+    bool success;
+    QString error;
+};
+
+// Own pool, so that encoding many images does not block parallelFor() of the
+// global pool (which is used by the conversion and scaling kernels)
+static QThreadPool &savePool()
+{
+    static QThreadPool pool;
+    return pool;
+}
+
+// Limits the number of image copies waiting for their encoder
+static QSemaphore &freeSlots()
+{
+    static QSemaphore free_slots(std::max(1, QThread::idealThreadCount()) * 2);
+    return free_slots;
+}
+
+static bool writePng(SaveJob &job)
+{
+    // Wraps the pixels without copying, the job owns the image until it is written
+    QImage image(job.image.bits(), job.image.width(), job.image.height(),
+                 static_cast<int>(job.image.bytesPerLine()), QImage::Format_RGB32);
+
+    QImageWriter writer(job.file_name, "png");
+
+    // Qt maps the quality to the zlib level -> compression = (100 - quality) * 9 / 91
+    if (job.compression >= 0)
+        writer.setQuality(100 - (std::min(job.compression, 9) * 91 + 8) / 9);
+
+    if (!writer.write(image)) {
+        job.error = writer.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+static bool writeFile(SaveJob &job, const char *data, qint64 size)
+{
+    QFile file(job.file_name);
+    if (!file.open(QIODevice::WriteOnly)) {
+        job.error = file.errorString();
+        return false;
+    }
+
+    if (file.write(data, size) != size) {
+        job.error = file.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+static bool writeQoi(SaveJob &job)
+{
+    QByteArray data = qoi::encode(job.image.bits(), static_cast<int>(job.image.bytesPerLine()),
+                                  job.image.width(), job.image.height());
+    if (data.isEmpty()) {
+        job.error = "Image is empty";
+        return false;
+    }
+
+    return writeFile(job, data.constData(), data.size());
+}
+
+static bool writeRaw(SaveJob &job)
+{
+    size_t row_size = static_cast<size_t>(job.image.width()) * 4;
+
+    if (job.image.bytesPerLine() == row_size)
+        return writeFile(job, reinterpret_cast<const char *>(job.image.bits()),
+                         static_cast<qint64>(row_size) * job.image.height());
+
+    // Remove the padding of the rows
+    QByteArray data;
+    data.resize(static_cast<int>(row_size) * job.image.height());
+
+    int line;
+    for (line = 0; line < job.image.height(); line++)
+        memcpy(data.data() + row_size * static_cast<size_t>(line), job.image.scanLine(static_cast<size_t>(line)), row_size);
+
+    return writeFile(job, data.constData(), data.size());
+}
+
+class SaveRunnable : public QRunnable
+{
+public:
+    SaveRunnable(const std::shared_ptr<SaveJob> &job) : job(job) {}
+
+    void run() override
+    {
+        bool success;
+        switch (job->format) {
+        case ImageSaver::QOI:
+            success = writeQoi(*job);
+            break;
+        case ImageSaver::RawBGRA:
+            success = writeRaw(*job);
+            break;
+        case ImageSaver::PNG:
+        default:
+            success = writePng(*job);
+            break;
+        }
+
+        // The copy is not needed anymore, even if the handle is kept alive
+        job->image.clear();
+
+        QMutexLocker locker(&job->mutex);
+        job->success = success;
+        job->finished = true;
+        job->condition.wakeAll();
+        locker.unlock();
+
+        freeSlots().release();
+    }
+
+private:
+    std::shared_ptr<SaveJob> job;
+};
+
+bool SaveHandle::isFinished() const
+{
+    if (job == nullptr)
+        return true;
+
+    QMutexLocker locker(&job->mutex);
+    return job->finished;
+}
+
+bool SaveHandle::wait() const
+{
+    if (job == nullptr)
+        return false;
+
+    QMutexLocker locker(&job->mutex);
+    while (!job->finished)
+        job->condition.wait(&job->mutex);
+
+    return job->success;
+}
+
+QString SaveHandle::lastError() const
+{
+    if (job == nullptr)
+        return QString();
+
+    QMutexLocker locker(&job->mutex);
+    return job->error;
+}
+
+ImageSaver::Format ImageSaver::formatFromFileName(const QString &file_name)
+{
+    if (file_name.endsWith(".qoi", Qt::CaseInsensitive))
+        return QOI;
+    if (file_name.endsWith(".bgra", Qt::CaseInsensitive) || file_name.endsWith(".raw", Qt::CaseInsensitive))
+        return RawBGRA;
+    return PNG;
+}
+
+SaveHandle ImageSaver::save(const Image &image, const QString &file_name, Format format, int compression)
+{
+    freeSlots().acquire();
+
+    std::shared_ptr<SaveJob> job = std::make_shared<SaveJob>();
+    job->image = image;
+    job->file_name = file_name;
+    job->format = format == Auto ? formatFromFileName(file_name) : format;
+    job->compression = compression;
+    job->finished = false;
+    job->success = false;
+
+    savePool().start(new SaveRunnable(job));
+
+    SaveHandle handle;
+    handle.job = job;
+    return handle;
+}
+
+void ImageSaver::waitForAll()
+{
+    savePool().waitForDone();
+}
@@ -0,0 +1,56 @@
+#ifndef IMAGESAVER_H
+#define IMAGESAVER_H
+
+#include <QString>
+
+#include <memory>
+
+class Image;
+struct SaveJob;
+
+// Handle of an image, which is saved in the background
+// -> destroying the handle does not cancel the job
+class SaveHandle
+{
+public:
+    SaveHandle() {}
+
+    bool isValid() const { return job != nullptr; }
+    bool isFinished() const;
+
+    // Blocks until the image is written, returns false on errors
+    bool wait() const;
+
+    QString lastError() const;
+
+private:
+    std::shared_ptr<SaveJob> job;
+
+    friend class ImageSaver;
+};
+
+class ImageSaver
+{
+public:
+    enum Format
+    {
+        Auto,   // -> chosen by the file extension, PNG if unknown
+        PNG,
+        QOI,
+        RawBGRA // -> tightly packed rows without header
+    };
+
+    static Format formatFromFileName(const QString &file_name);
+
+    // Copies the image and encodes it on a worker thread. The compression ranges
+    // from 0 (fastest) to 9 (smallest file), -1 uses the default of the format and
+    // only affects PNG. If too many images are queued already, the call blocks
+    // until one of them is written -> memory usage stays bounded in loops.
+    static SaveHandle save(const Image &image, const QString &file_name,
+                           Format format = Auto, int compression = -1);
+
+    // Blocks until every queued image is written
+    static void waitForAll();
+};
+
+#endif // IMAGESAVER_H
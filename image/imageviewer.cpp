@@ -44,6 +44,7 @@ ImageViewer::ImageViewer(QDialog *parent, Qt::WindowFlags f)
 
 void ImageViewer::showImage(const Image &image)
 {
+    source = image;
     this->image = image.toQImage();
 
     scalableImage->setPixmap(QPixmap::fromImage(this->image));
@@ -159,6 +160,7 @@ void ImageViewer::scaleImage(double factor, int zoomInOut)
     scaleFactor = newScaleFactor;
 
     scalableImage->resize(scaleFactor * scalableImage->pixmap()->size());
+    updateScaledPixmap();
 
     adjustScrollBar(scrollArea->horizontalScrollBar(), factorQuot);
     adjustScrollBar(scrollArea->verticalScrollBar(), factorQuot);
@@ -192,6 +194,17 @@ void ImageViewer::scaleImage(double factor, int zoomInOut)
     }
 }
 
+void ImageViewer::updateScaledPixmap()
+{
+    // Zoom-out levels are filtered once when the zoom changes,
+    // instead of smoothing the pixmap in every paint event
+    if (scaleFactor < 1.0) {
+        Image scaled = source.scaled(scalableImage->size(), Image::Lanczos);
+        scalableImage->setScaledPixmap(QPixmap::fromImage(scaled.toQImage()));
+    } else
+        scalableImage->setScaledPixmap(QPixmap());
+}
+
 void ImageViewer::adjustScrollBar(QScrollBar *scrollBar, double factor)
 {
     scrollBar->setValue(static_cast<int>(factor * scrollBar->value()
@@ -200,6 +213,12 @@ void ImageViewer::adjustScrollBar(QScrollBar *scrollBar, double factor)
 
 void ScalableImage::paintEvent(QPaintEvent *event)
 {
+    if (!_scaledPixmap.isNull() && _scaledPixmap.size() == size()) {
+        QPainter painter(this);
+        painter.drawPixmap(event->rect(), _scaledPixmap, event->rect());
+        return;
+    }
+
     double scaleFactor = static_cast<double>(_pixmap.size().width()) / static_cast<double>(size().width());
 
     QPainter painter(this);
@@ -43,8 +43,10 @@ private slots:
 
 private:
     void scaleImage(double factor, int zoomInOut);
+    void updateScaledPixmap();
     void adjustScrollBar(QScrollBar *scrollBar, double factor);
 
+    Image source;
     QImage image;
     QVBoxLayout *mainLayout;
     LabelEventFilter *labelEventFilter;
@@ -72,14 +74,18 @@ class ScalableImage : public QWidget
 public:
     ScalableImage(QWidget *parent = nullptr) : QWidget(parent) {}
 
-    void setPixmap(QPixmap &&pixmap) { _pixmap = std::move(pixmap); resize(_pixmap.size()); }
+    void setPixmap(QPixmap &&pixmap) { _pixmap = std::move(pixmap); _scaledPixmap = QPixmap(); resize(_pixmap.size()); }
     const QPixmap *pixmap() const { return &_pixmap; }
 
+    // Pixmap that has already been scaled to the size of the widget
+    void setScaledPixmap(QPixmap &&pixmap) { _scaledPixmap = std::move(pixmap); update(); }
+
 protected:
     void paintEvent(QPaintEvent *event) override;
 
 private:
     QPixmap _pixmap;
+    QPixmap _scaledPixmap;
 };
 
 class LabelEventFilter : public QObject
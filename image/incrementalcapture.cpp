@@ -0,0 +1,217 @@
+#include "incrementalcapture.h"
+
+#include "utils/parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+IncrementalCapture::IncrementalCapture(const QRect &rect) :
+    rect(rect),
+    damage_tracker(rect),
+    _unchanged(false),
+    changed_tiles(0),
+    _version(0)
+{
+}
+
+bool IncrementalCapture::capture()
+{
+    bool first = _frame.bits() == nullptr;
+    bool damage_known = damage_tracker.takeDamage(damage);
+
+    // Nothing was redrawn -> the screen does not even need to be read
+    if (!first && damage_known && damage.empty()) {
+        _unchanged = true;
+        changed_tiles = 0;
+        return true;
+    }
+
+    // The buffer keeps its platform resources (e.g. shared memory) between
+    // captures -> with known damage, only the damaged tiles are read into it
+    bool whole = first || !damage_known || buffer.size() != rect.size() || _frame.size() != rect.size();
+    if (whole) {
+        buffer.captureRect(rect);
+        if (buffer.bits() == nullptr)
+            return false;
+    }
+
+    if (first || buffer.size() != _frame.size()) {
+        _frame = buffer;
+        _unchanged = false;
+        changed_tiles = ((buffer.width() + tile_size - 1) / tile_size) * ((buffer.height() + tile_size - 1) / tile_size);
+
+        _version++;
+        tile_versions.assign(static_cast<size_t>(changed_tiles), _version);
+        return true;
+    }
+
+    if (!damage_known)
+        damage.assign(1, QRect(QPoint(0, 0), buffer.size()));
+
+    markTiles(damage);
+
+    if (!whole && !captureTiles())
+        return false;
+
+    _unchanged = !compareTiles();
+    return true;
+}
+
+void IncrementalCapture::markTiles(const std::vector<QRect> &regions)
+{
+    int width = _frame.width();
+    int height = _frame.height();
+    int tiles_x = (width + tile_size - 1) / tile_size;
+    int tiles_y = (height + tile_size - 1) / tile_size;
+
+    // Mark the tiles, which overlap with damaged regions
+    dirty.assign(static_cast<size_t>(tiles_x * tiles_y), 0);
+    for (const QRect &region : regions) {
+        QRect clipped = region.intersected(QRect(0, 0, width, height));
+        if (clipped.isEmpty())
+            continue;
+
+        int tx, ty;
+        for (ty = clipped.top() / tile_size; ty <= clipped.bottom() / tile_size; ty++) {
+            for (tx = clipped.left() / tile_size; tx <= clipped.right() / tile_size; tx++)
+                dirty[static_cast<size_t>(ty * tiles_x + tx)] = 1;
+        }
+    }
+}
+
+bool IncrementalCapture::captureTiles()
+{
+    int width = _frame.width();
+    int height = _frame.height();
+    int tiles_x = (width + tile_size - 1) / tile_size;
+    int tiles_y = (height + tile_size - 1) / tile_size;
+
+    // Every read is a round trip to the server -> a row of tiles is read from
+    // its first to its last dirty tile, and consecutive rows with the same
+    // span are read together
+    QRect pending;
+    int ty;
+    for (ty = 0; ty <= tiles_y; ty++) {
+        QRect span;
+        if (ty < tiles_y) {
+            int first = tiles_x;
+            int last = -1;
+            int tx;
+            for (tx = 0; tx < tiles_x; tx++) {
+                if (dirty[static_cast<size_t>(ty * tiles_x + tx)]) {
+                    first = std::min(first, tx);
+                    last = tx;
+                }
+            }
+            if (last >= 0)
+                span = QRect(first * tile_size, ty * tile_size, (last - first + 1) * tile_size, tile_size);
+        }
+
+        if (!pending.isEmpty() && !span.isEmpty() && span.left() == pending.left() && span.right() == pending.right()) {
+            pending.setBottom(span.bottom());
+            continue;
+        }
+
+        if (!pending.isEmpty() && !buffer.captureRegion(rect, pending))
+            return false;
+        pending = span;
+    }
+
+    return buffer.bits() != nullptr;
+}
+
+bool IncrementalCapture::compareTiles()
+{
+    int width = _frame.width();
+    int height = _frame.height();
+    int tiles_x = (width + tile_size - 1) / tile_size;
+    int tiles_y = (height + tile_size - 1) / tile_size;
+
+    std::atomic<int> num_changed(0);
+    uint64_t next_version = _version + 1;
+
+    parallelFor(tiles_y, std::max(1, (1 << 18) / (width * tile_size)), [&](int begin, int end) {
+        int ty;
+        for (ty = begin; ty < end; ty++) {
+            int top = ty * tile_size;
+            int rows = std::min(tile_size, height - top);
+
+            int tx;
+            for (tx = 0; tx < tiles_x; tx++) {
+                if (!dirty[static_cast<size_t>(ty * tiles_x + tx)])
+                    continue;
+
+                size_t offset = static_cast<size_t>(tx * tile_size) * 4;
+                size_t row_bytes = static_cast<size_t>(std::min(tile_size, width - tx * tile_size)) * 4;
+
+                // Rows before the first difference are equal already
+                int row;
+                for (row = 0; row < rows; row++) {
+                    size_t line = static_cast<size_t>(top + row);
+                    if (memcmp(buffer.scanLine(line) + offset, _frame.scanLine(line) + offset, row_bytes) != 0)
+                        break;
+                }
+
+                if (row == rows)
+                    continue;
+
+                for (; row < rows; row++) {
+                    size_t line = static_cast<size_t>(top + row);
+                    memcpy(_frame.scanLine(line) + offset, buffer.scanLine(line) + offset, row_bytes);
+                }
+
+                tile_versions[static_cast<size_t>(ty * tiles_x + tx)] = next_version;
+                num_changed++;
+            }
+        }
+    });
+
+    changed_tiles = num_changed;
+    if (changed_tiles > 0)
+        _version = next_version;
+    return changed_tiles > 0;
+}
+
+void IncrementalCapture::copyTo(Image &dest, uint64_t &dest_version) const
+{
+    if (dest.size() != _frame.size() || dest.bits() == nullptr || dest_version == 0 || dest_version > _version) {
+        dest = _frame;
+        dest_version = _version;
+        return;
+    }
+
+    if (dest_version == _version)
+        return;
+
+    int width = _frame.width();
+    int height = _frame.height();
+    int tiles_x = (width + tile_size - 1) / tile_size;
+    int tiles_y = (height + tile_size - 1) / tile_size;
+    uint64_t since = dest_version;
+
+    parallelFor(tiles_y, std::max(1, (1 << 18) / (width * tile_size)), [&](int begin, int end) {
+        int ty;
+        for (ty = begin; ty < end; ty++) {
+            int top = ty * tile_size;
+            int rows = std::min(tile_size, height - top);
+
+            int tx;
+            for (tx = 0; tx < tiles_x; tx++) {
+                if (tile_versions[static_cast<size_t>(ty * tiles_x + tx)] <= since)
+                    continue;
+
+                size_t offset = static_cast<size_t>(tx * tile_size) * 4;
+                size_t row_bytes = static_cast<size_t>(std::min(tile_size, width - tx * tile_size)) * 4;
+
+                int row;
+                for (row = 0; row < rows; row++) {
+                    size_t line = static_cast<size_t>(top + row);
+                    memcpy(dest.scanLine(line) + offset, _frame.scanLine(line) + offset, row_bytes);
+                }
+            }
+        }
+    });
+
+    dest_version = _version;
+}
@@ -0,0 +1,65 @@
+#ifndef INCREMENTALCAPTURE_H
+#define INCREMENTALCAPTURE_H
+
+#include <QRect>
+
+#include <vector>
+
+#include "damagetracker.h"
+#include "image.h"
+
+// Captures a screen area into a persistent frame and only copies the tiles,
+// which changed since the previous capture.
+//
+// If the platform reports damaged regions (XDamage), the screen is not read at
+// all while nothing changes and only damaged tiles are read and compared.
+// Otherwise the whole area is captured into a scratch buffer and compared tile
+// by tile.
+class IncrementalCapture
+{
+public:
+    IncrementalCapture(const QRect &rect);
+
+    // Returns false, if the screen could not be captured
+    bool capture();
+
+    const Image &frame() const { return _frame; }
+
+    // Counts the captures, which changed the frame
+    uint64_t version() const { return _version; }
+
+    // Copies the frame into an image, which holds the frame of an earlier
+    // version -> only the tiles, which changed since then, are copied (all of
+    // them for version 0 or an image of another size)
+    void copyTo(Image &dest, uint64_t &dest_version) const;
+
+    // True, if the frame is identical to the one of the previous capture
+    bool unchanged() const { return _unchanged; }
+
+    // Number of tiles copied by the last capture
+    int changedTiles() const { return changed_tiles; }
+
+    static const int tile_size = 64;
+
+private:
+    void markTiles(const std::vector<QRect> &regions);
+    bool captureTiles();
+    bool compareTiles();
+
+    QRect rect;
+    DamageTracker damage_tracker;
+
+    Image buffer;
+    Image _frame;
+
+    bool _unchanged;
+    int changed_tiles;
+
+    uint64_t _version;
+    std::vector<uint64_t> tile_versions; // version, in which the tile changed last
+
+    std::vector<QRect> damage;
+    std::vector<uint8_t> dirty;
+};
+
+#endif // INCREMENTALCAPTURE_H
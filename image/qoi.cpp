@@ -0,0 +1,218 @@
+#include "qoi.h"
+#include "image.h"
+
+#include <cstring>
+
+namespace qoi
+{
+
+static const uint8_t op_index = 0x00;
+static const uint8_t op_diff  = 0x40;
+static const uint8_t op_luma  = 0x80;
+static const uint8_t op_run   = 0xc0;
+static const uint8_t op_rgb   = 0xfe;
+static const uint8_t op_rgba  = 0xff;
+static const uint8_t op_mask  = 0xc0;
+
+static const int header_size = 14;
+static const uint8_t end_marker[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+
+// Limit of the reference implementation -> protects against corrupt headers
+static const uint32_t max_pixels = 400000000;
+
+struct Pixel
+{
+    uint8_t r, g, b, a;
+
+    bool operator==(const Pixel &cmp) const { return memcmp(this, &cmp, sizeof(Pixel)) == 0; }
+    bool operator!=(const Pixel &cmp) const { return !operator==(cmp); }
+};
+
+static inline int hash(const Pixel &px)
+{
+    return (px.r * 3 + px.g * 5 + px.b * 7 + px.a * 11) % 64;
+}
+
+static inline void writeUInt32(uint8_t *out, uint32_t val)
+{
+    out[0] = static_cast<uint8_t>(val >> 24);
+    out[1] = static_cast<uint8_t>(val >> 16);
+    out[2] = static_cast<uint8_t>(val >> 8);
+    out[3] = static_cast<uint8_t>(val);
+}
+
+static inline uint32_t readUInt32(const uint8_t *in)
+{
+    return static_cast<uint32_t>(in[0]) << 24 | static_cast<uint32_t>(in[1]) << 16 |
+           static_cast<uint32_t>(in[2]) << 8 | static_cast<uint32_t>(in[3]);
+}
+
+QByteArray encode(const uint8_t *bits, int stride, int width, int height)
+{
+    QByteArray data;
+    if (bits == nullptr || width <= 0 || height <= 0)
+        return data;
+
+    // Worst case: every pixel is written with op_rgb
+    data.resize(header_size + width * height * 4 + static_cast<int>(sizeof(end_marker)));
+    uint8_t *out = reinterpret_cast<uint8_t *>(data.data());
+
+    memcpy(out, "qoif", 4);
+    writeUInt32(out + 4, static_cast<uint32_t>(width));
+    writeUInt32(out + 8, static_cast<uint32_t>(height));
+    out[12] = 3;
+    out[13] = 0;
+
+    size_t pos = header_size;
+
+    Pixel index[64];
+    memset(index, 0, sizeof(index));
+
+    Pixel prev = {0, 0, 0, 255};
+    int run = 0;
+
+    int x, y;
+    for (y = 0; y < height; y++) {
+        const uint8_t *src = bits + static_cast<ptrdiff_t>(stride) * y;
+        for (x = 0; x < width; x++, src += 4) {
+            Pixel px = {src[2], src[1], src[0], 255};
+
+            if (px == prev) {
+                if (++run == 62) {
+                    out[pos++] = static_cast<uint8_t>(op_run | (run - 1));
+                    run = 0;
+                }
+                continue;
+            }
+
+            if (run > 0) {
+                out[pos++] = static_cast<uint8_t>(op_run | (run - 1));
+                run = 0;
+            }
+
+            int index_pos = hash(px);
+            if (index[index_pos] == px) {
+                out[pos++] = op_index | static_cast<uint8_t>(index_pos);
+            } else {
+                index[index_pos] = px;
+
+                // Differences wrap around, as in the specification
+                int8_t dr = static_cast<int8_t>(px.r - prev.r);
+                int8_t dg = static_cast<int8_t>(px.g - prev.g);
+                int8_t db = static_cast<int8_t>(px.b - prev.b);
+
+                int8_t dr_dg = static_cast<int8_t>(dr - dg);
+                int8_t db_dg = static_cast<int8_t>(db - dg);
+
+                if (dr > -3 && dr < 2 && dg > -3 && dg < 2 && db > -3 && db < 2) {
+                    out[pos++] = op_diff | static_cast<uint8_t>((dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+                } else if (dr_dg > -9 && dr_dg < 8 && dg > -33 && dg < 32 && db_dg > -9 && db_dg < 8) {
+                    out[pos++] = op_luma | static_cast<uint8_t>(dg + 32);
+                    out[pos++] = static_cast<uint8_t>((dr_dg + 8) << 4 | (db_dg + 8));
+                } else {
+                    out[pos++] = op_rgb;
+                    out[pos++] = px.r;
+                    out[pos++] = px.g;
+                    out[pos++] = px.b;
+                }
+            }
+
+            prev = px;
+        }
+    }
+
+    if (run > 0)
+        out[pos++] = static_cast<uint8_t>(op_run | (run - 1));
+
+    memcpy(out + pos, end_marker, sizeof(end_marker));
+    pos += sizeof(end_marker);
+
+    data.resize(static_cast<int>(pos));
+    return data;
+}
+
+bool decode(const QByteArray &data, Image &image)
+{
+    const uint8_t *in = reinterpret_cast<const uint8_t *>(data.constData());
+    size_t size = static_cast<size_t>(data.size());
+
+    if (size < header_size + sizeof(end_marker) || memcmp(in, "qoif", 4) != 0)
+        return false;
+
+    uint32_t width = readUInt32(in + 4);
+    uint32_t height = readUInt32(in + 8);
+    uint8_t channels = in[12];
+
+    if (width == 0 || height == 0 || height > max_pixels / width || (channels != 3 && channels != 4))
+        return false;
+
+    image.resize(static_cast<int>(width), static_cast<int>(height));
+
+    Pixel index[64];
+    memset(index, 0, sizeof(index));
+
+    Pixel px = {0, 0, 0, 255};
+    int run = 0;
+
+    size_t pos = header_size;
+    size_t end = size - sizeof(end_marker);
+
+    size_t x, y;
+    for (y = 0; y < height; y++) {
+        uint8_t *dst = image.scanLine(y);
+        for (x = 0; x < width; x++, dst += 4) {
+            if (run > 0) {
+                run--;
+            } else if (pos < end) {
+                uint8_t op = in[pos++];
+
+                if (op == op_rgb) {
+                    if (pos + 3 > end)
+                        return false;
+                    px.r = in[pos];
+                    px.g = in[pos + 1];
+                    px.b = in[pos + 2];
+                    pos += 3;
+                } else if (op == op_rgba) {
+                    if (pos + 4 > end)
+                        return false;
+                    px.r = in[pos];
+                    px.g = in[pos + 1];
+                    px.b = in[pos + 2];
+                    px.a = in[pos + 3];
+                    pos += 4;
+                } else if ((op & op_mask) == op_index) {
+                    px = index[op];
+                } else if ((op & op_mask) == op_diff) {
+                    px.r = static_cast<uint8_t>(px.r + ((op >> 4) & 0x03) - 2);
+                    px.g = static_cast<uint8_t>(px.g + ((op >> 2) & 0x03) - 2);
+                    px.b = static_cast<uint8_t>(px.b + (op & 0x03) - 2);
+                } else if ((op & op_mask) == op_luma) {
+                    if (pos + 1 > end)
+                        return false;
+                    int dg = (op & 0x3f) - 32;
+                    uint8_t next = in[pos++];
+                    px.r = static_cast<uint8_t>(px.r + dg - 8 + ((next >> 4) & 0x0f));
+                    px.g = static_cast<uint8_t>(px.g + dg);
+                    px.b = static_cast<uint8_t>(px.b + dg - 8 + (next & 0x0f));
+                } else {
+                    run = op & 0x3f;
+                }
+
+                index[hash(px)] = px;
+            } else {
+                // Truncated data
+                return false;
+            }
+
+            dst[0] = px.b;
+            dst[1] = px.g;
+            dst[2] = px.r;
+            dst[3] = px.a;
+        }
+    }
+
+    return true;
+}
+
+} // namespace qoi
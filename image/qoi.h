@@ -0,0 +1,24 @@
+#ifndef QOI_H
+#define QOI_H
+
+#include <QByteArray>
+
+#include <cstdint>
+
+class Image;
+
+// Encoder and decoder for the "Quite OK Image Format" (https://qoiformat.org)
+// -> lossless like PNG, but encodes several times faster, which makes it the
+//    format of choice for dumping many screenshots in a short time
+namespace qoi
+{
+
+// Encodes BGRA pixels, the alpha channel is ignored (3 channels, sRGB)
+QByteArray encode(const uint8_t *bits, int stride, int width, int height);
+
+// Returns false, if the data is not a valid QOI image
+bool decode(const QByteArray &data, Image &image);
+
+} // namespace qoi
+
+#endif // QOI_H
@@ -0,0 +1,306 @@
+#include "image.h"
+#include "convert.h"
+
+#include "utils/parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SCALE_X86
+#include <emmintrin.h>
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#endif
+
+// Fixed point precision of the filter weights
+static const int weight_bits = 14;
+
+// Contributions of the source pixels to every pixel of the target
+// -> the weights of each target pixel are padded to an even number of taps,
+//    so the SSE2 kernels can always process two taps at once
+struct Coefficients
+{
+    int taps;
+    std::vector<int> first;
+    std::vector<int16_t> weights;
+};
+
+static double boxFilter(double x)
+{
+    return (x >= -0.5 && x < 0.5) ? 1.0 : 0.0;
+}
+
+static double bilinearFilter(double x)
+{
+    x = fabs(x);
+    return x < 1.0 ? 1.0 - x : 0.0;
+}
+
+static inline double sinc(double x)
+{
+    if (x == 0.0)
+        return 1.0;
+    x *= 3.14159265358979323846;
+    return sin(x) / x;
+}
+
+static double lanczosFilter(double x)
+{
+    return (x > -3.0 && x < 3.0) ? sinc(x) * sinc(x / 3.0) : 0.0;
+}
+
+static Coefficients calcCoefficients(int src_size, int dst_size, Image::ScaleFilter filter)
+{
+    double (*filter_fnc)(double);
+    double support;
+
+    switch (filter) {
+    case Image::Box:
+        filter_fnc = boxFilter;
+        support = 0.5;
+        break;
+    case Image::Lanczos:
+        filter_fnc = lanczosFilter;
+        support = 3.0;
+        break;
+    case Image::Bilinear:
+    default:
+        filter_fnc = bilinearFilter;
+        support = 1.0;
+        break;
+    }
+
+    double scale = static_cast<double>(src_size) / static_cast<double>(dst_size);
+    double filter_scale = std::max(scale, 1.0);
+    support *= filter_scale;
+
+    Coefficients coef;
+    coef.taps = (static_cast<int>(ceil(support)) * 2 + 2) & ~1;
+    coef.first.resize(static_cast<size_t>(dst_size));
+    coef.weights.assign(static_cast<size_t>(dst_size * coef.taps), 0);
+
+    std::vector<double> w(static_cast<size_t>(coef.taps));
+
+    int index;
+    for (index = 0; index < dst_size; index++) {
+        double center = (index + 0.5) * scale;
+        int first = std::max(static_cast<int>(center - support + 0.5), 0);
+        int last = std::min(static_cast<int>(center + support + 0.5), src_size);
+        int count = std::min(last - first, coef.taps);
+
+        double total = 0.0;
+        int tap;
+        for (tap = 0; tap < count; tap++) {
+            w[static_cast<size_t>(tap)] = filter_fnc((first + tap - center + 0.5) / filter_scale);
+            total += w[static_cast<size_t>(tap)];
+        }
+
+        int16_t *weights = &coef.weights[static_cast<size_t>(index * coef.taps)];
+        for (tap = 0; tap < count; tap++) {
+            double normalized = total != 0.0 ? w[static_cast<size_t>(tap)] / total : 0.0;
+            weights[tap] = static_cast<int16_t>(lround(normalized * (1 << weight_bits)));
+        }
+
+        // Keep taps inside of the source, even if the last ones have no weight
+        coef.first[static_cast<size_t>(index)] = std::max(0, std::min(first, src_size - coef.taps));
+        if (coef.first[static_cast<size_t>(index)] != first) {
+            // Shift weights to match the corrected first index
+            int shift = first - coef.first[static_cast<size_t>(index)];
+            for (tap = coef.taps - 1; tap >= 0; tap--)
+                weights[tap] = tap >= shift ? weights[tap - shift] : 0;
+        }
+    }
+
+    return coef;
+}
+
+static inline uint8_t clampPixel(int val)
+{
+    val = (val + (1 << (weight_bits - 1))) >> weight_bits;
+    return static_cast<uint8_t>(val < 0 ? 0 : (val > 255 ? 255 : val));
+}
+
+static void horizontalPassScalar(const uint8_t *src, uint8_t *dst, int dst_width, const Coefficients &coef)
+{
+    int x;
+    for (x = 0; x < dst_width; x++) {
+        const uint8_t *p = src + coef.first[static_cast<size_t>(x)] * 4;
+        const int16_t *w = &coef.weights[static_cast<size_t>(x * coef.taps)];
+
+        int sum[4] = {0, 0, 0, 0};
+        int tap;
+        for (tap = 0; tap < coef.taps; tap++, p += 4) {
+            sum[0] += p[0] * w[tap];
+            sum[1] += p[1] * w[tap];
+            sum[2] += p[2] * w[tap];
+            sum[3] += p[3] * w[tap];
+        }
+
+        dst[x * 4]     = clampPixel(sum[0]);
+        dst[x * 4 + 1] = clampPixel(sum[1]);
+        dst[x * 4 + 2] = clampPixel(sum[2]);
+        dst[x * 4 + 3] = clampPixel(sum[3]);
+    }
+}
+
+// Processes the pixels [begin, width) of a row
+static void verticalPassScalar(const uint8_t *const *rows, const int16_t *w, int taps, uint8_t *dst, int begin, int width)
+{
+    int x;
+    for (x = begin * 4; x < width * 4; x++) {
+        int sum = 0;
+        int tap;
+        for (tap = 0; tap < taps; tap++)
+            sum += rows[tap][x] * w[tap];
+        dst[x] = clampPixel(sum);
+    }
+}
+
+#ifdef SCALE_X86
+
+TARGET_SSE2 static void horizontalPassSse2(const uint8_t *src, uint8_t *dst, int dst_width, const Coefficients &coef)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32(1 << (weight_bits - 1));
+
+    int x;
+    for (x = 0; x < dst_width; x++) {
+        const uint8_t *p = src + coef.first[static_cast<size_t>(x)] * 4;
+        const int16_t *w = &coef.weights[static_cast<size_t>(x * coef.taps)];
+
+        __m128i sum = round;
+        int tap;
+        for (tap = 0; tap < coef.taps; tap += 2, p += 8) {
+            // Two pixels -> B0 B1 G0 G1 R0 R1 A0 A1 as int16
+            __m128i px = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)), zero);
+            px = _mm_unpacklo_epi16(px, _mm_srli_si128(px, 8));
+
+            int32_t pair;
+            memcpy(&pair, w + tap, 4);
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(px, _mm_set1_epi32(pair)));
+        }
+
+        sum = _mm_srai_epi32(sum, weight_bits);
+        sum = _mm_packs_epi32(sum, sum);
+        int32_t result = _mm_cvtsi128_si32(_mm_packus_epi16(sum, sum));
+        memcpy(dst + x * 4, &result, 4);
+    }
+}
+
+TARGET_SSE2 static void verticalPassSse2(const uint8_t *const *rows, const int16_t *w, int taps, uint8_t *dst, int, int width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32(1 << (weight_bits - 1));
+
+    int x;
+    for (x = 0; x + 4 <= width; x += 4) {
+        __m128i sum0 = round, sum1 = round, sum2 = round, sum3 = round;
+
+        int tap;
+        for (tap = 0; tap < taps; tap += 2) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows[tap] + x * 4));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows[tap + 1] + x * 4));
+
+            int32_t pair;
+            memcpy(&pair, w + tap, 4);
+            __m128i weights = _mm_set1_epi32(pair);
+
+            __m128i a_lo = _mm_unpacklo_epi8(a, zero);
+            __m128i a_hi = _mm_unpackhi_epi8(a, zero);
+            __m128i b_lo = _mm_unpacklo_epi8(b, zero);
+            __m128i b_hi = _mm_unpackhi_epi8(b, zero);
+
+            sum0 = _mm_add_epi32(sum0, _mm_madd_epi16(_mm_unpacklo_epi16(a_lo, b_lo), weights));
+            sum1 = _mm_add_epi32(sum1, _mm_madd_epi16(_mm_unpackhi_epi16(a_lo, b_lo), weights));
+            sum2 = _mm_add_epi32(sum2, _mm_madd_epi16(_mm_unpacklo_epi16(a_hi, b_hi), weights));
+            sum3 = _mm_add_epi32(sum3, _mm_madd_epi16(_mm_unpackhi_epi16(a_hi, b_hi), weights));
+        }
+
+        __m128i lo = _mm_packs_epi32(_mm_srai_epi32(sum0, weight_bits), _mm_srai_epi32(sum1, weight_bits));
+        __m128i hi = _mm_packs_epi32(_mm_srai_epi32(sum2, weight_bits), _mm_srai_epi32(sum3, weight_bits));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x * 4), _mm_packus_epi16(lo, hi));
+    }
+
+    verticalPassScalar(rows, w, taps, dst, x, width);
+}
+
+#endif // SCALE_X86
+
+Image Image::scaled(const QSize &new_size, ScaleFilter filter) const
+{
+    Image dest(linesize_alignment);
+
+    if (_bits == nullptr || new_size.width() < 1 || new_size.height() < 1)
+        return dest;
+
+    if (new_size == size())
+        return Image(*this);
+
+    int dst_width = new_size.width();
+    int dst_height = new_size.height();
+
+    Coefficients coef_x = calcCoefficients(_width, dst_width, filter);
+    Coefficients coef_y = calcCoefficients(_height, dst_height, filter);
+
+    // The filters need at least as many source pixels as taps
+    // -> tiny sources are scaled with the fallback of QImage
+    if (coef_x.taps > _width || coef_y.taps > _height) {
+        QImage image = toQImage().scaled(new_size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation)
+                                 .convertToFormat(QImage::Format_RGB32);
+        dest.resize(new_size);
+        conv::copyBgra(image.constBits(), image.bytesPerLine(),
+                       dest._bits, static_cast<int>(dest.bpr), dst_width, dst_height);
+        return dest;
+    }
+
+    auto horizontal_pass = horizontalPassScalar;
+    auto vertical_pass = verticalPassScalar;
+#ifdef SCALE_X86
+    if (conv::isa() >= conv::SSE2) {
+        horizontal_pass = horizontalPassSse2;
+        vertical_pass = verticalPassSse2;
+    }
+#endif
+
+    // Horizontal pass into an intermediate image with the target width
+    Image temp(16);
+    temp.resize(dst_width, _height);
+
+    parallelFor(_height, std::max(1, (1 << 15) / dst_width), [&](int begin, int end) {
+        int line;
+        for (line = begin; line < end; line++)
+            horizontal_pass(scanLine(static_cast<size_t>(line)), temp.scanLine(static_cast<size_t>(line)),
+                            dst_width, coef_x);
+    });
+
+    // Vertical pass into the target image
+    dest.resize(dst_width, dst_height);
+
+    parallelFor(dst_height, std::max(1, (1 << 15) / dst_width), [&](int begin, int end) {
+        std::vector<const uint8_t *> rows(static_cast<size_t>(coef_y.taps));
+
+        int line;
+        for (line = begin; line < end; line++) {
+            int first = coef_y.first[static_cast<size_t>(line)];
+            const int16_t *w = &coef_y.weights[static_cast<size_t>(line * coef_y.taps)];
+
+            int tap;
+            for (tap = 0; tap < coef_y.taps; tap++)
+                rows[static_cast<size_t>(tap)] = temp.scanLine(static_cast<size_t>(first + tap));
+
+            vertical_pass(rows.data(), w, coef_y.taps, dest.scanLine(static_cast<size_t>(line)), 0, dst_width);
+        }
+    });
+
+    return dest;
+}
+
+Image Image::thumbnail(int max_size, ScaleFilter filter) const
+{
+    if (_width <= max_size && _height <= max_size)
+        return Image(*this);
+
+    return scaled(size().scaled(max_size, max_size, Qt::KeepAspectRatio).expandedTo(QSize(1, 1)), filter);
+}
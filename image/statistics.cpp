@@ -0,0 +1,329 @@
+#include "statistics.h"
+#include "convert.h"
+#include "image.h"
+
+#include "utils/parallel.h"
+
+#include <QMutex>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define STATS_X86
+#include <emmintrin.h>
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#endif
+
+namespace stats
+{
+
+// Bands of rows are processed in parallel from this amount of pixels on
+static const int min_band_pixels = 1 << 18;
+
+// Number of pixels, for which 32 bit sums of squares cannot overflow
+static const int max_chunk = 1 << 16;
+
+struct Accumulator
+{
+    uint64_t sum;
+    uint64_t sum_sq;
+    int min;
+    int max;
+};
+
+static void accumulateScalar(const uint8_t *p, int n, Accumulator &acc)
+{
+    uint32_t sum = 0;
+    uint64_t sum_sq = 0;
+    int min = acc.min;
+    int max = acc.max;
+
+    int x;
+    for (x = 0; x < n; x++) {
+        int val = p[x];
+        sum += static_cast<uint32_t>(val);
+        sum_sq += static_cast<uint64_t>(val * val);
+        min = std::min(min, val);
+        max = std::max(max, val);
+    }
+
+    acc.sum += sum;
+    acc.sum_sq += sum_sq;
+    acc.min = min;
+    acc.max = max;
+}
+
+// Copies one channel of a BGRA row into a contiguous row
+static void extractScalar(const uint8_t *src, int width, int channel, uint8_t *dst)
+{
+    int x;
+    for (x = 0; x < width; x++)
+        dst[x] = src[x * 4 + channel];
+}
+
+#ifdef STATS_X86
+
+TARGET_SSE2 static void accumulateSse2(const uint8_t *p, int n, Accumulator &acc)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    __m128i sum = zero;
+    __m128i sum_sq = zero;
+    __m128i min = _mm_set1_epi8(static_cast<char>(acc.min));
+    __m128i max = _mm_set1_epi8(static_cast<char>(acc.max));
+
+    int x;
+    for (x = 0; x + 16 <= n; x += 16) {
+        __m128i val = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + x));
+
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(val, zero));
+
+        __m128i lo = _mm_unpacklo_epi8(val, zero);
+        __m128i hi = _mm_unpackhi_epi8(val, zero);
+        sum_sq = _mm_add_epi32(sum_sq, _mm_madd_epi16(lo, lo));
+        sum_sq = _mm_add_epi32(sum_sq, _mm_madd_epi16(hi, hi));
+
+        min = _mm_min_epu8(min, val);
+        max = _mm_max_epu8(max, val);
+    }
+
+    uint64_t sums[2];
+    uint32_t sums_sq[4];
+    uint8_t mins[16], maxs[16];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(sums), sum);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(sums_sq), sum_sq);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(mins), min);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(maxs), max);
+
+    acc.sum += sums[0] + sums[1];
+    acc.sum_sq += static_cast<uint64_t>(sums_sq[0]) + sums_sq[1] + sums_sq[2] + sums_sq[3];
+    acc.min = *std::min_element(mins, mins + 16);
+    acc.max = *std::max_element(maxs, maxs + 16);
+
+    accumulateScalar(p + x, n - x, acc);
+}
+
+TARGET_SSE2 static void extractSse2(const uint8_t *src, int width, int channel, uint8_t *dst)
+{
+    const __m128i mask = _mm_set1_epi32(0xff);
+    const __m128i shift = _mm_cvtsi32_si128(channel * 8);
+
+    int x;
+    for (x = 0; x + 16 <= width; x += 16) {
+        const __m128i *p = reinterpret_cast<const __m128i *>(src + x * 4);
+        __m128i a = _mm_and_si128(_mm_srl_epi32(_mm_loadu_si128(p), shift), mask);
+        __m128i b = _mm_and_si128(_mm_srl_epi32(_mm_loadu_si128(p + 1), shift), mask);
+        __m128i c = _mm_and_si128(_mm_srl_epi32(_mm_loadu_si128(p + 2), shift), mask);
+        __m128i d = _mm_and_si128(_mm_srl_epi32(_mm_loadu_si128(p + 3), shift), mask);
+
+        __m128i packed = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x), packed);
+    }
+
+    extractScalar(src + x * 4, width - x, channel, dst + x);
+}
+
+#endif // STATS_X86
+
+bool channelFromName(const std::string &name, Channel &channel)
+{
+    if (name == "blue")
+        channel = Blue;
+    else if (name == "green")
+        channel = Green;
+    else if (name == "red")
+        channel = Red;
+    else if (name == "gray")
+        channel = Gray;
+    else
+        return false;
+    return true;
+}
+
+// Runs fnc for bands of rows of the region, in parallel if the region is large
+static void forRows(const QRect &region, const std::function<void(int begin, int end)> &fnc)
+{
+    parallelFor(region.height(), std::max(1, min_band_pixels / std::max(1, region.width())),
+                [&](int begin, int end) { fnc(region.top() + begin, region.top() + end); });
+}
+
+// Provides one channel of the rows of a region as contiguous bytes
+// -> the kernels do not need to know about the channel and the layout
+class ChannelReader
+{
+public:
+    ChannelReader(const Image &image, const QRect &region, Channel channel) :
+        image(image), region(region), channel(channel), temp(static_cast<size_t>(region.width()))
+    {
+#ifdef STATS_X86
+        if (conv::isa() >= conv::SSE2)
+            extract = extractSse2;
+#endif
+    }
+
+    const uint8_t *row(int line)
+    {
+        const uint8_t *src = image.scanLine(static_cast<size_t>(line)) + region.left() * 4;
+        if (channel == Gray)
+            conv::bgraToGray8(src, 0, temp.data(), 0, region.width(), 1);
+        else
+            extract(src, region.width(), channel, temp.data());
+        return temp.data();
+    }
+
+private:
+    const Image &image;
+    QRect region;
+    Channel channel;
+    std::vector<uint8_t> temp;
+
+    void (*extract)(const uint8_t *, int, int, uint8_t *) = extractScalar;
+};
+
+Summary summarize(const Image &image, const QRect &rect, Channel channel)
+{
+    Summary summary = {0, 0.0, 0.0, 0, 0};
+
+    QRect region = rect.intersected(QRect(QPoint(0, 0), image.size()));
+    if (region.isEmpty())
+        return summary;
+
+    auto accumulate = accumulateScalar;
+#ifdef STATS_X86
+    if (conv::isa() >= conv::SSE2)
+        accumulate = accumulateSse2;
+#endif
+
+    Accumulator total = {0, 0, 255, 0};
+    QMutex mutex;
+
+    forRows(region, [&](int begin, int end) {
+        Accumulator acc = {0, 0, 255, 0};
+        ChannelReader reader(image, region, channel);
+
+        int line;
+        for (line = begin; line < end; line++) {
+            const uint8_t *p = reader.row(line);
+
+            int x;
+            for (x = 0; x < region.width(); x += max_chunk)
+                accumulate(p + x, std::min(max_chunk, region.width() - x), acc);
+        }
+
+        QMutexLocker locker(&mutex);
+        total.sum += acc.sum;
+        total.sum_sq += acc.sum_sq;
+        total.min = std::min(total.min, acc.min);
+        total.max = std::max(total.max, acc.max);
+    });
+
+    summary.count = static_cast<int64_t>(region.width()) * region.height();
+    summary.mean = static_cast<double>(total.sum) / summary.count;
+    summary.variance = std::max(0.0, static_cast<double>(total.sum_sq) / summary.count - summary.mean * summary.mean);
+    summary.min = total.min;
+    summary.max = total.max;
+
+    return summary;
+}
+
+void histogram(const Image &image, const QRect &rect, Channel channel, uint32_t bins[256])
+{
+    memset(bins, 0, 256 * sizeof(uint32_t));
+
+    QRect region = rect.intersected(QRect(QPoint(0, 0), image.size()));
+    if (region.isEmpty())
+        return;
+
+    QMutex mutex;
+
+    forRows(region, [&](int begin, int end) {
+        // Four interleaved histograms -> consecutive equal values do not
+        // have to wait for the increment of the previous one
+        std::vector<uint32_t> local(256 * 4, 0);
+        ChannelReader reader(image, region, channel);
+
+        int line;
+        for (line = begin; line < end; line++) {
+            const uint8_t *p = reader.row(line);
+
+            int x;
+            for (x = 0; x + 4 <= region.width(); x += 4) {
+                local[p[x]]++;
+                local[256 + p[x + 1]]++;
+                local[512 + p[x + 2]]++;
+                local[768 + p[x + 3]]++;
+            }
+            for (; x < region.width(); x++)
+                local[p[x]]++;
+        }
+
+        QMutexLocker locker(&mutex);
+        int bin;
+        for (bin = 0; bin < 256; bin++)
+            bins[bin] += local[static_cast<size_t>(bin)] + local[static_cast<size_t>(256 + bin)] +
+                         local[static_cast<size_t>(512 + bin)] + local[static_cast<size_t>(768 + bin)];
+    });
+}
+
+QColor meanColor(const Image &image, const QRect &rect)
+{
+    Summary blue = summarize(image, rect, Blue);
+    if (blue.count == 0)
+        return QColor();
+
+    Summary green = summarize(image, rect, Green);
+    Summary red = summarize(image, rect, Red);
+
+    return QColor(static_cast<int>(red.mean + 0.5), static_cast<int>(green.mean + 0.5), static_cast<int>(blue.mean + 0.5));
+}
+
+QColor dominantColor(const Image &image, const QRect &rect)
+{
+    QRect region = rect.intersected(QRect(QPoint(0, 0), image.size()));
+    if (region.isEmpty())
+        return QColor();
+
+    // Per bin: count and the sums of blue, green and red
+    static const size_t num_bins = 4096;
+    std::vector<uint64_t> total(num_bins * 4, 0);
+    QMutex mutex;
+
+    forRows(region, [&](int begin, int end) {
+        std::vector<uint64_t> local(num_bins * 4, 0);
+
+        int line;
+        for (line = begin; line < end; line++) {
+            const uint8_t *p = image.scanLine(static_cast<size_t>(line)) + region.left() * 4;
+
+            int x;
+            for (x = 0; x < region.width(); x++, p += 4) {
+                size_t bin = (static_cast<size_t>(p[2] >> 4) << 8 | static_cast<size_t>(p[1] >> 4) << 4 | static_cast<size_t>(p[0] >> 4)) * 4;
+                local[bin]++;
+                local[bin + 1] += p[0];
+                local[bin + 2] += p[1];
+                local[bin + 3] += p[2];
+            }
+        }
+
+        QMutexLocker locker(&mutex);
+        size_t index;
+        for (index = 0; index < total.size(); index++)
+            total[index] += local[index];
+    });
+
+    size_t best = 0;
+    size_t bin;
+    for (bin = 1; bin < num_bins; bin++) {
+        if (total[bin * 4] > total[best * 4])
+            best = bin;
+    }
+
+    uint64_t count = total[best * 4];
+    return QColor(static_cast<int>((total[best * 4 + 3] + count / 2) / count),
+                  static_cast<int>((total[best * 4 + 2] + count / 2) / count),
+                  static_cast<int>((total[best * 4 + 1] + count / 2) / count));
+}
+
+} // namespace stats
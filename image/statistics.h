@@ -0,0 +1,51 @@
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include <QColor>
+#include <QRect>
+
+#include <cstdint>
+#include <string>
+
+class Image;
+
+// Statistics over a rectangular region of an image
+//
+// The region is clipped to the image, the padding of the rows is never read.
+// Sums, minimum and maximum are computed by SSE2 kernels if available, large
+// regions are split into bands of rows, which are processed in parallel.
+namespace stats
+{
+
+enum Channel
+{
+    Blue,
+    Green,
+    Red,
+    Gray // -> luma with BT.601 weights, as in conv::bgraToGray8
+};
+
+// Accepts "blue", "green", "red" and "gray"
+bool channelFromName(const std::string &name, Channel &channel);
+
+struct Summary
+{
+    int64_t count;
+    double mean;
+    double variance;
+    int min;
+    int max;
+};
+
+Summary summarize(const Image &image, const QRect &rect, Channel channel);
+
+void histogram(const Image &image, const QRect &rect, Channel channel, uint32_t bins[256]);
+
+QColor meanColor(const Image &image, const QRect &rect);
+
+// Average color of the most frequent color, with 4 bits per channel
+QColor dominantColor(const Image &image, const QRect &rect);
+
+} // namespace stats
+
+#endif // STATISTICS_H
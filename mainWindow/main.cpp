@@ -1,4 +1,6 @@
 #include "mainwindow.h"
+#include "image/imagesaver.h"
+#include "video/transcodequeue.h"
 #include <QApplication>
 
 int main(int argc, char *argv[])
@@ -6,5 +8,11 @@ int main(int argc, char *argv[])
     QApplication a(argc, argv);
     MainWindow w;
     w.show();
-    return a.exec();
+    int result = a.exec();
+
+    // Images and videos, which are still being saved in the background, are written completely
+    ImageSaver::waitForAll();
+    TranscodeQueue::instance().waitForAll();
+
+    return result;
 }
@@ -0,0 +1,44 @@
+QT += widgets
+
+CONFIG += \
+    sdk_no_version_check
+
+HEADERS += \
+    ../../image/image.h
+
+SOURCES += \
+    main.cpp \
+    ../../image/convert.cpp \
+    ../../image/imageloader.cpp \
+    ../../image/qoi.cpp \
+    ../../image/image.cpp \
+    ../../utils/bufferpool.cpp \
+    ../../utils/parallel.cpp
+
+INCLUDEPATH += \
+    $$PWD/../..
+
+win32 {
+    SOURCES += \
+        ../../image/image_win.cpp
+
+    LIBS += \
+        -lgdi32
+}
+
+macx {
+    SOURCES += \
+        ../../image/image_mac.cpp
+
+    LIBS += \
+        -framework ApplicationServices
+}
+
+unix:!macx {
+    SOURCES += \
+        ../../image/image_x11.cpp
+
+    LIBS += \
+        -lX11 \
+        -lXext
+}
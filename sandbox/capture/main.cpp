@@ -0,0 +1,56 @@
+#include <QApplication>
+#include <QElapsedTimer>
+
+#include <iostream>
+
+#include "image/image.h"
+
+// Captures the same area repeatedly and prints the achievable frame rate
+// -> the first capture allocates the buffer, all others reuse it
+static void benchmark(const char *name, const QRect &rect, int count)
+{
+    Image image;
+
+    QElapsedTimer elapsed_timer;
+    elapsed_timer.start();
+    image.captureRect(rect);
+    qint64 t_first = elapsed_timer.nsecsElapsed();
+
+    if (image.size() != rect.size()) {
+        std::cout << name << ": capture failed" << std::endl;
+        return;
+    }
+
+    elapsed_timer.restart();
+
+    int index;
+    for (index = 0; index < count; index++)
+        image.captureRect(rect);
+
+    double ms = static_cast<double>(elapsed_timer.nsecsElapsed()) / 1e6;
+
+    std::cout << name << " (" << rect.width() << "x" << rect.height() << "): "
+              << "first capture " << static_cast<double>(t_first) / 1e6 << " ms, "
+              << ms / count << " ms per frame -> " << (count * 1000.0 / ms) << " fps" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    QApplication app(argc, argv);
+
+    Image desktop;
+    desktop.captureDesktop();
+    if (desktop.size() == QSize(0, 0)) {
+        std::cout << "Could not capture the desktop" << std::endl;
+        return 1;
+    }
+
+    int count = 200;
+
+    benchmark("Full desktop", QRect(QPoint(0, 0), desktop.size()), count);
+    benchmark("Half desktop", QRect(0, 0, desktop.width() / 2, desktop.height() / 2), count);
+    benchmark("Small rect", QRect(100, 100, 320, 240), count);
+    benchmark("Tiny rect", QRect(100, 100, 32, 32), count);
+
+    return 0;
+}
@@ -5,12 +5,18 @@ CONFIG += \
 
 SOURCES += \
     main.cpp \
+    ../../image/convert.cpp \
+    ../../image/imageloader.cpp \
+    ../../image/qoi.cpp \
     ../../image/image.cpp \
+    ../../utils/bufferpool.cpp \
+    ../../utils/parallel.cpp \
     ../../tests/createimage.cpp
 
 HEADERS += \
+    lockedqueue.hpp \
     ../../image/image.h \
-    ../../utils/circularqueue.h \
+    ../../utils/circularqueue.hpp \
     ../../utils/memoryusage.h
 
 INCLUDEPATH += \
@@ -28,3 +34,8 @@ macx {
     SOURCES += \
         ../../utils/memoryusage_mac.cpp
 }
+
+unix:!macx {
+    SOURCES += \
+        ../../utils/memoryusage_linux.cpp
+}
@@ -2,14 +2,57 @@
 #include <QElapsedTimer>
 
 #include <iostream>
+#include <thread>
 
 #include "image/image.h"
 #include "tests/createimage.h"
-#include "utils/circularqueue.h"
+#include "utils/circularqueue.hpp"
 #include "utils/memoryusage.h"
 
+#include "lockedqueue.hpp"
+
 typedef CircularQueue<Image> FrameQueue;
 
+// One producer and one consumer poll the queue in tight loops, like the
+// recorder threads did -> measures the cost of the synchronization itself
+// (yielding, so that the benchmark also works on a single core)
+template<typename Queue>
+static qint64 benchmark(int count, size_t queue_size)
+{
+    Queue queue(sizeof(int));
+    queue.resize(queue_size);
+
+    QElapsedTimer elapsed_timer;
+    elapsed_timer.start();
+
+    std::thread producer([&queue, count]() {
+        int index;
+        for (index = 0; index < count; index++) {
+            while (queue.full())
+                std::this_thread::yield();
+            int val = index;
+            queue.push(val);
+        }
+    });
+
+    int64_t sum = 0;
+    int index;
+    for (index = 0; index < count; index++) {
+        while (queue.empty())
+            std::this_thread::yield();
+        int val = 0;
+        queue.pop(val);
+        sum += val;
+    }
+
+    producer.join();
+
+    if (sum != static_cast<int64_t>(count) * (count - 1) / 2)
+        std::cout << "Error: Elements were lost!" << std::endl;
+
+    return elapsed_timer.elapsed();
+}
+
 int main(int argc, char **argv)
 {
     QApplication app(argc, argv);
@@ -85,5 +128,15 @@ int main(int argc, char **argv)
     std::cout << "Used memory after cycling through queue: " << usage_stats.used() << " MB" << std::endl;
     std::cout << "Unused memory after cycling through queue: " << usage_stats.unused() << " MB" << std::endl;
 
+    // Contention benchmark
+    int count = 2000000;
+    for (size_t queue_size : {16, 1024}) {
+        qint64 t_locked = benchmark<LockedCircularQueue<int>>(count, queue_size);
+        qint64 t_lock_free = benchmark<CircularQueue<int>>(count, queue_size);
+
+        std::cout << count << " elements through a queue of size " << queue_size << ": "
+                  << t_locked << " ms with mutex, " << t_lock_free << " ms lock-free" << std::endl;
+    }
+
     return 0;
 }
@@ -5,9 +5,15 @@ CONFIG += \
 
 SOURCES += \
     main.cpp \
+    ../../image/convert.cpp \
+    ../../image/imageloader.cpp \
+    ../../image/qoi.cpp \
     ../../image/image.cpp \
+    ../../utils/bufferpool.cpp \
+    ../../utils/parallel.cpp \
     ../../tests/createimage.cpp \
-    ../../video/decoder.cpp
+    ../../video/decoder.cpp \
+    ../../video/videofile.cpp
 
 HEADERS += \
     ../../image/image.h \
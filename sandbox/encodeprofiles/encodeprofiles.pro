@@ -0,0 +1,32 @@
+QT += widgets
+
+CONFIG += \
+    c++17 \
+    sdk_no_version_check
+
+HEADERS += \
+    ../../image/image.h \
+    ../../video/decoder.h \
+    ../../video/encoder.h \
+    ../../video/remux.h \
+    ../../video/transcode.h
+
+SOURCES += \
+    main.cpp \
+    ../../image/convert.cpp \
+    ../../image/imageloader.cpp \
+    ../../image/qoi.cpp \
+    ../../image/image.cpp \
+    ../../utils/bufferpool.cpp \
+    ../../utils/parallel.cpp \
+    ../../video/decoder.cpp \
+    ../../video/encoder.cpp \
+    ../../video/remux.cpp \
+    ../../video/transcode.cpp \
+    ../../video/videofile.cpp \
+    ../../tests/createimage.cpp
+
+INCLUDEPATH += \
+    $$PWD/../..
+
+include(../../external/FFmpeg.pri)
@@ -0,0 +1,116 @@
+#include <QApplication>
+#include <QElapsedTimer>
+#include <QFileInfo>
+
+#include <iostream>
+#include <vector>
+
+#include "tests/createimage.h"
+#include "video/decoder.h"
+#include "video/encoder.h"
+#include "video/transcode.h"
+#include "video/videofile.h"
+
+// Encodes the same synthetic sequence with every profile and prints the
+// encoding throughput, the file size and the decoding throughput
+static void benchmark(const char *name, int width, int height, int count)
+{
+    VideoEncoder::Profile profile;
+    profileFromName(name, profile);
+
+    VideoFile video_file;
+    video_file.createTemporary();
+
+    // The frames are created up front, only encoding is measured
+    std::vector<Image> frames;
+    int index;
+    for (index = 0; index < count; index++)
+        frames.push_back(createImage(width, height, index));
+
+    VideoEncoder encoder;
+    encoder.open(video_file, width, height, 30, profile);
+    if (!encoder.last_error.isEmpty()) {
+        std::cout << name << ": " << encoder.last_error.toStdString() << std::endl;
+        return;
+    }
+
+    QElapsedTimer elapsed_timer;
+    elapsed_timer.start();
+
+    for (index = 0; index < count; index++)
+        encoder.addFrame(frames[static_cast<size_t>(index)], index);
+    encoder.finish();
+
+    double encode_ms = static_cast<double>(elapsed_timer.nsecsElapsed()) / 1e6;
+
+    VideoDecoder decoder;
+    decoder.open(video_file);
+
+    elapsed_timer.restart();
+
+    int decoded = 0;
+    while (decoder.readFrame()) {
+        decoder.swsScale();
+        decoded++;
+    }
+
+    double decode_ms = static_cast<double>(elapsed_timer.nsecsElapsed()) / 1e6;
+
+    std::cout << name << ": encoding " << (count * 1000.0 / encode_ms) << " fps, "
+              << QFileInfo(video_file.fileName()).size() / 1024 << " KB, "
+              << "decoding " << (decoded * 1000.0 / decode_ms) << " fps" << std::endl;
+}
+
+// Re-encodes a lossless recording with a single encoder and with one encoder
+// per chunk on all cores
+static void benchmarkTranscode(int width, int height, int count)
+{
+    VideoFile source;
+    source.createTemporary();
+
+    VideoEncoder encoder;
+    encoder.open(source, width, height, 30);
+    int index;
+    for (index = 0; index < count; index++)
+        encoder.addFrame(createImage(width, height, index), index);
+    encoder.finish();
+
+    for (bool parallel : {false, true}) {
+        VideoFile target;
+        target.createTemporary();
+
+        QElapsedTimer elapsed_timer;
+        elapsed_timer.start();
+
+        QString error;
+        bool success = parallel ? transcodeVideoParallel(source, target, VideoEncoder::Profile::lossless(), error)
+                                : transcodeVideo(source, target, VideoEncoder::Profile::lossless(), error);
+        if (!success) {
+            std::cout << "transcode: " << error.toStdString() << std::endl;
+            return;
+        }
+
+        double transcode_ms = static_cast<double>(elapsed_timer.nsecsElapsed()) / 1e6;
+
+        std::cout << (parallel ? "transcode (chunked): " : "transcode (serial): ")
+                  << (count * 1000.0 / transcode_ms) << " fps" << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    QApplication app(argc, argv);
+
+    int width = 1280;
+    int height = 720;
+    int count = 150;
+
+    std::cout << width << "x" << height << ", " << count << " frames" << std::endl;
+
+    for (const char *name : {"lossless", "realtime", "small", "seekable", "vfr"})
+        benchmark(name, width, height, count);
+
+    benchmarkTranscode(width, height, count);
+
+    return 0;
+}
@@ -0,0 +1,23 @@
+QT -= gui
+
+CONFIG += \
+    c++17 \
+    console \
+    sdk_no_version_check
+
+CONFIG -= app_bundle
+
+HEADERS += \
+    ../../utils/framepacer.h
+
+SOURCES += \
+    main.cpp \
+    ../../utils/framepacer.cpp
+
+INCLUDEPATH += \
+    $$PWD/../..
+
+win32 {
+    LIBS += \
+        -lwinmm
+}
@@ -0,0 +1,88 @@
+#include <QCoreApplication>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "utils/framepacer.h"
+
+// Target of the recorder: 30 fps with less than 1 ms between deadline and
+// wake up
+static const double max_jitter_ms = 1.0;
+
+// Paces a loop for a fixed time and measures, how late each tick wakes up
+// -> the work per frame simulates the capture (busy, so the scheduler sees a
+//    loaded thread), late ticks are counted separately, because they missed
+//    their deadline before waiting
+//
+// Usage: framepacer [frame_rate [seconds [work_ms]]]
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    int frame_rate = 30;
+    int seconds = 10;
+    int work_ms = 5;
+
+    if (argc >= 2)
+        frame_rate = std::max(1, atoi(argv[1]));
+    if (argc >= 3)
+        seconds = std::max(1, atoi(argv[2]));
+    if (argc >= 4)
+        work_ms = std::max(0, atoi(argv[3]));
+
+    int64_t count = static_cast<int64_t>(frame_rate) * seconds;
+
+    std::vector<double> jitter;
+    jitter.reserve(static_cast<size_t>(count));
+
+    FramePacer pacer(frame_rate);
+    pacer.start();
+
+    while (pacer.frameIndex() < count) {
+        FramePacer::Clock::time_point work_end = FramePacer::Clock::now() + std::chrono::milliseconds(work_ms);
+        while (FramePacer::Clock::now() < work_end)
+            ;
+
+        int64_t late = pacer.statistics().late;
+        pacer.waitForNextFrame();
+
+        // Measured here as well -> includes the return from the pacer
+        int64_t deadline_us = pacer.frameIndex() * 1000000 / frame_rate;
+        double delay_ms = static_cast<double>(pacer.elapsedUs() - deadline_us) / 1000.0;
+
+        // Late ticks did not wait at all
+        if (pacer.statistics().late == late)
+            jitter.push_back(delay_ms);
+    }
+
+    if (jitter.empty()) {
+        std::cout << "Every tick was late, the work takes longer than a frame" << std::endl;
+        return 1;
+    }
+
+    std::sort(jitter.begin(), jitter.end());
+
+    double sum = 0.;
+    for (double value : jitter)
+        sum += value;
+
+    double mean = sum / static_cast<double>(jitter.size());
+    double p99 = jitter[std::min(jitter.size() - 1, jitter.size() * 99 / 100)];
+    double max = jitter.back();
+
+    const FramePacer::Statistics &stats = pacer.statistics();
+
+    std::cout << frame_rate << " fps for " << seconds << " s with " << work_ms << " ms of work per frame" << std::endl;
+    std::cout << "ticks " << stats.frames << ", late " << stats.late << ", skipped " << stats.skipped << std::endl;
+    std::cout << "jitter mean " << mean << " ms, p99 " << p99 << " ms, max " << max << " ms" << std::endl;
+    std::cout << "pacer statistics: mean " << stats.mean_jitter << " ms, max " << stats.max_jitter << " ms" << std::endl;
+
+    bool passed = max < max_jitter_ms && stats.late == 0;
+    std::cout << (passed ? "PASS" : "FAIL") << ": target is below " << max_jitter_ms << " ms without late ticks" << std::endl;
+
+    return passed ? 0 : 1;
+}
@@ -4,7 +4,12 @@ CONFIG += sdk_no_version_check
 
 SOURCES += \
     main.cpp \
+    ../../image/convert.cpp \
+    ../../image/imageloader.cpp \
+    ../../image/qoi.cpp \
     ../../image/image.cpp \
+    ../../utils/bufferpool.cpp \
+    ../../utils/parallel.cpp \
     ../../tests/createimage.cpp
 
 HEADERS += \
@@ -26,3 +31,8 @@ macx {
     SOURCES += \
         ../../utils/memoryusage_mac.cpp
 }
+
+unix:!macx {
+    SOURCES += \
+        ../../utils/memoryusage_linux.cpp
+}
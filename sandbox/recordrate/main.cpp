@@ -0,0 +1,101 @@
+#include <QApplication>
+#include <QElapsedTimer>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+#include "image/image.h"
+#include "video/encoder.h"
+#include "video/videofile.h"
+
+// Measures the stages of the real-time recording mode for one rect size and
+// prints the frame rate, which the machine sustains
+// -> in the pipeline, capture, conversion and encoding run on separate threads,
+//    so the slowest stage limits the frame rate (the serial rate is the limit
+//    of a single thread doing all the work)
+//
+// Usage: recordrate [width height [frames]]
+int main(int argc, char **argv)
+{
+    QApplication app(argc, argv);
+
+    Image desktop;
+    desktop.captureDesktop();
+    if (desktop.size() == QSize(0, 0)) {
+        std::cout << "Could not capture the desktop" << std::endl;
+        return 1;
+    }
+
+    int width = desktop.width();
+    int height = desktop.height();
+    int count = 300;
+
+    if (argc >= 3) {
+        width = std::min(atoi(argv[1]), desktop.width());
+        height = std::min(atoi(argv[2]), desktop.height());
+    }
+    if (argc >= 4)
+        count = std::max(1, atoi(argv[3]));
+
+    // Same alignment as in the recorder
+    width &= 0xfffe;
+    height &= 0xfffe;
+    QRect rect(0, 0, width, height);
+
+    VideoFile video_file;
+    video_file.createTemporary();
+
+    VideoEncoder::Profile profile = VideoEncoder::Profile::realtime();
+
+    VideoEncoder encoder;
+    encoder.open(video_file, width, height, 120, profile);
+    if (!encoder.last_error.isEmpty())
+        return 1;
+
+    Image image(32);
+    YuvFrame yuv(profile.yuvLayout());
+
+    // The first capture allocates the buffers
+    image.captureRect(rect);
+    yuv.convertFrom(image);
+
+    qint64 capture_ns = 0;
+    qint64 convert_ns = 0;
+    qint64 encode_ns = 0;
+
+    QElapsedTimer elapsed_timer;
+
+    int index;
+    for (index = 0; index < count; index++) {
+        elapsed_timer.start();
+        image.captureRect(rect);
+        capture_ns += elapsed_timer.nsecsElapsed();
+
+        elapsed_timer.start();
+        yuv.convertFrom(image);
+        convert_ns += elapsed_timer.nsecsElapsed();
+
+        elapsed_timer.start();
+        encoder.addFrame(yuv, index);
+        encode_ns += elapsed_timer.nsecsElapsed();
+    }
+
+    // Frames, which are still in the encoder, are part of the encoding time
+    elapsed_timer.start();
+    encoder.finish();
+    encode_ns += elapsed_timer.nsecsElapsed();
+
+    double capture_ms = static_cast<double>(capture_ns) / 1e6 / count;
+    double convert_ms = static_cast<double>(convert_ns) / 1e6 / count;
+    double encode_ms = static_cast<double>(encode_ns) / 1e6 / count;
+
+    double slowest_ms = std::max(capture_ms, std::max(convert_ms, encode_ms));
+    double serial_ms = capture_ms + convert_ms + encode_ms;
+
+    std::cout << width << "x" << height << ", " << count << " frames" << std::endl;
+    std::cout << "capture " << capture_ms << " ms, conversion " << convert_ms << " ms, encoding " << encode_ms << " ms per frame" << std::endl;
+    std::cout << "serial " << 1000.0 / serial_ms << " fps, pipelined " << 1000.0 / slowest_ms << " fps" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,50 @@
+QT += widgets
+
+CONFIG += \
+    c++17 \
+    sdk_no_version_check
+
+HEADERS += \
+    ../../image/image.h \
+    ../../video/encoder.h
+
+SOURCES += \
+    main.cpp \
+    ../../image/convert.cpp \
+    ../../image/imageloader.cpp \
+    ../../image/qoi.cpp \
+    ../../image/image.cpp \
+    ../../utils/bufferpool.cpp \
+    ../../utils/parallel.cpp \
+    ../../video/encoder.cpp \
+    ../../video/videofile.cpp
+
+INCLUDEPATH += \
+    $$PWD/../..
+
+include(../../external/FFmpeg.pri)
+
+win32 {
+    SOURCES += \
+        ../../image/image_win.cpp
+
+    LIBS += \
+        -lgdi32
+}
+
+macx {
+    SOURCES += \
+        ../../image/image_mac.cpp
+
+    LIBS += \
+        -framework ApplicationServices
+}
+
+unix:!macx {
+    SOURCES += \
+        ../../image/image_x11.cpp
+
+    LIBS += \
+        -lX11 \
+        -lXext
+}
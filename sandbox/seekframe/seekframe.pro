@@ -11,10 +11,16 @@ HEADERS += \
 
 SOURCES += \
     main.cpp \
+    ../../image/convert.cpp \
+    ../../image/imageloader.cpp \
+    ../../image/qoi.cpp \
     ../../image/image.cpp \
+    ../../utils/bufferpool.cpp \
+    ../../utils/parallel.cpp \
     ../../tests/createimage.cpp \
     ../../video/decoder.cpp \
-    ../../video/encoder.cpp
+    ../../video/encoder.cpp \
+    ../../video/videofile.cpp
 
 INCLUDEPATH += \
     $$PWD/../..
@@ -2,15 +2,25 @@
 
 #include "frameSelector/selectframewidget.h"
 #include "image/image.h"
+#include "image/imageloader.h"
+#include "image/imagesaver.h"
 #include "image/imageviewer.h"
+#include "image/statistics.h"
+#include "video/decoder.h"
 #include "video/player.h"
 #include "video/recorder.h"
+#include "video/remux.h"
+#include "video/segmentring.h"
+#include "video/transcode.h"
+#include "video/transcodequeue.h"
 #include "video/videofile.h"
 
 #include <QEventLoop>
 #include <QFileDialog>
 #include <QTimer>
 
+#include <algorithm>
+
 using namespace tw;
 
 static ScriptEngine *engine;
@@ -18,11 +28,17 @@ static ScriptEngine *engine;
 enum : ObjectReference
 {
     ImageRef,
-    VideoRef
+    VideoRef,
+    SaveRef,
+    RingRef,
+    TranscodeRef
 };
 
 template<> ObjectReference ParameterObjectBase<Image>::ref = ImageRef;
 template<> ObjectReference ParameterObjectBase<VideoFile>::ref  = VideoRef;
+template<> ObjectReference ParameterObjectBase<SaveHandle>::ref = SaveRef;
+template<> ObjectReference ParameterObjectBase<SegmentRing>::ref = RingRef;
+template<> ObjectReference ParameterObjectBase<TranscodeHandle>::ref = TranscodeRef;
 
 bool cmdCapture(const ParameterList &in_params, Parameter &out_param)
 {
@@ -38,6 +54,94 @@ bool cmdCapture(const ParameterList &in_params, Parameter &out_param)
     return out_param.asObject<Image>().size() != QSize(0, 0);
 }
 
+bool cmdConcat(const ParameterList &in_params, Parameter &out_param)
+{
+    const VideoFile &first = in_params[0].asObject<VideoFile>();
+    const VideoFile &second = in_params[1].asObject<VideoFile>();
+
+    VideoFile &video_file = out_param.createObject<VideoFile>();
+    video_file.createTemporary();
+
+    // The packets are copied, so both videos need the same codec and size
+    QString error;
+    if (!concatVideos(first, second, video_file, error)) {
+        engine->printError(error.toStdString());
+        return false;
+    }
+
+    return true;
+}
+
+// Reads the optional rectangle and channel of the statistics commands, which
+// start at in_params[index]. Returns an error message for unknown channels.
+static std::string readRegion(const ParameterList &in_params, size_t index, QRect &rect, stats::Channel &channel)
+{
+    const Image &image = in_params[0].asObject<Image>();
+
+    rect = QRect(QPoint(0, 0), image.size());
+    channel = stats::Gray;
+
+    if (in_params.size() > index)
+        rect = in_params[index].asRect();
+
+    if (in_params.size() > index + 1 && !stats::channelFromName(in_params[index + 1].asString(), channel))
+        return "Channel needs to be 'red', 'green', 'blue' or 'gray'";
+
+    return std::string();
+}
+
+bool cmdDominantColor(const ParameterList &in_params, Parameter &out_param)
+{
+    QRect rect;
+    stats::Channel channel;
+    readRegion(in_params, 1, rect, channel);
+
+    QColor color = stats::dominantColor(in_params[0].asObject<Image>(), rect);
+    out_param.assign(color.isValid() ? color.name().toStdString() : std::string());
+
+    return true;
+}
+
+bool cmdExportRing(const ParameterList &in_params, Parameter &out_param)
+{
+    const SegmentRing &ring = in_params[0].asObject<SegmentRing>();
+
+    VideoFile &video_file = out_param.createObject<VideoFile>();
+    video_file.createTemporary();
+
+    // The segments are only remuxed, not encoded again
+    QString error;
+    if (!ring.exportTo(video_file, error)) {
+        engine->printError(error.toStdString());
+        return false;
+    }
+
+    return true;
+}
+
+bool cmdHistogram(const ParameterList &in_params, Parameter &out_param)
+{
+    int value = in_params[1].asInt();
+    if (value < 0 || value > 255) {
+        engine->printError("Value needs to be between 0 and 255");
+        return false;
+    }
+
+    QRect rect;
+    stats::Channel channel;
+    std::string error = readRegion(in_params, 2, rect, channel);
+    if (!error.empty()) {
+        engine->printError(error);
+        return false;
+    }
+
+    uint32_t bins[256];
+    stats::histogram(in_params[0].asObject<Image>(), rect, channel, bins);
+    out_param.assign(static_cast<int32_t>(bins[value]));
+
+    return true;
+}
+
 bool cmdLoadImage(const ParameterList &in_params, Parameter &out_param)
 {
     QString file_name;
@@ -46,14 +150,18 @@ bool cmdLoadImage(const ParameterList &in_params, Parameter &out_param)
     else
         file_name = QFileDialog::getOpenFileName(nullptr,
             QObject::tr("Load image"), "",
-            QObject::tr("Portable Network Graphics (*.png);;All files (*)"));
+            ImageLoader::fileFilter());
 
     if (!QFileInfo::exists(file_name)) {
         engine->printError("File does not exist");
         return false;
     }
 
-    out_param.createObject<Image>(file_name);
+    QString error;
+    if (!ImageLoader::load(file_name, out_param.createObject<Image>(), &error)) {
+        engine->printError(error.toStdString());
+        return false;
+    }
 
     return true;
 }
@@ -78,6 +186,63 @@ bool cmdLoadVideo(const ParameterList &in_params, Parameter &out_param)
     return true;
 }
 
+bool cmdMaximum(const ParameterList &in_params, Parameter &out_param)
+{
+    QRect rect;
+    stats::Channel channel;
+    std::string error = readRegion(in_params, 1, rect, channel);
+    if (!error.empty()) {
+        engine->printError(error);
+        return false;
+    }
+
+    out_param.assign(static_cast<int32_t>(stats::summarize(in_params[0].asObject<Image>(), rect, channel).max));
+
+    return true;
+}
+
+bool cmdMean(const ParameterList &in_params, Parameter &out_param)
+{
+    QRect rect;
+    stats::Channel channel;
+    std::string error = readRegion(in_params, 1, rect, channel);
+    if (!error.empty()) {
+        engine->printError(error);
+        return false;
+    }
+
+    out_param.assign(stats::summarize(in_params[0].asObject<Image>(), rect, channel).mean);
+
+    return true;
+}
+
+bool cmdMeanColor(const ParameterList &in_params, Parameter &out_param)
+{
+    QRect rect;
+    stats::Channel channel;
+    readRegion(in_params, 1, rect, channel);
+
+    QColor color = stats::meanColor(in_params[0].asObject<Image>(), rect);
+    out_param.assign(color.isValid() ? color.name().toStdString() : std::string());
+
+    return true;
+}
+
+bool cmdMinimum(const ParameterList &in_params, Parameter &out_param)
+{
+    QRect rect;
+    stats::Channel channel;
+    std::string error = readRegion(in_params, 1, rect, channel);
+    if (!error.empty()) {
+        engine->printError(error);
+        return false;
+    }
+
+    out_param.assign(static_cast<int32_t>(stats::summarize(in_params[0].asObject<Image>(), rect, channel).min));
+
+    return true;
+}
+
 bool cmdMsecsBetween(const ParameterList &in_params, Parameter &out_param)
 {
     const QDateTime &dt1 = in_params[0].asDateTime();
@@ -105,23 +270,103 @@ bool cmdPrint(const ParameterList &in_params, Parameter &)
     return true;
 }
 
+bool cmdProgress(const ParameterList &in_params, Parameter &out_param)
+{
+    TranscodeStatus status = in_params[0].asObject<TranscodeHandle>().status();
+
+    // Percentage of the encoded frames
+    double progress = 0;
+    if (status.state == TranscodeStatus::Finished)
+        progress = 100;
+    else if (status.total > 0)
+        progress = std::min(100.0, status.frames * 100.0 / status.total);
+
+    out_param.assign(progress);
+
+    return true;
+}
+
 bool cmdRecord(const ParameterList &in_params, Parameter &out_param)
 {
     const QRect &rect = in_params[0].asRect();
     int frame_rate    = in_params[1].asInt();
 
-    if (frame_rate < 1 || frame_rate > 30) {
-        engine->printError("Frame rate needs to be between 1 and 30");
+    if (frame_rate < 1 || frame_rate > 120) {
+        engine->printError("Frame rate needs to be between 1 and 120");
+        return false;
+    }
+
+    BackpressurePolicy policy = Block;
+    if (in_params.size() > 2 && !policyFromName(in_params[2].asString(), policy)) {
+        engine->printError("Policy needs to be 'block', 'drop-newest', 'drop-oldest' or 'adaptive'");
+        return false;
+    }
+
+    // Queued frames can be compressed in memory
+    bool compress = false;
+    if (in_params.size() > 3) {
+        const std::string &compression = in_params[3].asString();
+        if (compression == "lz4") {
+            compress = true;
+        } else if (compression != "none") {
+            engine->printError("Compression needs to be 'none' or 'lz4'");
+            return false;
+        }
+    }
+
+    VideoEncoder::Profile profile = ScreenRecorder::defaultProfile(frame_rate);
+    if (in_params.size() > 4 && !profileFromName(in_params[4].asString(), profile)) {
+        engine->printError("Profile needs to be 'lossless', 'realtime', 'small', 'seekable' or 'vfr'");
         return false;
     }
 
     engine->mainWindow->hide();
 
+    // Short clips stay in memory, long recordings move into a temporary file
     VideoFile &video_file = out_param.createObject<VideoFile>();
-    video_file.createTemporary();
+    video_file.createInMemory();
 
     ScreenRecorder recorder;
-    recorder.exec(video_file, rect, frame_rate);
+    recorder.exec(video_file, rect, frame_rate, profile, policy, compress);
+
+    engine->mainWindow->show();
+
+    return true;
+}
+
+bool cmdRecordRing(const ParameterList &in_params, Parameter &out_param)
+{
+    const QRect &rect = in_params[0].asRect();
+    int frame_rate    = in_params[1].asInt();
+    int segments      = in_params[2].asInt();
+    int seconds       = in_params[3].asInt();
+
+    if (frame_rate < 1 || frame_rate > 120) {
+        engine->printError("Frame rate needs to be between 1 and 120");
+        return false;
+    }
+
+    if (segments < 1 || seconds < 1) {
+        engine->printError("Number and duration of the segments need to be positive");
+        return false;
+    }
+
+    VideoEncoder::Profile profile = ScreenRecorder::defaultProfile(frame_rate);
+    if (in_params.size() > 4 && !profileFromName(in_params[4].asString(), profile)) {
+        engine->printError("Profile needs to be 'lossless', 'realtime', 'small', 'seekable' or 'vfr'");
+        return false;
+    }
+
+    SegmentRing &ring = out_param.createObject<SegmentRing>(segments, seconds);
+    if (!ring.isValid()) {
+        engine->printError("Could not create a directory for the segments");
+        return false;
+    }
+
+    engine->mainWindow->hide();
+
+    ScreenRecorder recorder;
+    recorder.execRing(ring, rect, frame_rate, profile);
 
     engine->mainWindow->show();
 
@@ -134,32 +379,66 @@ bool cmdSave(const ParameterList &in_params, Parameter &)
     case ImageRef: {
         const Image &image = in_params[0].asObject<Image>();
 
+        if (in_params.size() > 2) {
+            engine->printError("Profiles can only be used for videos");
+            return false;
+        }
+
         QString fileName;
         if (in_params.size() == 2 && in_params[1].type() == String)
             fileName = in_params[1].asString().c_str();
         else
             fileName = QFileDialog::getSaveFileName(nullptr,
                 QObject::tr("Save image"), "",
-                QObject::tr("Portable Network Graphics (*.png);;All files (*)"));
+                QObject::tr("Portable Network Graphics (*.png);;Quite OK Image (*.qoi);;Raw BGRA (*.bgra);;All files (*)"));
+
+        if (fileName.isEmpty())
+            return true;
 
-        if (!fileName.isEmpty())
-            image.toQImage().save(fileName, "PNG");
+        SaveHandle handle = ImageSaver::save(image, fileName);
+        if (!handle.wait()) {
+            engine->printError(handle.lastError().toStdString());
+            return false;
+        }
 
         return true;
     }
     case VideoRef: {
         const VideoFile &video = in_params[0].asObject<VideoFile>();
 
+        // With a profile, the video is encoded again
+        VideoEncoder::Profile profile = VideoEncoder::Profile::lossless();
+        bool transcode = in_params.size() > 2;
+        if (transcode && !profileFromName(in_params[2].asString(), profile)) {
+            engine->printError("Profile needs to be 'lossless', 'realtime', 'small', 'seekable' or 'vfr'");
+            return false;
+        }
+
         QString fileName;
-        if (in_params.size() == 2 && in_params[1].type() == String)
+        if (in_params.size() >= 2 && in_params[1].type() == String && !in_params[1].asString().empty())
             fileName = in_params[1].asString().c_str();
         else
             fileName = QFileDialog::getSaveFileName(nullptr,
                 QObject::tr("Save video"), "",
-                QObject::tr("AVI video file (*.avi);;All files (*)"));
-
-        if (!fileName.isEmpty())
-            video.save(fileName);
+                QObject::tr("AVI video file (*.avi);;MP4 video file (*.mp4);;Matroska video file (*.mkv);;All files (*)"));
+
+        if (fileName.isEmpty())
+            return true;
+
+        // Recordings are moved or linked there, not copied
+        if (!transcode) {
+            if (!video.save(fileName)) {
+                engine->printError("Could not save video");
+                return false;
+            }
+            return true;
+        }
+
+        QString error;
+        if (!transcodeVideoParallel(video, VideoFile(fileName), profile, error)) {
+            engine->printError(error.toStdString());
+            return false;
+        }
 
         return true;
     }
@@ -168,6 +447,25 @@ bool cmdSave(const ParameterList &in_params, Parameter &)
     }
 }
 
+bool cmdSaveAsync(const ParameterList &in_params, Parameter &out_param)
+{
+    const Image &image = in_params[0].asObject<Image>();
+    QString fileName   = in_params[1].asString().c_str();
+
+    int compression = -1;
+    if (in_params.size() == 3) {
+        compression = in_params[2].asInt();
+        if (compression < 0 || compression > 9) {
+            engine->printError("Compression level needs to be between 0 and 9");
+            return false;
+        }
+    }
+
+    out_param.createObject<SaveHandle>() = ImageSaver::save(image, fileName, ImageSaver::Auto, compression);
+
+    return true;
+}
+
 bool cmdSelect(const ParameterList &, Parameter &out_param)
 {
     engine->mainWindow->hide();
@@ -203,6 +501,13 @@ bool cmdSleep(const ParameterList &in_params, Parameter &)
     return true;
 }
 
+bool cmdStatus(const ParameterList &in_params, Parameter &out_param)
+{
+    out_param.assign(in_params[0].asObject<TranscodeHandle>().status().toString().toStdString());
+
+    return true;
+}
+
 bool cmdStr(const ParameterList &in_params, Parameter &out_param)
 {
     std::stringstream ss;
@@ -212,6 +517,139 @@ bool cmdStr(const ParameterList &in_params, Parameter &out_param)
     return true;
 }
 
+bool cmdThumbnail(const ParameterList &in_params, Parameter &out_param)
+{
+    int max_size = 256;
+    if (in_params.size() == 2)
+        max_size = in_params[1].asInt();
+
+    if (max_size < 1) {
+        engine->printError("Thumbnail size needs to be positive");
+        return false;
+    }
+
+    switch (in_params[0].objectRef()) {
+    case ImageRef: {
+        const Image &image = in_params[0].asObject<Image>();
+
+        out_param.createObject<Image>() = image.thumbnail(max_size, Image::Lanczos);
+
+        return true;
+    }
+    case VideoRef: {
+        const VideoFile &video = in_params[0].asObject<VideoFile>();
+
+        // The thumbnail of a video is taken from its first frame
+        VideoDecoder decoder;
+        decoder.open(video);
+        if (!decoder.isOpen() || !decoder.readFrame()) {
+            engine->printError("Could not read frame from video");
+            return false;
+        }
+        decoder.swsScale();
+
+        out_param.createObject<Image>() = decoder.frame().thumbnail(max_size, Image::Lanczos);
+
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+bool cmdTranscode(const ParameterList &in_params, Parameter &out_param)
+{
+    const VideoFile &video = in_params[0].asObject<VideoFile>();
+    QString fileName = in_params[1].asString().c_str();
+
+    // Shareable mp4 by default
+    VideoEncoder::Profile profile = VideoEncoder::Profile::small();
+    if (in_params.size() > 2 && !profileFromName(in_params[2].asString(), profile)) {
+        engine->printError("Profile needs to be 'lossless', 'realtime', 'small', 'seekable' or 'vfr'");
+        return false;
+    }
+
+    TranscodeHandle &handle = out_param.createObject<TranscodeHandle>();
+    handle = TranscodeQueue::instance().enqueue(video, fileName, profile);
+
+    if (handle.status().state == TranscodeStatus::Failed) {
+        engine->printError(handle.status().error.toStdString());
+        return false;
+    }
+
+    return true;
+}
+
+bool cmdTrim(const ParameterList &in_params, Parameter &out_param)
+{
+    const VideoFile &video = in_params[0].asObject<VideoFile>();
+    int start = in_params[1].asInt();
+    int end = in_params[2].asInt();
+
+    // 'keyframes' copies whole GOPs, 'exact' encodes the frames at both ends again
+    std::string mode = in_params.size() > 3 ? in_params[3].asString() : "keyframes";
+    if (mode != "keyframes" && mode != "exact") {
+        engine->printError("Trim mode needs to be 'keyframes' or 'exact'");
+        return false;
+    }
+
+    VideoFile &video_file = out_param.createObject<VideoFile>();
+    video_file.createTemporary();
+
+    QString error;
+    if (!trimVideo(video, video_file, start, end, mode == "exact", error)) {
+        engine->printError(error.toStdString());
+        return false;
+    }
+
+    return true;
+}
+
+bool cmdWait(const ParameterList &in_params, Parameter &out_param)
+{
+    bool success;
+    QString error;
+
+    switch (in_params[0].objectRef()) {
+    case SaveRef: {
+        const SaveHandle &handle = in_params[0].asObject<SaveHandle>();
+        success = handle.wait();
+        error = handle.lastError();
+        break;
+    }
+    case TranscodeRef: {
+        const TranscodeHandle &handle = in_params[0].asObject<TranscodeHandle>();
+        success = handle.wait();
+        error = handle.status().error;
+        break;
+    }
+    default:
+        return false;
+    }
+
+    if (!success)
+        engine->printError(error.toStdString());
+
+    out_param.assign(success);
+
+    return true;
+}
+
+bool cmdVariance(const ParameterList &in_params, Parameter &out_param)
+{
+    QRect rect;
+    stats::Channel channel;
+    std::string error = readRegion(in_params, 1, rect, channel);
+    if (!error.empty()) {
+        engine->printError(error);
+        return false;
+    }
+
+    out_param.assign(stats::summarize(in_params[0].asObject<Image>(), rect, channel).variance);
+
+    return true;
+}
+
 bool cmdView(const ParameterList &in_params, Parameter &)
 {
     switch (in_params[0].objectRef()) {
@@ -241,16 +679,43 @@ ScriptEngine::ScriptEngine(QMainWindow *parent)
 {
     tw.registerObject<Image>("Image", false);
     tw.registerObject<VideoFile>("Video", false);
+    tw.registerObject<SaveHandle>("SaveJob", false);
+    tw.registerObject<SegmentRing>("Ring", false);
+    tw.registerObject<TranscodeHandle>("TranscodeJob", false);
 
     tw.registerCommand("capture", cmdCapture,
         {{Empty, Rect}}, ImageRef);
 
+    tw.registerCommand("concat", cmdConcat,
+        {{VideoRef}, {VideoRef}}, VideoRef);
+
+    tw.registerCommand("dominantColor", cmdDominantColor,
+        {{ImageRef}, {Empty, Rect}}, String);
+
+    tw.registerCommand("exportRing", cmdExportRing,
+        {{RingRef}}, VideoRef);
+
+    tw.registerCommand("histogram", cmdHistogram,
+        {{ImageRef}, {Int}, {Empty, Rect}, {Empty, String}}, Int);
+
     tw.registerCommand("loadImage", cmdLoadImage,
         {{Empty, String}}, ImageRef);
 
     tw.registerCommand("loadVideo", cmdLoadVideo,
         {{Empty, String}}, VideoRef);
 
+    tw.registerCommand("maximum", cmdMaximum,
+        {{ImageRef}, {Empty, Rect}, {Empty, String}}, Int);
+
+    tw.registerCommand("mean", cmdMean,
+        {{ImageRef}, {Empty, Rect}, {Empty, String}}, Float);
+
+    tw.registerCommand("meanColor", cmdMeanColor,
+        {{ImageRef}, {Empty, Rect}}, String);
+
+    tw.registerCommand("minimum", cmdMinimum,
+        {{ImageRef}, {Empty, Rect}, {Empty, String}}, Int);
+
     tw.registerCommand("msecsbetween", cmdMsecsBetween,
         {{DateTime}, {DateTime}}, Int);
 
@@ -260,11 +725,20 @@ ScriptEngine::ScriptEngine(QMainWindow *parent)
     tw.registerCommand("print", cmdPrint,
         {{Empty, String, Int, Float, Boolean, Point, Rect, DateTime}}, Empty);
 
+    tw.registerCommand("progress", cmdProgress,
+        {{TranscodeRef}}, Float);
+
     tw.registerCommand("record", cmdRecord,
-        {{Rect}, {Int}}, VideoRef);
+        {{Rect}, {Int}, {Empty, String}, {Empty, String}, {Empty, String}}, VideoRef);
+
+    tw.registerCommand("recordRing", cmdRecordRing,
+        {{Rect}, {Int}, {Int}, {Int}, {Empty, String}}, RingRef);
 
     tw.registerCommand("save", cmdSave,
-        {{ImageRef, VideoRef}, {Empty, String}}, Empty);
+        {{ImageRef, VideoRef}, {Empty, String}, {Empty, String}}, Empty);
+
+    tw.registerCommand("saveAsync", cmdSaveAsync,
+        {{ImageRef}, {String}, {Empty, Int}}, SaveRef);
 
     tw.registerCommand("select", cmdSelect,
         {}, Rect);
@@ -272,11 +746,29 @@ ScriptEngine::ScriptEngine(QMainWindow *parent)
     tw.registerCommand("sleep", cmdSleep,
         {{Int, Float}}, Empty);
 
+    tw.registerCommand("status", cmdStatus,
+        {{TranscodeRef}}, String);
+
     tw.registerCommand("str", cmdStr,
         {{String, Int, Float, Boolean, Point, Rect, DateTime}}, String);
 
+    tw.registerCommand("thumbnail", cmdThumbnail,
+        {{ImageRef, VideoRef}, {Empty, Int}}, ImageRef);
+
+    tw.registerCommand("transcode", cmdTranscode,
+        {{VideoRef}, {String}, {Empty, String}}, TranscodeRef);
+
+    tw.registerCommand("trim", cmdTrim,
+        {{VideoRef}, {Int}, {Int}, {Empty, String}}, VideoRef);
+
+    tw.registerCommand("variance", cmdVariance,
+        {{ImageRef}, {Empty, Rect}, {Empty, String}}, Float);
+
     tw.registerCommand("view", cmdView,
         {{ImageRef, VideoRef}}, Empty);
 
+    tw.registerCommand("wait", cmdWait,
+        {{SaveRef, TranscodeRef}}, Boolean);
+
     engine = this;
 }
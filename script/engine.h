@@ -29,11 +29,25 @@ private:
     inline void printError(const std::string &str)
     { if (output != nullptr) { tw::Parameter param; param.assign(str); output(param, Qt::darkRed); } }
 
+    friend bool cmdConcat(const tw::ParameterList &, tw::Parameter &);
+    friend bool cmdExportRing(const tw::ParameterList &, tw::Parameter &);
+    friend bool cmdHistogram(const tw::ParameterList &, tw::Parameter &);
     friend bool cmdLoadImage(const tw::ParameterList &, tw::Parameter &);
     friend bool cmdLoadVideo(const tw::ParameterList &, tw::Parameter &);
+    friend bool cmdMaximum(const tw::ParameterList &, tw::Parameter &);
+    friend bool cmdMean(const tw::ParameterList &, tw::Parameter &);
+    friend bool cmdMinimum(const tw::ParameterList &, tw::Parameter &);
     friend bool cmdPrint(const tw::ParameterList &, tw::Parameter &);
     friend bool cmdRecord(const tw::ParameterList &, tw::Parameter &);
+    friend bool cmdRecordRing(const tw::ParameterList &, tw::Parameter &);
+    friend bool cmdSave(const tw::ParameterList &, tw::Parameter &);
+    friend bool cmdSaveAsync(const tw::ParameterList &, tw::Parameter &);
     friend bool cmdSelect(const tw::ParameterList &, tw::Parameter &);
+    friend bool cmdThumbnail(const tw::ParameterList &, tw::Parameter &);
+    friend bool cmdTranscode(const tw::ParameterList &, tw::Parameter &);
+    friend bool cmdTrim(const tw::ParameterList &, tw::Parameter &);
+    friend bool cmdVariance(const tw::ParameterList &, tw::Parameter &);
+    friend bool cmdWait(const tw::ParameterList &, tw::Parameter &);
 };
 
 #endif // ENGINE_H
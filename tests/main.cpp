@@ -1,6 +1,7 @@
 #include "test_script.h"
 #include "test_image.h"
 #include "test_encode.h"
+#include "test_recorder.h"
 
 #include <gtest/gtest.h>
 
@@ -8,8 +8,15 @@
 #include "image/image.h"
 #include "video/decoder.h"
 #include "video/encoder.h"
+#include "video/remux.h"
+#include "video/segmentring.h"
+#include "video/transcode.h"
+#include "video/transcodequeue.h"
+#include "image/statistics.h"
 
+#include <QFile>
 #include <QImage>
+#include <QTemporaryDir>
 
 extern "C" {
 #include "libavcodec/avcodec.h"
@@ -140,6 +147,625 @@ TEST(Video, SeekFrame)
         EXPECT_EQ(img.size(), QSize(width, height));
         EXPECT_EQ(img, createImage(width, height, i));
     }
+
+    // Frames outside of the video
+    decoder.seek(-1);
+    EXPECT_FALSE(decoder.readFrame());
+}
+
+TEST(Video, EncodeRealtime)
+{
+    int width = 320;
+    int height = 240;
+    int framecount = 60;
+    int framerate = 60;
+    int i, x, y;
+
+    VideoFile video_file;
+    video_file.createTemporary();
+
+    // YUV 4:2:0 with fast settings
+    VideoEncoder encoder;
+    encoder.open(video_file, width, height, framerate, VideoEncoder::Profile::realtime());
+
+    ASSERT_EQ(encoder.last_error, "");
+
+    Image img(32);
+    img.resize(width, height);
+
+    // Flat colors survive the chroma subsampling
+    YuvFrame yuv(YuvFrame::Nv12);
+    for (i = 0; i < framecount; i++) {
+        for (y = 0; y < height; y++) {
+            for (x = 0; x < width; x++) {
+                *(img.scanLine(y) + (x * 4))     = static_cast<uint8_t>(40 + i * 2);
+                *(img.scanLine(y) + (x * 4) + 1) = 128;
+                *(img.scanLine(y) + (x * 4) + 2) = static_cast<uint8_t>(200 - i * 2);
+                *(img.scanLine(y) + (x * 4) + 3) = 255;
+            }
+        }
+        yuv.convertFrom(img);
+        encoder.addFrame(yuv, i);
+    }
+
+    encoder.finish();
+
+    ASSERT_EQ(encoder.last_error, "");
+
+    VideoDecoder decoder;
+    decoder.open(video_file);
+
+    ASSERT_EQ(decoder.last_error, "");
+
+    EXPECT_EQ(decoder.info().width, width);
+    EXPECT_EQ(decoder.info().height, height);
+    EXPECT_EQ(decoder.info().framerate, framerate);
+    EXPECT_EQ(decoder.info().framecount, framecount);
+
+    for (i = 0; i < framecount; i++) {
+        ASSERT_TRUE(decoder.readFrame());
+
+        decoder.swsScale();
+
+        QColor color = stats::meanColor(decoder.frame(), QRect(0, 0, width, height));
+        EXPECT_NEAR(color.blue(), 40 + i * 2, 4);
+        EXPECT_NEAR(color.green(), 128, 4);
+        EXPECT_NEAR(color.red(), 200 - i * 2, 4);
+    }
+
+    EXPECT_FALSE(decoder.readFrame());
+}
+
+TEST(Video, YuvFrameLayouts)
+{
+    int width = 102;
+    int height = 50;
+    int x, y;
+
+    Image img = createImage(width, height, 7);
+
+    YuvFrame i420(YuvFrame::I420);
+    YuvFrame nv12(YuvFrame::Nv12);
+    i420.convertFrom(img);
+    nv12.convertFrom(img);
+
+    EXPECT_EQ(i420.planeCount(), 3);
+    EXPECT_EQ(nv12.planeCount(), 2);
+
+    for (y = 0; y < height; y++)
+        EXPECT_EQ(memcmp(i420.plane(0) + y * i420.stride(0), nv12.plane(0) + y * nv12.stride(0), static_cast<size_t>(width)), 0);
+
+    // Same chroma, only interleaved
+    for (y = 0; y < height / 2; y++) {
+        for (x = 0; x < width / 2; x++) {
+            EXPECT_EQ(nv12.plane(1)[y * nv12.stride(1) + x * 2],     i420.plane(1)[y * i420.stride(1) + x]);
+            EXPECT_EQ(nv12.plane(1)[y * nv12.stride(1) + x * 2 + 1], i420.plane(2)[y * i420.stride(2) + x]);
+        }
+    }
+}
+
+// Duration of the video in microseconds, as stored by the container
+static double videoDuration(const VideoFile &video_file)
+{
+    AVFormatContext *format_ctx = nullptr;
+    if (avformat_open_input(&format_ctx, video_file.fileName().toStdString().c_str(), nullptr, nullptr) < 0)
+        return 0;
+
+    avformat_find_stream_info(format_ctx, nullptr);
+    double duration = static_cast<double>(format_ctx->duration);
+    avformat_close_input(&format_ctx);
+
+    return duration;
+}
+
+TEST(Video, EncodeProfiles)
+{
+    int width = 320;
+    int height = 240;
+    int framecount = 30;
+    int framerate = 25;
+    int i;
+
+    for (const char *name : {"lossless", "realtime", "small", "seekable", "vfr"}) {
+        VideoEncoder::Profile profile;
+        ASSERT_TRUE(profileFromName(name, profile));
+
+        VideoFile video_file;
+        video_file.createTemporary();
+
+        VideoEncoder encoder;
+        encoder.open(video_file, width, height, framerate, profile);
+
+        ASSERT_EQ(encoder.last_error, "") << name;
+
+        // Images are converted for the YUV profiles
+        encoder.frame().resize(width, height);
+        for (i = 0; i < framecount; i++) {
+            fillImage(encoder.frame(), i);
+            encoder.addFrame();
+        }
+
+        encoder.finish();
+
+        ASSERT_EQ(encoder.last_error, "") << name;
+
+        // The packets are rescaled to the time base of the stream (e.g. 1/12800 for mp4)
+        EXPECT_NEAR(videoDuration(video_file), framecount * 1000000.0 / framerate, 1000000.0 / framerate) << name;
+
+        VideoDecoder decoder;
+        decoder.open(video_file);
+
+        ASSERT_EQ(decoder.last_error, "") << name;
+
+        EXPECT_EQ(decoder.info().framecount, framecount) << name;
+
+        for (i = 0; i < framecount; i++) {
+            ASSERT_TRUE(decoder.readFrame()) << name;
+
+            decoder.swsScale();
+
+            if (!profile.isYuv())
+                EXPECT_EQ(decoder.frame(), createImage(width, height, i)) << name;
+        }
+    }
+
+    VideoEncoder::Profile profile;
+    EXPECT_FALSE(profileFromName("fast", profile));
+}
+
+TEST(Video, EncodeVariableFrameRate)
+{
+    int width = 160;
+    int height = 120;
+    int framecount = 12;
+    int framerate = 25;
+    int i;
+
+    VideoFile video_file;
+    video_file.createTemporary();
+
+    VideoEncoder encoder;
+    encoder.open(video_file, width, height, framerate, VideoEncoder::Profile::vfr());
+
+    ASSERT_EQ(encoder.last_error, "");
+
+    // Irregular capture times with a long idle gap in the middle
+    std::vector<int64_t> times;
+    for (i = 0; i < framecount; i++)
+        times.push_back(i * 40000 + (i % 3) * 7000 + (i >= framecount / 2 ? 5000000 : 0));
+
+    for (i = 0; i < framecount; i++)
+        encoder.addFrameAt(createImage(width, height, i), times[static_cast<size_t>(i)]);
+
+    encoder.finish();
+
+    ASSERT_EQ(encoder.last_error, "");
+
+    VideoDecoder decoder;
+    decoder.open(video_file);
+
+    ASSERT_EQ(decoder.last_error, "");
+    EXPECT_EQ(decoder.info().framerate, framerate);
+    EXPECT_EQ(decoder.info().framecount, framecount);
+
+    // The timestamps are kept with millisecond precision
+    for (i = 0; i < framecount; i++) {
+        ASSERT_TRUE(decoder.readFrame());
+        EXPECT_EQ(decoder.frameTimeUs(), times[static_cast<size_t>(i)]);
+
+        decoder.swsScale();
+        EXPECT_EQ(decoder.frame(), createImage(width, height, i));
+    }
+
+    // Seeking finds the frames by their timestamps, also after the gap
+    std::vector<int> seek_frames = {7, 2, 11, 6};
+    for (int seek_frame : seek_frames) {
+        decoder.seek(seek_frame);
+        ASSERT_TRUE(decoder.readFrame());
+        EXPECT_EQ(decoder.frameTimeUs(), times[static_cast<size_t>(seek_frame)]);
+
+        decoder.swsScale();
+        EXPECT_EQ(decoder.frame(), createImage(width, height, seek_frame));
+    }
+}
+
+TEST(Video, SegmentRing)
+{
+    int width = 160;
+    int height = 120;
+    int framecount = 50;
+    int framerate = 10;
+    int i;
+
+    // 5 segments of 10 frames -> the ring keeps the last 3
+    SegmentRing ring(3, 1);
+    ASSERT_TRUE(ring.isValid());
+
+    VideoEncoder encoder;
+    encoder.setSegments(ring.count(), ring.seconds(), ring.listFileName());
+    encoder.open(ring.pattern(), width, height, framerate);
+
+    ASSERT_EQ(encoder.last_error, "");
+
+    for (i = 0; i < framecount; i++)
+        encoder.addFrame(createImage(width, height, i));
+
+    encoder.finish();
+
+    ASSERT_EQ(encoder.last_error, "");
+    EXPECT_EQ(ring.segmentFiles().size(), 3);
+
+    VideoFile video_file;
+    video_file.createTemporary();
+
+    QString error;
+    ASSERT_TRUE(ring.exportTo(video_file, error)) << error.toStdString();
+
+    VideoDecoder decoder;
+    decoder.open(video_file);
+
+    ASSERT_EQ(decoder.last_error, "");
+    EXPECT_EQ(decoder.info().framecount, 30);
+
+    // Every segment starts with a key frame on the boundary
+    for (i = 20; i < framecount; i++) {
+        ASSERT_TRUE(decoder.readFrame());
+        decoder.swsScale();
+        EXPECT_EQ(decoder.frame(), createImage(width, height, i));
+    }
+}
+
+TEST(Video, Transcode)
+{
+    int width = 160;
+    int height = 120;
+    int framecount = 20;
+    int framerate = 25;
+    int i;
+
+    VideoFile source;
+    source.createTemporary();
+
+    VideoEncoder encoder;
+    encoder.open(source, width, height, framerate);
+    encoder.frame().resize(width, height);
+    for (i = 0; i < framecount; i++) {
+        fillImage(encoder.frame(), i);
+        encoder.addFrame();
+    }
+    encoder.finish();
+
+    VideoFile target;
+    target.createTemporary();
+
+    // Lossless to lossless keeps every pixel
+    QString error;
+    ASSERT_TRUE(transcodeVideo(source, target, VideoEncoder::Profile::seekable(), error)) << error.toStdString();
+
+    VideoDecoder decoder;
+    decoder.open(target);
+
+    ASSERT_EQ(decoder.last_error, "");
+    EXPECT_EQ(decoder.info().framerate, framerate);
+    EXPECT_EQ(decoder.info().framecount, framecount);
+
+    // Every frame is a key frame
+    decoder.seek(13);
+    ASSERT_TRUE(decoder.readFrame());
+    decoder.swsScale();
+    EXPECT_EQ(decoder.frame(), createImage(width, height, 13));
+}
+
+TEST(Video, TranscodeParallel)
+{
+    int width = 160;
+    int height = 120;
+    int framecount = 60;
+    int framerate = 25;
+    int i;
+
+    // Key frames every 12 frames -> at least two chunks
+    VideoFile source;
+    source.createTemporary();
+
+    VideoEncoder encoder;
+    encoder.open(source, width, height, framerate);
+    for (i = 0; i < framecount; i++)
+        encoder.addFrame(createImage(width, height, i));
+    encoder.finish();
+
+    ASSERT_EQ(encoder.last_error, "");
+
+    VideoFile target;
+    target.createTemporary();
+
+    QString error;
+    ASSERT_TRUE(transcodeVideoParallel(source, target, VideoEncoder::Profile::seekable(), error)) << error.toStdString();
+
+    VideoDecoder decoder;
+    decoder.open(target);
+
+    ASSERT_EQ(decoder.last_error, "");
+    EXPECT_EQ(decoder.info().framerate, framerate);
+    EXPECT_EQ(decoder.info().framecount, framecount);
+
+    // The chunks are joined in order without gaps
+    for (i = 0; i < framecount; i++) {
+        ASSERT_TRUE(decoder.readFrame());
+        decoder.swsScale();
+        EXPECT_EQ(decoder.frame(), createImage(width, height, i));
+    }
+}
+
+TEST(Video, TrimAndConcat)
+{
+    int width = 160;
+    int height = 120;
+    int framecount = 60;
+    int framerate = 25;
+    int i;
+
+    // Start codes (avi) and length prefixed NAL units (mkv)
+    for (const char *container : {"avi", "matroska"}) {
+        // Key frames every 12 frames
+        VideoEncoder::Profile profile = VideoEncoder::Profile::lossless();
+        profile.container = container;
+
+        VideoFile source;
+        source.createTemporary();
+
+        VideoEncoder encoder;
+        encoder.open(source, width, height, framerate, profile);
+        for (i = 0; i < framecount; i++)
+            encoder.addFrame(createImage(width, height, i));
+        encoder.finish();
+
+        ASSERT_EQ(encoder.last_error, "") << container;
+
+        // [15, 40) grows to the key frames 12 and 48
+        VideoFile trimmed;
+        trimmed.createTemporary();
+
+        QString error;
+        ASSERT_TRUE(trimVideo(source, trimmed, 15, 40, false, error)) << error.toStdString() << container;
+
+        VideoDecoder decoder;
+        decoder.open(trimmed);
+
+        ASSERT_EQ(decoder.last_error, "") << container;
+        EXPECT_EQ(decoder.info().framecount, 36) << container;
+
+        ASSERT_TRUE(decoder.readFrame()) << container;
+        decoder.swsScale();
+        EXPECT_EQ(decoder.frame(), createImage(width, height, 12)) << container;
+
+        // The frames at both ends are encoded again (lossless)
+        VideoFile exact;
+        exact.createTemporary();
+
+        ASSERT_TRUE(trimVideo(source, exact, 15, 40, true, error)) << error.toStdString() << container;
+
+        decoder.open(exact);
+
+        ASSERT_EQ(decoder.last_error, "") << container;
+        EXPECT_EQ(decoder.info().framecount, 25) << container;
+
+        for (i = 15; i < 40; i++) {
+            ASSERT_TRUE(decoder.readFrame()) << container;
+            decoder.swsScale();
+            EXPECT_EQ(decoder.frame(), createImage(width, height, i)) << container;
+        }
+
+        // The second video follows the last frame of the first one
+        VideoFile joined;
+        joined.createTemporary();
+
+        ASSERT_TRUE(concatVideos(exact, source, joined, error)) << error.toStdString() << container;
+
+        decoder.open(joined);
+
+        ASSERT_EQ(decoder.last_error, "") << container;
+        EXPECT_EQ(decoder.info().framecount, 25 + framecount) << container;
+
+        for (i = 0; i < 25 + framecount; i++) {
+            ASSERT_TRUE(decoder.readFrame()) << container;
+            decoder.swsScale();
+            EXPECT_EQ(decoder.frame(), createImage(width, height, i < 25 ? i + 15 : i - 25)) << container;
+        }
+
+        // Out of range
+        EXPECT_FALSE(trimVideo(source, trimmed, 50, 70, false, error)) << container;
+
+        // The packets of another profile do not fit to the parameters of the stream
+        VideoFile other;
+        other.createTemporary();
+
+        VideoEncoder::Profile other_profile = VideoEncoder::Profile::realtime();
+        other_profile.container = container;
+
+        VideoEncoder other_encoder;
+        other_encoder.open(other, width, height, framerate, other_profile);
+        for (i = 0; i < framecount; i++)
+            other_encoder.addFrame(createImage(width, height, i));
+        other_encoder.finish();
+
+        ASSERT_EQ(other_encoder.last_error, "") << container;
+
+        error.clear();
+        EXPECT_FALSE(concatVideos(source, other, joined, error)) << container;
+        EXPECT_FALSE(error.isEmpty()) << container;
+    }
+}
+
+TEST(Video, TranscodeQueue)
+{
+    int width = 160;
+    int height = 120;
+    int framecount = 40;
+    int framerate = 25;
+    int i;
+
+    VideoFile source;
+    source.createTemporary();
+
+    VideoEncoder encoder;
+    encoder.open(source, width, height, framerate);
+    for (i = 0; i < framecount; i++)
+        encoder.addFrame(createImage(width, height, i));
+    encoder.finish();
+
+    ASSERT_EQ(encoder.last_error, "");
+
+    TranscodeQueue &queue = TranscodeQueue::instance();
+
+    // Emitted on the worker threads
+    std::atomic<int> finished_jobs(0);
+    QMetaObject::Connection connection = QObject::connect(&queue, &TranscodeQueue::finished,
+        [&finished_jobs](int, bool success, const QString &) { if (success) finished_jobs++; });
+
+    // One job per profile pixel format, both run at the same time on larger machines
+    VideoFile lossless;
+    lossless.createTemporary();
+    VideoFile small;
+    small.createTemporary();
+
+    TranscodeHandle lossless_job = queue.enqueue(source, lossless.fileName(), VideoEncoder::Profile::seekable());
+    TranscodeHandle small_job = queue.enqueue(source, small.fileName(), VideoEncoder::Profile::small());
+
+    ASSERT_TRUE(lossless_job.isValid());
+    EXPECT_NE(lossless_job.id(), small_job.id());
+
+    ASSERT_TRUE(lossless_job.wait()) << lossless_job.status().error.toStdString();
+    ASSERT_TRUE(small_job.wait()) << small_job.status().error.toStdString();
+
+    QObject::disconnect(connection);
+
+    EXPECT_EQ(finished_jobs, 2);
+    EXPECT_EQ(lossless_job.status().state, TranscodeStatus::Finished);
+    EXPECT_EQ(lossless_job.status().frames, framecount);
+    EXPECT_EQ(small_job.status().frames, framecount);
+
+    VideoDecoder decoder;
+    decoder.open(lossless);
+
+    ASSERT_EQ(decoder.last_error, "");
+    EXPECT_EQ(decoder.info().framecount, framecount);
+
+    for (i = 0; i < framecount; i++) {
+        ASSERT_TRUE(decoder.readFrame());
+        decoder.swsScale();
+        EXPECT_EQ(decoder.frame(), createImage(width, height, i));
+    }
+
+    // Missing sources fail right away
+    TranscodeHandle missing = queue.enqueue(VideoFile("/nonexistent.avi"), small.fileName(), VideoEncoder::Profile::small());
+    EXPECT_TRUE(missing.isFinished());
+    EXPECT_FALSE(missing.wait());
+}
+
+TEST(Video, SaveVideoFile)
+{
+    VideoFile video;
+    video.createTemporary();
+
+    QFile file(video.fileName());
+    ASSERT_TRUE(file.open(QIODevice::WriteOnly));
+    file.write("recorded frames");
+    file.close();
+
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+
+    // The temporary file is moved -> the video refers to the saved file
+    QString first = dir.filePath("first.avi");
+    ASSERT_TRUE(video.save(first));
+    EXPECT_EQ(video.fileName(), first);
+
+    // Files of the user are cloned or copied, an existing target is replaced
+    QString second = dir.filePath("second.avi");
+    QFile existing(second);
+    ASSERT_TRUE(existing.open(QIODevice::WriteOnly));
+    existing.write("old");
+    existing.close();
+
+    ASSERT_TRUE(video.save(second));
+    EXPECT_EQ(video.fileName(), first);
+
+    QFile saved(second);
+    ASSERT_TRUE(saved.open(QIODevice::ReadOnly));
+    EXPECT_EQ(saved.readAll(), QByteArray("recorded frames"));
+    EXPECT_TRUE(QFile::exists(first));
+}
+
+TEST(Video, EncodeInMemory)
+{
+    int width = 160;
+    int height = 120;
+    int framecount = 20;
+    int framerate = 25;
+    int i;
+
+    VideoFile video;
+    video.createInMemory();
+
+    VideoEncoder encoder;
+    encoder.open(video, width, height, framerate);
+    for (i = 0; i < framecount; i++)
+        encoder.addFrame(createImage(width, height, i));
+    encoder.finish();
+
+    ASSERT_EQ(encoder.last_error, "");
+    EXPECT_TRUE(video.isInMemory());
+    EXPECT_TRUE(video.fileName().isEmpty());
+
+    VideoDecoder decoder;
+    decoder.open(video);
+
+    ASSERT_EQ(decoder.last_error, "");
+    EXPECT_EQ(decoder.info().framecount, framecount);
+
+    // Seeking goes through the custom I/O as well
+    decoder.seek(13);
+    ASSERT_TRUE(decoder.readFrame());
+    decoder.swsScale();
+    EXPECT_EQ(decoder.frame(), createImage(width, height, 13));
+
+    // Beyond the threshold, the video moves into a file
+    VideoFile spilled;
+    spilled.createInMemory(4096);
+
+    VideoEncoder spill_encoder;
+    spill_encoder.open(spilled, width, height, framerate);
+    for (i = 0; i < framecount; i++)
+        spill_encoder.addFrame(createImage(width, height, i));
+    spill_encoder.finish();
+
+    ASSERT_EQ(spill_encoder.last_error, "");
+    EXPECT_FALSE(spilled.isInMemory());
+    EXPECT_FALSE(spilled.fileName().isEmpty());
+
+    decoder.open(spilled);
+
+    ASSERT_EQ(decoder.last_error, "");
+    EXPECT_EQ(decoder.info().framecount, framecount);
+
+    for (i = 0; i < framecount; i++) {
+        ASSERT_TRUE(decoder.readFrame());
+        decoder.swsScale();
+        EXPECT_EQ(decoder.frame(), createImage(width, height, i));
+    }
+
+    // Saving writes the memory into the file
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+
+    QString file_name = dir.filePath("clip.avi");
+    ASSERT_TRUE(video.save(file_name));
+
+    decoder.open(VideoFile(file_name));
+
+    ASSERT_EQ(decoder.last_error, "");
+    EXPECT_EQ(decoder.info().framecount, framecount);
 }
 
 #endif // TEST_VIDEO_H
@@ -5,12 +5,23 @@
 #include <gmock/gmock-matchers.h>
 
 #include "createimage.h"
+#include "image/convert.h"
 #include "image/image.h"
+#include "image/imageloader.h"
+#include "image/imagesaver.h"
+#include "image/incrementalcapture.h"
+#include "image/statistics.h"
 
+#include <QDir>
+#include <QFileInfo>
 #include <QTemporaryFile>
 #include <QImage>
 #include <QString>
 
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
 using namespace testing;
 
 TEST(Image, Copy)
@@ -80,6 +91,289 @@ TEST(Image, SaveAndLoad)
     EXPECT_EQ(test_image, loaded_image);
 }
 
+TEST(Image, SaveAsync)
+{
+    int width = 254;
+    int height = 256;
+
+    Image test_image = createImage(width, height, 5, 32);
+
+    QTemporaryFile png_file(QDir::tempPath() + "/XXXXXX.png");
+    QTemporaryFile qoi_file(QDir::tempPath() + "/XXXXXX.qoi");
+    QTemporaryFile raw_file(QDir::tempPath() + "/XXXXXX.bgra");
+    png_file.open();
+    qoi_file.open();
+    raw_file.open();
+
+    // All three are encoded at the same time
+    SaveHandle png_handle = ImageSaver::save(test_image, png_file.fileName(), ImageSaver::Auto, 1);
+    SaveHandle qoi_handle = ImageSaver::save(test_image, qoi_file.fileName());
+    SaveHandle raw_handle = ImageSaver::save(test_image, raw_file.fileName());
+
+    ASSERT_TRUE(png_handle.wait());
+    ASSERT_TRUE(qoi_handle.wait());
+    ASSERT_TRUE(raw_handle.wait());
+    EXPECT_TRUE(png_handle.isFinished());
+
+    EXPECT_EQ(test_image, Image(png_file.fileName()));
+    EXPECT_EQ(test_image, Image(qoi_file.fileName()));
+    EXPECT_EQ(QFileInfo(raw_file.fileName()).size(), width * height * 4);
+}
+
+TEST(Image, LoadRgb888)
+{
+    int width = 254;
+    int height = 256;
+
+    Image test_image = createImage(width, height, 3);
+
+    QTemporaryFile temp_file;
+    temp_file.open();
+
+    // Save as 24bit image, loading converts it back to 32bit
+    QString file_name = temp_file.fileName();
+    test_image.toQImage().convertToFormat(QImage::Format_RGB888).save(file_name, "PNG");
+
+    Image loaded_image(file_name);
+
+    EXPECT_EQ(test_image, loaded_image);
+}
+
+TEST(Image, LoadFormats)
+{
+    int width = 254;
+    int height = 256;
+
+    Image test_image = createImage(width, height, 4);
+
+    QTemporaryFile png_file(QDir::tempPath() + "/XXXXXX.png");
+    QTemporaryFile bmp_file(QDir::tempPath() + "/XXXXXX.bmp");
+    QTemporaryFile jpg_file(QDir::tempPath() + "/XXXXXX.jpg");
+    QTemporaryFile gray_file(QDir::tempPath() + "/XXXXXX.png");
+    png_file.open();
+    bmp_file.open();
+    jpg_file.open();
+    gray_file.open();
+
+    QImage qimage = test_image.toQImage();
+    qimage.save(png_file.fileName(), "PNG");
+    qimage.save(bmp_file.fileName(), "BMP");
+    qimage.save(jpg_file.fileName(), "JPG", 95);
+    qimage.convertToFormat(QImage::Format_Grayscale8).save(gray_file.fileName(), "PNG");
+
+    QStringList file_names = {png_file.fileName(), bmp_file.fileName(), jpg_file.fileName(),
+                              gray_file.fileName(), QDir::tempPath() + "/does_not_exist.png"};
+
+    std::vector<Image> images;
+    EXPECT_EQ(ImageLoader::loadAll(file_names, images), 4);
+    ASSERT_EQ(images.size(), static_cast<size_t>(5));
+
+    EXPECT_EQ(test_image, images[0]);
+    EXPECT_EQ(test_image, images[1]);
+
+    // JPEG is lossy, grayscale is expanded to all channels
+    EXPECT_EQ(images[2].size(), test_image.size());
+    EXPECT_EQ(images[3].size(), test_image.size());
+    EXPECT_EQ(images[3].scanLine(7)[0], images[3].scanLine(7)[2]);
+
+    EXPECT_EQ(images[4].bits(), nullptr);
+
+    QString error;
+    Image image;
+    EXPECT_FALSE(ImageLoader::load(file_names[4], image, &error));
+    EXPECT_FALSE(error.isEmpty());
+}
+
+TEST(Image, ConvertKernels)
+{
+    int width = 350;
+    int height = 288;
+
+    Image src = createImage(width, height, 7, 32);
+
+    std::vector<uint8_t> rgb(static_cast<size_t>(width * 3 * height));
+    std::vector<uint8_t> planes(static_cast<size_t>(width * 3 * height));
+    std::vector<uint8_t> yuv(static_cast<size_t>(width * height * 3 / 2));
+
+    for (conv::Isa isa : {conv::Scalar, conv::SSE2, conv::SSSE3}) {
+        conv::setIsa(isa);
+
+        Image dest(32);
+        dest.resize(width, height);
+
+        // RGB24 round trip
+        conv::bgraToRgb24(src.bits(), static_cast<int>(src.bytesPerLine()), rgb.data(), width * 3, width, height);
+        conv::rgb24ToBgra(rgb.data(), width * 3, dest.scanLine(0), static_cast<int>(dest.bytesPerLine()), width, height);
+        EXPECT_EQ(src, dest);
+
+        // Planar GBR round trip
+        uint8_t *g = planes.data();
+        uint8_t *b = g + width * height;
+        uint8_t *r = b + width * height;
+        conv::bgraToGbrp(src.bits(), static_cast<int>(src.bytesPerLine()), g, width, b, width, r, width, width, height);
+        conv::gbrpToBgra(g, width, b, width, r, width, dest.scanLine(0), static_cast<int>(dest.bytesPerLine()), width, height);
+        EXPECT_EQ(src, dest);
+
+        // I420 is lossy, but flat colors have to survive
+        Image flat(32);
+        flat.resize(width, height);
+        int x, y;
+        for (y = 0; y < height; y++) {
+            for (x = 0; x < width; x++) {
+                uint8_t *px = flat.scanLine(static_cast<size_t>(y)) + x * 4;
+                px[0] = 40; px[1] = 120; px[2] = 200; px[3] = 255;
+            }
+        }
+        uint8_t *py = yuv.data();
+        uint8_t *pu = py + width * height;
+        uint8_t *pv = pu + width * height / 4;
+        conv::bgraToI420(flat.bits(), static_cast<int>(flat.bytesPerLine()), py, width, pu, width / 2, pv, width / 2, width, height);
+        conv::i420ToBgra(py, width, pu, width / 2, pv, width / 2, dest.scanLine(0), static_cast<int>(dest.bytesPerLine()), width, height);
+        for (y = 0; y < height; y++) {
+            for (x = 0; x < width * 4; x++)
+                ASSERT_NEAR(flat.scanLine(static_cast<size_t>(y))[x], dest.scanLine(static_cast<size_t>(y))[x], 2);
+        }
+    }
+
+    // Reset to the best instruction set available
+    conv::setIsa(conv::SSSE3);
+}
+
+TEST(Image, Scaled)
+{
+    int width = 350;
+    int height = 288;
+
+    // Flat colors have to stay the same with every filter and instruction set
+    Image flat(32);
+    flat.resize(width, height);
+    int x, y;
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            uint8_t *px = flat.scanLine(static_cast<size_t>(y)) + x * 4;
+            px[0] = 40; px[1] = 120; px[2] = 200; px[3] = 255;
+        }
+    }
+
+    for (conv::Isa isa : {conv::Scalar, conv::SSE2}) {
+        conv::setIsa(isa);
+
+        for (Image::ScaleFilter filter : {Image::Box, Image::Bilinear, Image::Lanczos}) {
+            Image scaled = flat.scaled(QSize(117, 61), filter);
+            ASSERT_EQ(scaled.size(), QSize(117, 61));
+            for (y = 0; y < scaled.height(); y++)
+                ASSERT_EQ(memcmp(scaled.scanLine(static_cast<size_t>(y)), flat.scanLine(0), 117 * 4), 0);
+        }
+    }
+
+    conv::setIsa(conv::SSSE3);
+
+    // Thumbnails keep the aspect ratio and never upscale
+    Image test_image = createImage(width, height, 3, 32);
+    EXPECT_EQ(test_image.thumbnail(100).size(), QSize(100, 82));
+    EXPECT_EQ(test_image.thumbnail(400), test_image);
+}
+
+TEST(Image, Statistics)
+{
+    int width = 254;
+    int height = 256;
+
+    // The padding of the rows must not be part of the statistics
+    Image test_image = createImage(width, height, 6, 64);
+    QRect rect(13, 7, 201, 230);
+
+    for (conv::Isa isa : {conv::Scalar, conv::SSE2}) {
+        conv::setIsa(isa);
+
+        for (stats::Channel channel : {stats::Blue, stats::Green, stats::Red}) {
+            uint64_t sum = 0, sum_sq = 0;
+            int min = 255, max = 0;
+            uint32_t expected_bins[256] = {0};
+
+            int x, y;
+            for (y = rect.top(); y <= rect.bottom(); y++) {
+                for (x = rect.left(); x <= rect.right(); x++) {
+                    int val = test_image.scanLine(static_cast<size_t>(y))[x * 4 + channel];
+                    sum += static_cast<uint64_t>(val);
+                    sum_sq += static_cast<uint64_t>(val * val);
+                    min = std::min(min, val);
+                    max = std::max(max, val);
+                    expected_bins[val]++;
+                }
+            }
+
+            double count = rect.width() * rect.height();
+            double mean = sum / count;
+
+            stats::Summary summary = stats::summarize(test_image, rect, channel);
+            EXPECT_EQ(summary.count, rect.width() * rect.height());
+            EXPECT_DOUBLE_EQ(summary.mean, mean);
+            EXPECT_NEAR(summary.variance, sum_sq / count - mean * mean, 1e-6);
+            EXPECT_EQ(summary.min, min);
+            EXPECT_EQ(summary.max, max);
+
+            uint32_t bins[256];
+            stats::histogram(test_image, rect, channel, bins);
+            EXPECT_EQ(memcmp(bins, expected_bins, sizeof(bins)), 0);
+        }
+    }
+
+    conv::setIsa(conv::SSSE3);
+
+    // Regions outside of the image are clipped
+    EXPECT_EQ(stats::summarize(test_image, QRect(200, 200, 100, 100), stats::Gray).count, 54 * 56);
+    EXPECT_EQ(stats::summarize(test_image, QRect(300, 300, 10, 10), stats::Gray).count, 0);
+
+    // Flat regions
+    Image flat(32);
+    flat.resize(64, 48);
+    int x, y;
+    for (y = 0; y < 48; y++) {
+        for (x = 0; x < 64; x++) {
+            uint8_t *px = flat.scanLine(static_cast<size_t>(y)) + x * 4;
+            px[0] = x < 48 ? 40 : 0; px[1] = x < 48 ? 200 : 0; px[2] = x < 48 ? 10 : 0; px[3] = 255;
+        }
+    }
+    EXPECT_EQ(stats::dominantColor(flat, QRect(0, 0, 64, 48)), QColor(10, 200, 40));
+    EXPECT_EQ(stats::meanColor(flat, QRect(0, 0, 48, 48)), QColor(10, 200, 40));
+    EXPECT_DOUBLE_EQ(stats::summarize(flat, QRect(0, 0, 48, 48), stats::Green).variance, 0.0);
+}
+
+TEST(Image, IncrementalCapture)
+{
+    QRect rect(100, 100, 254, 256);
+
+    IncrementalCapture capture(rect);
+
+    // The first capture copies every tile
+    ASSERT_TRUE(capture.capture());
+    EXPECT_FALSE(capture.unchanged());
+    ASSERT_NE(capture.frame().bits(), nullptr);
+
+    int tiles_x = (capture.frame().width() + IncrementalCapture::tile_size - 1) / IncrementalCapture::tile_size;
+    int tiles_y = (capture.frame().height() + IncrementalCapture::tile_size - 1) / IncrementalCapture::tile_size;
+    EXPECT_EQ(capture.changedTiles(), tiles_x * tiles_y);
+
+    // The screen may change in between, the frame keeps its size either way
+    QSize size = capture.frame().size();
+    ASSERT_TRUE(capture.capture());
+    EXPECT_EQ(capture.unchanged(), capture.changedTiles() == 0);
+    EXPECT_EQ(capture.frame().size(), size);
+
+    // A copy of an earlier version only receives the tiles changed since then
+    Image copy(32);
+    uint64_t copy_version = 0;
+    capture.copyTo(copy, copy_version);
+    EXPECT_EQ(copy, capture.frame());
+    EXPECT_EQ(copy_version, capture.version());
+
+    ASSERT_TRUE(capture.capture());
+    capture.copyTo(copy, copy_version);
+    EXPECT_EQ(copy, capture.frame());
+    EXPECT_EQ(copy_version, capture.version());
+}
+
 TEST(Image, Screenshot)
 {
     int width = 254;
@@ -0,0 +1,129 @@
+#ifndef TEST_RECORDER_H
+#define TEST_RECORDER_H
+
+#include <gtest/gtest.h>
+#include <gmock/gmock-matchers.h>
+
+#include "createimage.h"
+#include "image/image.h"
+#include "utils/framepacer.h"
+#include "video/framequeue.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace testing;
+
+TEST(Recorder, FrameQueue)
+{
+    int width = 64;
+    int height = 48;
+    int framecount = 200;
+
+    for (bool compression : {false, true}) {
+        // Two frames fit into the memory, the others go to the file
+        FrameQueue queue(width, height);
+        queue.resize(8, 32);
+        queue.setCompression(compression);
+        queue.setMemoryLimit(static_cast<int64_t>(queue.frameSize()) * 2);
+
+        std::atomic<bool> produced(false);
+
+        std::thread producer([&queue, &produced, width, height, framecount]() {
+            int index;
+            for (index = 0; index < framecount; index++) {
+                RecordedFrame *frame;
+                while ((frame = queue.acquireWrite()) == nullptr)
+                    queue.waitNotFull(100);
+
+                // Slots in memory get their buffer on first use (like from the capture)
+                if (frame->image.bits() == nullptr)
+                    frame->image.resize(width, height);
+                fillImage(frame->image, index);
+
+                frame->index = index;
+                frame->timestamp = index * 1000;
+                frame->repeat = index % 3;
+                frame->stop_timestamp = index == framecount - 1 ? index * 1000 : -1;
+                queue.commitWrite();
+            }
+            produced = true;
+        });
+
+        // The consumer starts late -> the backlog exceeds the memory (at most
+        // a second, in case the file cannot be created)
+        int index;
+        for (index = 0; index < 1000 && queue.size() < 12 && !produced; index++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        for (index = 0; index < framecount; index++) {
+            while (queue.empty())
+                queue.waitNotEmpty(100);
+
+            RecordedFrame *frame = queue.acquireRead();
+            ASSERT_NE(frame, nullptr) << compression;
+
+            EXPECT_EQ(frame->index, index) << compression;
+            EXPECT_EQ(frame->timestamp, index * 1000) << compression;
+            EXPECT_EQ(frame->repeat, index % 3) << compression;
+            EXPECT_EQ(frame->stop_timestamp, index == framecount - 1 ? index * 1000 : -1) << compression;
+            EXPECT_EQ(frame->image, createImage(width, height, index)) << compression << " " << index;
+
+            queue.releaseRead();
+        }
+
+        producer.join();
+
+        EXPECT_TRUE(queue.empty()) << compression;
+        EXPECT_GT(queue.spilledFrames(), 0u) << compression;
+
+        // Compressed frames give back all of their memory, only the buffers,
+        // which the slots keep for reuse, are left (within the limit)
+        EXPECT_EQ(queue.memoryUsed() % static_cast<int64_t>(queue.frameSize()), 0) << compression;
+        EXPECT_LE(queue.memoryUsed(), queue.memoryLimit()) << compression;
+    }
+}
+
+TEST(Recorder, FramePacer)
+{
+    // Deadlines every 20ms
+    FramePacer pacer(50);
+    pacer.start();
+
+    int passed = pacer.waitForNextFrame();
+    EXPECT_GE(passed, 1);
+    EXPECT_EQ(pacer.frameIndex(), passed);
+    EXPECT_GE(pacer.elapsedUs(), pacer.frameIndex() * 20000);
+    EXPECT_EQ(pacer.statistics().frames, 1);
+
+    // More than two frames late -> the missed deadlines are skipped, the
+    // frame of the last one is late
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    int64_t index = pacer.frameIndex();
+    int64_t skipped = pacer.statistics().skipped;
+
+    passed = pacer.waitForNextFrame();
+    EXPECT_GE(passed, 2);
+    EXPECT_EQ(pacer.frameIndex(), index + passed);
+    EXPECT_GE(pacer.elapsedUs(), pacer.frameIndex() * 20000);
+    EXPECT_EQ(pacer.statistics().skipped - skipped, passed - 1);
+    EXPECT_GE(pacer.statistics().late, 1);
+    EXPECT_EQ(pacer.statistics().frames, 2);
+
+    // Back on time
+    index = pacer.frameIndex();
+    passed = pacer.waitForNextFrame();
+    EXPECT_GE(passed, 1);
+    EXPECT_EQ(pacer.frameIndex(), index + passed);
+    EXPECT_EQ(pacer.statistics().frames, 3);
+
+    // Restarting resets the index and the statistics
+    pacer.start();
+    EXPECT_EQ(pacer.frameIndex(), 0);
+    EXPECT_EQ(pacer.statistics().frames, 0);
+    EXPECT_EQ(pacer.statistics().skipped, 0);
+}
+
+#endif // TEST_RECORDER_H
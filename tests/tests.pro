@@ -12,8 +12,10 @@ HEADERS += \
     ../image/image.h \ # for moc creation
     ../video/decoder.h \ # for moc creation
     ../video/encoder.h \ # for moc creation
+    ../video/transcodequeue.h \ # for moc creation
     test_encode.h \
     test_image.h \
+    test_recorder.h \
     test_script.h
 
 SOURCES += \
@@ -23,16 +25,35 @@ SOURCES += \
     ../script/lexer.cpp \
     ../script/parameter.cpp \
     ../script/parser.cpp \
+    ../image/convert.cpp \
+    ../image/damagetracker.cpp \
     ../image/image.cpp \
+    ../image/imageloader.cpp \
+    ../image/imagesaver.cpp \
+    ../image/incrementalcapture.cpp \
+    ../image/qoi.cpp \
+    ../image/scale.cpp \
+    ../image/statistics.cpp \
+    ../utils/bufferpool.cpp \
+    ../utils/framepacer.cpp \
+    ../utils/parallel.cpp \
+    ../utils/spillfile.cpp \
     ../video/decoder.cpp \
-    ../video/encoder.cpp
+    ../video/encoder.cpp \
+    ../video/framequeue.cpp \
+    ../video/remux.cpp \
+    ../video/segmentring.cpp \
+    ../video/transcode.cpp \
+    ../video/transcodequeue.cpp \
+    ../video/videofile.cpp
 
 win32 {
     SOURCES += \
         ../image/image_win.cpp
 
     LIBS += \
-        -lgdi32
+        -lgdi32 \
+        -lwinmm
 }
 
 macx {
@@ -43,8 +64,25 @@ macx {
         -framework ApplicationServices
 }
 
+unix:!macx {
+    SOURCES += \
+        ../image/image_x11.cpp
+
+    LIBS += \
+        -lX11 \
+        -lXext
+
+    # Without XDamage, captures are compared tile by tile
+    CONFIG += link_pkgconfig
+    packagesExist(xdamage xfixes) {
+        DEFINES += HAVE_XDAMAGE
+        PKGCONFIG += xdamage xfixes
+    }
+}
+
 INCLUDEPATH += \
     $$PWD/..
 
 include(../external/googletest.pri)
 include(../external/FFmpeg.pri)
+include(../external/lz4.pri)
@@ -0,0 +1,122 @@
+#include "bufferpool.h"
+
+#include <QMutex>
+
+#include <cstdlib>
+#include <iterator>
+#include <map>
+
+namespace bufferpool
+{
+
+// Stored directly in front of every buffer
+struct Header
+{
+    void *base;
+    size_t size;
+};
+
+// Small buffers are cheap to allocate and are not kept
+static const size_t min_pooled_size = 1 << 16;
+
+static QMutex mutex;
+static std::multimap<size_t, Header *> free_buffers;
+static size_t cached_bytes = 0;
+static size_t capacity = 128 << 20;
+
+static inline Header *header(void *buffer)
+{
+    return static_cast<Header *>(buffer) - 1;
+}
+
+static inline uint8_t *buffer(Header *header)
+{
+    return reinterpret_cast<uint8_t *>(header + 1);
+}
+
+static void freeHeader(Header *header)
+{
+    free(header->base);
+}
+
+uint8_t *acquire(size_t size)
+{
+    if (size >= min_pooled_size) {
+        QMutexLocker locker(&mutex);
+
+        // Slightly larger buffers are fine as well
+        auto it = free_buffers.lower_bound(size);
+        if (it != free_buffers.end() && it->first <= size + size / 8) {
+            Header *reused = it->second;
+            cached_bytes -= it->first;
+            free_buffers.erase(it);
+            return buffer(reused);
+        }
+    }
+
+    void *base = malloc(size + sizeof(Header) + alignment);
+    if (base == nullptr)
+        return nullptr;
+
+    uintptr_t aligned = (reinterpret_cast<uintptr_t>(base) + sizeof(Header) + alignment - 1) & ~(alignment - 1);
+
+    Header *new_header = reinterpret_cast<Header *>(aligned) - 1;
+    new_header->base = base;
+    new_header->size = size;
+
+    return buffer(new_header);
+}
+
+void release(void *buffer)
+{
+    if (buffer == nullptr)
+        return;
+
+    Header *released = header(buffer);
+
+    if (released->size >= min_pooled_size) {
+        QMutexLocker locker(&mutex);
+
+        if (cached_bytes + released->size <= capacity) {
+            cached_bytes += released->size;
+            free_buffers.emplace(released->size, released);
+            return;
+        }
+    }
+
+    freeHeader(released);
+}
+
+void discard(void *buffer)
+{
+    if (buffer != nullptr)
+        freeHeader(header(buffer));
+}
+
+// Drops the largest buffers first -> mutex needs to be locked
+static void shrinkTo(size_t bytes)
+{
+    while (cached_bytes > bytes) {
+        auto it = std::prev(free_buffers.end());
+        cached_bytes -= it->first;
+        freeHeader(it->second);
+        free_buffers.erase(it);
+    }
+}
+
+void setCapacity(size_t bytes)
+{
+    QMutexLocker locker(&mutex);
+
+    capacity = bytes;
+    shrinkTo(capacity);
+}
+
+void clear()
+{
+    QMutexLocker locker(&mutex);
+
+    shrinkTo(0);
+}
+
+} // namespace bufferpool
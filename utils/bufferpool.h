@@ -0,0 +1,32 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Recycles large pixel buffers. Images of the same size are allocated over and
+// over again (loading, capturing, scaling), with the pool they do not need fresh
+// pages from the system every time. Buffers are aligned to a cache line.
+namespace bufferpool
+{
+
+static const size_t alignment = 64;
+
+uint8_t *acquire(size_t size);
+
+// Matches ImageCleanupFunction -> buffers can be handed over to Image::assign
+void release(void *buffer);
+
+// Frees the buffer right away instead of keeping it for reuse, e.g. when
+// memory is given back to the system
+void discard(void *buffer);
+
+// Maximum number of bytes kept for reuse, 0 disables the pool
+void setCapacity(size_t bytes);
+
+// Frees all buffers, which are kept for reuse
+void clear();
+
+} // namespace bufferpool
+
+#endif // BUFFERPOOL_H
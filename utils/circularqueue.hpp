@@ -2,68 +2,112 @@
 #define CIRCULARQUEUE_H
 
 #include <QMutex>
+#include <QWaitCondition>
+
+#include <algorithm>
+#include <atomic>
 #include <vector>
 
+// Ring buffer for exactly one producer and one consumer thread
+// -> push() and pop() are wait-free, they only touch the atomic position of the
+//    other side, when the cached copy indicates that the queue is full / empty.
+//    The positions of both sides live on separate cache lines, so the threads
+//    do not invalidate each other's cache with every operation
 template<typename T>
 class CircularQueue
 {
 public:
     CircularQueue(size_t obj_size);
 
+    // Must not be called, while the queue is in use by another thread
     void resize(size_t val);
 
-    void push(T &val);
-    void pop(T &val);
-
-    inline bool empty() { QMutexLocker locker(&mutex); return total_size == 0; }
-    inline bool full() { QMutexLocker locker(&mutex); return total_size == max_size; }
-    inline size_t size() { QMutexLocker locker(&mutex); return total_size; }
+    // Return false, if the queue is full / empty
+    // -> push() must only be called by the producer, pop() only by the consumer
+    bool push(T &val);
+    bool pop(T &val);
+
+    // Access to the slots in place, without moving elements in and out
+    // -> acquireWrite() returns the next free slot (nullptr if full), which is
+    //    published to the consumer by commitWrite(). acquireRead() returns the
+    //    oldest element (nullptr if empty), releaseRead() hands the slot back.
+    //    The slots keep their content, so buffers of elements are reused
+    T *acquireWrite();
+    void commitWrite();
+    T *acquireRead();
+    void releaseRead();
+
+    inline bool empty() const { return size() == 0; }
+    inline bool full() const { return size() == max_size; }
+    inline size_t size() const { return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire); }
+    inline size_t capacity() const { return max_size; }
+
+    // Block until an element can be pushed / popped, or the time (ms) is over
+    // -> return false on timeout or when woken up by wakeAll()
+    bool waitNotFull(unsigned long time);
+    bool waitNotEmpty(unsigned long time);
+
+    // Wakes up all waiting threads, e.g. when stopping
+    void wakeAll();
 
 protected:
     size_t obj_size;
 
 private:
+    static const size_t cache_line = 64;
+
+    inline T &slot(size_t pos) { size_t index = pos % max_size; return data[index / vector_size][index % vector_size]; }
+
+    void notify(std::atomic<int> &waiters, QWaitCondition &condition);
+
     // Make two-dimensional array in order to deal with problems,
     // that arise, when large vectors are used
     std::vector<std::vector<T>> data;
 
     size_t vector_size;
-    size_t total_size;
     size_t max_size;
 
-    size_t front_vector;
-    size_t front_index;
-    size_t back_vector;
-    size_t back_index;
+    // Positions only grow, the slot is the position modulo max_size
+    // -> consumer side
+    alignas(cache_line) std::atomic<size_t> head;
+    size_t cached_tail;
+
+    // -> producer side
+    alignas(cache_line) std::atomic<size_t> tail;
+    size_t cached_head;
+
+    // Only used for blocking waits
+    alignas(cache_line) std::atomic<int> consumer_waiting;
+    std::atomic<int> producer_waiting;
 
     QMutex mutex;
+    QWaitCondition not_full;
+    QWaitCondition not_empty;
 };
 
 template<typename T>
 CircularQueue<T>::CircularQueue(size_t obj_size)
     : obj_size(obj_size),
-      total_size(0),
       max_size(0),
-      front_vector(0),
-      front_index(0),
-      back_vector(0),
-      back_index(0)
+      head(0),
+      cached_tail(0),
+      tail(0),
+      cached_head(0),
+      consumer_waiting(0),
+      producer_waiting(0)
 {
     // max vector size is to store elements of 64 MB size
-    vector_size = (1 << 26) / obj_size;
+    vector_size = std::max<size_t>(1, (1 << 26) / std::max<size_t>(1, obj_size));
 }
 
 template<typename T>
 void CircularQueue<T>::resize(size_t val)
 {
-    QMutexLocker locker(&mutex);
-
     max_size = val;
-    total_size = 0;
-    back_vector = 0;
-    back_index = 0;
-    front_vector = 0;
-    front_index = 0;
+    head = 0;
+    tail = 0;
+    cached_head = 0;
+    cached_tail = 0;
 
     data.clear();
     data.resize((max_size + vector_size - 1) / vector_size, std::vector<T>());
@@ -73,41 +117,127 @@ void CircularQueue<T>::resize(size_t val)
 }
 
 template<typename T>
-void CircularQueue<T>::push(T &val)
+T *CircularQueue<T>::acquireWrite()
 {
-    QMutexLocker locker(&mutex);
+    size_t pos = tail.load(std::memory_order_relaxed);
+
+    if (pos - cached_head == max_size) {
+        cached_head = head.load(std::memory_order_acquire);
+        if (pos - cached_head == max_size)
+            return nullptr;
+    }
+
+    return &slot(pos);
+}
 
-    if (total_size == max_size)
-        return;
+template<typename T>
+void CircularQueue<T>::commitWrite()
+{
+    tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
 
-    data[back_vector][back_index] = std::move(val);
+    notify(consumer_waiting, not_empty);
+}
 
-    back_index++;
-    if (back_index == vector_size) {
-        back_vector = (back_vector + 1) % data.size();
-        back_index = 0;
+template<typename T>
+T *CircularQueue<T>::acquireRead()
+{
+    size_t pos = head.load(std::memory_order_relaxed);
+
+    if (pos == cached_tail) {
+        cached_tail = tail.load(std::memory_order_acquire);
+        if (pos == cached_tail)
+            return nullptr;
     }
 
-    total_size++;
+    return &slot(pos);
 }
 
 template<typename T>
-void CircularQueue<T>::pop(T &val)
+void CircularQueue<T>::releaseRead()
 {
-    QMutexLocker locker(&mutex);
+    head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
 
-    if (total_size == 0)
-        return;
+    notify(producer_waiting, not_full);
+}
 
-    val = std::move(data[front_vector][front_index]);
+template<typename T>
+bool CircularQueue<T>::push(T &val)
+{
+    T *dest = acquireWrite();
+    if (dest == nullptr)
+        return false;
 
-    front_index++;
-    if (front_index == vector_size) {
-        front_vector = (front_vector + 1) % data.size();
-        front_index = 0;
+    *dest = std::move(val);
+    commitWrite();
+    return true;
+}
+
+template<typename T>
+bool CircularQueue<T>::pop(T &val)
+{
+    T *src = acquireRead();
+    if (src == nullptr)
+        return false;
+
+    val = std::move(*src);
+    releaseRead();
+    return true;
+}
+
+template<typename T>
+void CircularQueue<T>::notify(std::atomic<int> &waiters, QWaitCondition &condition)
+{
+    // Pairs with the increment in the waiting thread -> either the waiting
+    // thread sees the new position, or this thread sees the waiter
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (waiters.load(std::memory_order_relaxed) > 0) {
+        QMutexLocker locker(&mutex);
+        condition.wakeAll();
     }
+}
+
+template<typename T>
+bool CircularQueue<T>::waitNotFull(unsigned long time)
+{
+    if (!full())
+        return true;
+
+    QMutexLocker locker(&mutex);
+
+    producer_waiting++;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (full())
+        not_full.wait(&mutex, time);
+    producer_waiting--;
+
+    return !full();
+}
+
+template<typename T>
+bool CircularQueue<T>::waitNotEmpty(unsigned long time)
+{
+    if (!empty())
+        return true;
+
+    QMutexLocker locker(&mutex);
+
+    consumer_waiting++;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (empty())
+        not_empty.wait(&mutex, time);
+    consumer_waiting--;
+
+    return !empty();
+}
+
+template<typename T>
+void CircularQueue<T>::wakeAll()
+{
+    QMutexLocker locker(&mutex);
 
-    total_size--;
+    not_full.wakeAll();
+    not_empty.wakeAll();
 }
 
 #endif // CIRCULARQUEUE_H
@@ -0,0 +1,97 @@
+#include "framepacer.h"
+
+#include <algorithm>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <timeapi.h>
+#endif
+
+// The scheduler may wake a thread up late by up to this margin
+// -> the rest of the time is spent yielding, which is cheap compared to a
+//    full busy wait, because it only lasts for a fraction of each frame
+#ifdef _WIN32
+static const std::chrono::microseconds wake_up_margin(1500);
+#else
+static const std::chrono::microseconds wake_up_margin(200);
+#endif
+
+FramePacer::FramePacer(int frame_rate) :
+    frame_rate(std::max(1, frame_rate)),
+    index(0),
+    jitter_sum(0.)
+{
+#ifdef _WIN32
+    // Default timer resolution on Windows is 15.6ms
+    timeBeginPeriod(1);
+#endif
+}
+
+FramePacer::~FramePacer()
+{
+#ifdef _WIN32
+    timeEndPeriod(1);
+#endif
+}
+
+void FramePacer::start()
+{
+    start_time = Clock::now();
+    index = 0;
+    stats = Statistics();
+    jitter_sum = 0.;
+}
+
+FramePacer::Clock::time_point FramePacer::deadline(int64_t frame) const
+{
+    // Computed from the index, so rounding errors do not add up
+    return start_time + std::chrono::duration_cast<Clock::duration>(std::chrono::nanoseconds(frame * 1000000000LL / frame_rate));
+}
+
+int64_t FramePacer::elapsedMs() const
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start_time).count();
+}
+
+int64_t FramePacer::elapsedUs() const
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start_time).count();
+}
+
+int FramePacer::waitForNextFrame()
+{
+    int64_t next = index + 1;
+    Clock::time_point now = Clock::now();
+
+    // If the caller is already late by more than a frame, waiting for the
+    // missed deadline would only shift all following frames
+    while (deadline(next + 1) <= now) {
+        next++;
+        stats.skipped++;
+    }
+
+    Clock::time_point target = deadline(next);
+    stats.frames++;
+
+    if (target <= now) {
+        // The caller missed the deadline -> nothing to wait for
+        stats.late++;
+    } else {
+        if (target - now > wake_up_margin)
+            std::this_thread::sleep_until(target - wake_up_margin);
+
+        while ((now = Clock::now()) < target)
+            std::this_thread::yield();
+
+        double jitter = std::chrono::duration<double, std::milli>(now - target).count();
+        jitter_sum += jitter;
+        stats.mean_jitter = jitter_sum / static_cast<double>(stats.frames - stats.late);
+        stats.max_jitter = std::max(stats.max_jitter, jitter);
+    }
+
+    int passed = static_cast<int>(next - index);
+    index = next;
+
+    return passed;
+}
@@ -0,0 +1,53 @@
+#ifndef FRAMEPACER_H
+#define FRAMEPACER_H
+
+#include <chrono>
+#include <cstdint>
+
+// Paces a loop on absolute deadlines (start + index / frame_rate), so that
+// delays of single frames do not accumulate.
+// -> The thread sleeps until shortly before the deadline and only yields for
+//    the remaining fraction of a millisecond, which keeps it mostly idle
+class FramePacer
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Statistics
+    {
+        int64_t frames = 0;
+        int64_t late = 0;        // deadlines, which had already passed when waiting
+        int64_t skipped = 0;     // deadlines, which had passed by more than a frame
+        double mean_jitter = 0.; // ms between deadline and wake up (without late frames)
+        double max_jitter = 0.;
+    };
+
+    FramePacer(int frame_rate);
+    ~FramePacer();
+
+    // Sets the deadline of frame 0 to now
+    void start();
+
+    // Blocks until the deadline of the next frame. Returns the number of frame
+    // intervals, which passed since the previous call (more than 1, if the
+    // caller took longer than a frame).
+    int waitForNextFrame();
+
+    int64_t frameIndex() const { return index; }
+    int64_t elapsedMs() const;
+    int64_t elapsedUs() const;
+
+    const Statistics &statistics() const { return stats; }
+
+private:
+    Clock::time_point deadline(int64_t frame) const;
+
+    int frame_rate;
+    Clock::time_point start_time;
+    int64_t index;
+
+    Statistics stats;
+    double jitter_sum;
+};
+
+#endif // FRAMEPACER_H
@@ -0,0 +1,41 @@
+#include "memorysampler.h"
+
+#include "memoryusage.h"
+
+MemorySampler::MemorySampler(int interval, QObject *parent) :
+    QThread(parent),
+    interval(interval),
+    _unused(0),
+    _total(0),
+    _samples(0),
+    quit(false)
+{
+}
+
+void MemorySampler::run()
+{
+    MemoryUsage usage_stats;
+
+    mutex.lock();
+    while (!quit) {
+        mutex.unlock();
+
+        usage_stats.retrieveInfo();
+        _unused.store(usage_stats.unused(), std::memory_order_relaxed);
+        _total.store(usage_stats.total(), std::memory_order_relaxed);
+        _samples.fetch_add(1, std::memory_order_release);
+
+        mutex.lock();
+        if (!quit)
+            wake_up.wait(&mutex, static_cast<unsigned long>(interval));
+    }
+    mutex.unlock();
+}
+
+void MemorySampler::stop()
+{
+    QMutexLocker locker(&mutex);
+
+    quit = true;
+    wake_up.wakeAll();
+}
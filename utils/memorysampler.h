@@ -0,0 +1,45 @@
+#ifndef MEMORYSAMPLER_H
+#define MEMORYSAMPLER_H
+
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+
+#include <atomic>
+
+// Samples the memory usage in the background, so that threads with deadlines
+// can poll the latest values without waiting for the system
+class MemorySampler : public QThread
+{
+    Q_OBJECT
+
+public:
+    MemorySampler(int interval = 500, QObject *parent = nullptr);
+
+    // Latest values in MB, 0 before the first sample was taken
+    int unused() const { return _unused.load(std::memory_order_relaxed); }
+    int total() const { return _total.load(std::memory_order_relaxed); }
+
+    // Increases with every sample -> tells, if the values changed since the last poll
+    int samples() const { return _samples.load(std::memory_order_acquire); }
+
+public slots:
+    void stop();
+
+protected:
+    void run() override;
+
+private:
+    int interval;
+
+    std::atomic<int> _unused;
+    std::atomic<int> _total;
+    std::atomic<int> _samples;
+
+    bool quit;
+
+    QMutex mutex;
+    QWaitCondition wake_up;
+};
+
+#endif // MEMORYSAMPLER_H
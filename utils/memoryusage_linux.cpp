@@ -0,0 +1,169 @@
+#if defined(__linux__)
+
+#include "memoryusage.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+// Containers only see the memory of their cgroup, the values of the host in
+// /proc/meminfo are limited by the memory limit and usage of the cgroup
+
+MemoryUsage::MemoryUsage() :
+    _used(0),
+    _unused(0),
+    _total(0),
+    _wired(0)
+{
+}
+
+static const int64_t no_limit = INT64_MAX;
+
+static bool readNumber(const std::string &file_name, int64_t &value)
+{
+    std::ifstream file(file_name);
+    std::string content;
+    if (!(file >> content))
+        return false;
+
+    // cgroup v2 writes 'max' for no limit
+    if (content == "max") {
+        value = no_limit;
+        return true;
+    }
+
+    try {
+        value = std::stoll(content);
+    } catch (...) {
+        return false;
+    }
+    return true;
+}
+
+// Value of a 'key value' line, e.g. in memory.stat or /proc/meminfo
+static int64_t readKey(const std::string &file_name, const std::string &key)
+{
+    std::ifstream file(file_name);
+    std::string name;
+    int64_t value;
+    while (file >> name >> value) {
+        if (name == key)
+            return value;
+        file.ignore(256, '\n');
+    }
+    return 0;
+}
+
+struct CgroupMemory
+{
+    int64_t limit = no_limit;
+    int64_t usage = 0;
+};
+
+// The cgroup path of this process, either of the unified hierarchy (v2) or
+// of the memory controller (v1)
+static bool cgroupPath(std::string &path, bool &unified)
+{
+    std::ifstream file("/proc/self/cgroup");
+    std::string line;
+
+    bool found = false;
+    while (std::getline(file, line)) {
+        size_t first = line.find(':');
+        size_t second = line.find(':', first + 1);
+        if (first == std::string::npos || second == std::string::npos)
+            continue;
+
+        std::string controllers = line.substr(first + 1, second - first - 1);
+        std::string cgroup = line.substr(second + 1);
+        if (cgroup == "/")
+            cgroup.clear();
+
+        if (controllers.empty() && !found) {
+            // '0::/path' -> v2, unless the memory controller is in v1
+            path = "/sys/fs/cgroup" + cgroup;
+            unified = true;
+            found = true;
+        } else if (("," + controllers + ",").find(",memory,") != std::string::npos) {
+            path = "/sys/fs/cgroup/memory" + cgroup;
+            unified = false;
+            return true;
+        }
+    }
+
+    return found;
+}
+
+static CgroupMemory cgroupMemory()
+{
+    CgroupMemory memory;
+
+    std::string path;
+    bool unified;
+    if (!cgroupPath(path, unified))
+        return memory;
+
+    std::string limit_name = unified ? "memory.max" : "memory.limit_in_bytes";
+    std::string usage_name = unified ? "memory.current" : "memory.usage_in_bytes";
+    std::string inactive_name = unified ? "inactive_file" : "total_inactive_file";
+
+    // Inside of a cgroup namespace, the path might not exist -> use the root
+    std::ifstream test(path + "/" + usage_name);
+    if (!test.good())
+        path = unified ? "/sys/fs/cgroup" : "/sys/fs/cgroup/memory";
+
+    if (!readNumber(path + "/" + usage_name, memory.usage))
+        return memory;
+
+    // Page cache, which can be reclaimed, does not count as used
+    memory.usage = std::max<int64_t>(0, memory.usage - readKey(path + "/memory.stat", inactive_name));
+
+    // Parent cgroups may have tighter limits
+    std::string dir = path;
+    while (true) {
+        int64_t limit;
+        if (readNumber(dir + "/" + limit_name, limit))
+            memory.limit = std::min(memory.limit, limit);
+
+        size_t slash = dir.find_last_of('/');
+        if (slash == std::string::npos || dir.length() <= std::string("/sys/fs/cgroup").length())
+            break;
+        dir = dir.substr(0, slash);
+    }
+
+    return memory;
+}
+
+void MemoryUsage::retrieveInfo()
+{
+    clear();
+
+    // Values in kB
+    int64_t total = readKey("/proc/meminfo", "MemTotal:");
+    int64_t available = readKey("/proc/meminfo", "MemAvailable:");
+    int64_t unevictable = readKey("/proc/meminfo", "Unevictable:");
+
+    // v1 reports a huge number close to INT64_MAX for no limit
+    CgroupMemory cgroup = cgroupMemory();
+    if (cgroup.limit / 1024 < total) {
+        int64_t limit = cgroup.limit / 1024;
+        total = limit;
+        available = std::min(available, std::max<int64_t>(0, limit - cgroup.usage / 1024));
+    }
+
+    _total = static_cast<int>(total / 1024);
+    _unused = static_cast<int>(available / 1024);
+    _used = _total - _unused;
+    _wired = static_cast<int>(unevictable / 1024);
+}
+
+void MemoryUsage::clear()
+{
+    _total = 0;
+    _used = 0;
+    _wired = 0;
+    _unused = 0;
+}
+
+#endif // __linux__
@@ -0,0 +1,90 @@
+#include "parallel.h"
+
+#include <QMutex>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+struct ParallelJob
+{
+    std::function<void(int, int)> fnc;
+
+    int count;
+    int band_size;
+    int num_bands;
+
+    std::atomic<int> next_band;
+
+    QMutex mutex;
+    QWaitCondition condition;
+    int finished_bands;
+
+    // Returns false, if there are no bands left
+    bool processNext()
+    {
+        int band = next_band.fetch_add(1);
+        if (band >= num_bands)
+            return false;
+
+        int begin = band * band_size;
+        int end = std::min(count, begin + band_size);
+        fnc(begin, end);
+
+        QMutexLocker locker(&mutex);
+        if (++finished_bands == num_bands)
+            condition.wakeAll();
+
+        return true;
+    }
+};
+
+class ParallelRunnable : public QRunnable
+{
+public:
+    ParallelRunnable(const std::shared_ptr<ParallelJob> &job) : job(job) {}
+
+    void run() override { while (job->processNext()) {} }
+
+private:
+    std::shared_ptr<ParallelJob> job;
+};
+
+void parallelFor(int count, int min_band, const std::function<void(int, int)> &fnc)
+{
+    if (count <= 0)
+        return;
+
+    int max_threads = std::max(1, QThreadPool::globalInstance()->maxThreadCount());
+    int num_bands = std::min(max_threads, count / std::max(1, min_band));
+
+    if (num_bands <= 1) {
+        fnc(0, count);
+        return;
+    }
+
+    std::shared_ptr<ParallelJob> job = std::make_shared<ParallelJob>();
+    job->fnc = fnc;
+    job->count = count;
+    job->band_size = (count + num_bands - 1) / num_bands;
+    job->num_bands = (count + job->band_size - 1) / job->band_size;
+    job->next_band = 0;
+    job->finished_bands = 0;
+
+    // The calling thread takes part, so one runnable less is needed
+    int index;
+    for (index = 1; index < job->num_bands; index++)
+        QThreadPool::globalInstance()->start(new ParallelRunnable(job));
+
+    // Bands, which have not been picked up by the pool yet, are processed here.
+    // Waiting is only necessary for bands, which are currently being processed
+    // -> this avoids a deadlock when the pool is exhausted
+    while (job->processNext()) {}
+
+    QMutexLocker locker(&job->mutex);
+    while (job->finished_bands < job->num_bands)
+        job->condition.wait(&job->mutex);
+}
@@ -0,0 +1,12 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <functional>
+
+// Splits the range [0, count) into bands of at least min_band elements and
+// processes them on the global QThreadPool. The calling thread works on bands
+// as well and only returns once every band is done.
+// -> It is safe to call this function from a thread of the pool itself
+void parallelFor(int count, int min_band, const std::function<void(int begin, int end)> &fnc);
+
+#endif // PARALLEL_H
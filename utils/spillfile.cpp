@@ -0,0 +1,158 @@
+#include "spillfile.h"
+
+#include <QDir>
+
+#include <algorithm>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+
+// Segments are mapped one at a time by each side
+static const size_t segment_size = 1 << 27;
+static const size_t page_size = 1 << 12;
+
+static const size_t no_segment = static_cast<size_t>(-1);
+
+SpillFile::SpillFile() :
+    file(QDir::tempPath() + "/SimpleScript-XXXXXX.spill"),
+    record_size(0),
+    records_per_segment(0),
+    max_records(0),
+    write_mapping({no_segment, nullptr}),
+    read_mapping({no_segment, nullptr}),
+    written(0),
+    read(0)
+{
+}
+
+SpillFile::~SpillFile()
+{
+    close();
+}
+
+bool SpillFile::open(size_t record_size, size_t max_records)
+{
+    close();
+
+    if (record_size == 0 || max_records == 0 || !file.open())
+        return false;
+
+    this->record_size = (record_size + page_size - 1) / page_size * page_size;
+    this->records_per_segment = std::max<size_t>(1, segment_size / this->record_size);
+    this->max_records = max_records;
+
+    written = 0;
+    read = 0;
+
+    return true;
+}
+
+void SpillFile::close()
+{
+    unmap(write_mapping, true);
+    unmap(read_mapping, false);
+
+    // The temporary file is removed by QTemporaryFile
+    if (file.isOpen()) {
+        file.resize(0);
+        file.close();
+    }
+
+    records_per_segment = 0;
+    max_records = 0;
+    written = 0;
+    read = 0;
+}
+
+uint8_t *SpillFile::record(Mapping &mapping, size_t pos, bool writing)
+{
+    size_t segment = pos / records_per_segment;
+
+    if (mapping.segment != segment) {
+        unmap(mapping, writing);
+
+        QMutexLocker locker(&mutex);
+
+        qint64 segment_bytes = static_cast<qint64>(records_per_segment * record_size);
+        qint64 offset = static_cast<qint64>(segment) * segment_bytes;
+
+        // The file only grows -> the writer extends it segment by segment
+        if (writing && file.size() < offset + segment_bytes && !file.resize(offset + segment_bytes))
+            return nullptr;
+
+        mapping.data = file.map(offset, segment_bytes);
+        if (mapping.data == nullptr)
+            return nullptr;
+        mapping.segment = segment;
+
+#ifdef Q_OS_UNIX
+        madvise(mapping.data, static_cast<size_t>(segment_bytes), MADV_SEQUENTIAL);
+        if (!writing)
+            madvise(mapping.data, static_cast<size_t>(segment_bytes), MADV_WILLNEED);
+#endif
+    }
+
+    return mapping.data + (pos % records_per_segment) * record_size;
+}
+
+void SpillFile::unmap(Mapping &mapping, bool writing)
+{
+    if (mapping.data == nullptr)
+        return;
+
+    size_t segment_bytes = records_per_segment * record_size;
+
+#ifdef Q_OS_UNIX
+    // Starts writing the segment back, before the kernel needs the memory
+    if (writing)
+        msync(mapping.data, segment_bytes, MS_ASYNC);
+#endif
+
+    QMutexLocker locker(&mutex);
+
+    file.unmap(mapping.data);
+
+#ifdef __linux__
+    // Read segments are not needed anymore
+    if (!writing)
+        fallocate(file.handle(), FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                  static_cast<off_t>(mapping.segment * segment_bytes), static_cast<off_t>(segment_bytes));
+#endif
+
+    mapping.segment = no_segment;
+    mapping.data = nullptr;
+}
+
+uint8_t *SpillFile::acquireWrite()
+{
+    if (!isOpen())
+        return nullptr;
+
+    // Same limit as the one seen by the producer (see capacity())
+    if (size() >= capacity())
+        return nullptr;
+
+    return record(write_mapping, written.load(std::memory_order_relaxed), true);
+}
+
+void SpillFile::commitWrite()
+{
+    written.store(written.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+uint8_t *SpillFile::acquireRead()
+{
+    size_t pos = read.load(std::memory_order_relaxed);
+
+    if (pos == written.load(std::memory_order_acquire))
+        return nullptr;
+
+    return record(read_mapping, pos, false);
+}
+
+void SpillFile::releaseRead()
+{
+    read.store(read.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
@@ -0,0 +1,79 @@
+#ifndef SPILLFILE_H
+#define SPILLFILE_H
+
+#include <QMutex>
+#include <QTemporaryFile>
+
+#include <atomic>
+#include <cstdint>
+
+// Append-only file of fixed size records for one producer and one consumer
+// -> extends a queue in memory, when it runs full. Records are written and read
+//    in place through memory mappings of large segments, which are accessed
+//    sequentially, so the kernel can write them back and drop them from the
+//    page cache early. Throughput is limited by the disk, not by the RAM.
+//    On Linux, segments, which were read completely, are punched out of the
+//    file, so only the backlog occupies disk space.
+class SpillFile
+{
+public:
+    SpillFile();
+    ~SpillFile();
+
+    // Creates the file in the temporary directory, max_records limits the backlog
+    // (on Linux, otherwise all records written to the file)
+    bool open(size_t record_size, size_t max_records);
+    void close();
+
+    bool isOpen() const { return records_per_segment > 0; }
+
+    // Same protocol as CircularQueue -> nullptr, if the file is full / empty
+    uint8_t *acquireWrite();
+    void commitWrite();
+    uint8_t *acquireRead();
+    void releaseRead();
+
+    inline size_t size() const { return written.load(std::memory_order_acquire) - read.load(std::memory_order_acquire); }
+    inline bool empty() const { return size() == 0; }
+
+    // On Linux, only the backlog is limited, elsewhere the file does not shrink
+    // -> records, which were read already, still count
+    inline size_t capacity() const
+    {
+#ifdef __linux__
+        return max_records;
+#else
+        return max_records - read.load(std::memory_order_acquire);
+#endif
+    }
+
+    // Records are page aligned
+    size_t recordSize() const { return record_size; }
+
+private:
+    struct Mapping
+    {
+        size_t segment;
+        uchar *data;
+    };
+
+    uint8_t *record(Mapping &mapping, size_t pos, bool writing);
+    void unmap(Mapping &mapping, bool writing);
+
+    static const size_t cache_line = 64;
+
+    QTemporaryFile file;
+    QMutex mutex; // QFile is not thread-safe, only needed to (un)map segments
+
+    size_t record_size;
+    size_t records_per_segment;
+    size_t max_records;
+
+    Mapping write_mapping;
+    Mapping read_mapping;
+
+    alignas(cache_line) std::atomic<size_t> written;
+    alignas(cache_line) std::atomic<size_t> read;
+};
+
+#endif // SPILLFILE_H
@@ -1,5 +1,9 @@
 #include "decoder.h"
 
+#include "image/convert.h"
+
+#include <algorithm>
+
 extern "C" {
 #include "libavcodec/avcodec.h"
 #include "libavformat/avformat.h"
@@ -161,10 +165,11 @@ VideoDecoder::VideoDecoder() :
 void VideoDecoder::cleanUp()
 {
     if (format_ctx != nullptr)
-        avformat_close_input(&format_ctx);
+        VideoFile::closeInput(&format_ctx);
     if (codec_ctx != nullptr)
         avcodec_close(codec_ctx);
     _info = {0, 0, 0, 0};
+    frame_pts.clear();
     if (frame_ != nullptr)
         av_frame_free(&frame_);
     frame_rgb.resizeHard(0, 0);
@@ -184,7 +189,7 @@ void VideoDecoder::open(const VideoFile &video_file)
     cleanUp();
 
     // Open video file
-    if (avformat_open_input(&format_ctx, video_file.fileName().toStdString().c_str(), nullptr, nullptr) < 0) {
+    if (video_file.openInput(&format_ctx) < 0) {
         errorMsg("Could not open file");
         return;
     }
@@ -205,8 +210,12 @@ void VideoDecoder::open(const VideoFile &video_file)
             _info.width = stream->codecpar->width;
             _info.height = stream->codecpar->height;
             _info.framecount = stream->nb_frames;
-            if (stream->avg_frame_rate.den != 0)
+            // With variable frame rate, the average may be unknown -> the
+            // nominal rate of the stream is used instead
+            if (stream->avg_frame_rate.num != 0 && stream->avg_frame_rate.den != 0)
                 _info.framerate =  static_cast<int>(av_q2d(stream->avg_frame_rate) + 0.1);
+            else if (stream->r_frame_rate.num != 0 && stream->r_frame_rate.den != 0)
+                _info.framerate =  static_cast<int>(av_q2d(stream->r_frame_rate) + 0.1);
             else {
                 errorMsg("Error: Could not determine framerate");
                 return;
@@ -220,6 +229,19 @@ void VideoDecoder::open(const VideoFile &video_file)
         return;
     }
 
+    // Containers with timestamps (e.g. matroska) do not store the number of
+    // frames -> with a constant frame rate, it follows from the last GOP,
+    // otherwise the packets of the stream are counted once
+    if (_info.framecount == 0) {
+        bool constant_rate = video_stream->avg_frame_rate.num != 0 &&
+                av_cmp_q(video_stream->avg_frame_rate, video_stream->r_frame_rate) == 0;
+
+        if (!(constant_rate && countLastGop()) && av_error == 0)
+            countFrames();
+        if (av_error < 0)
+            return;
+    }
+
     // Get a pointer to the codec context for the video stream
     codec_par = video_stream->codecpar;
 
@@ -338,12 +360,54 @@ bool VideoDecoder::readFrame()
     return !_eof;
 }
 
+bool VideoDecoder::convertFrame()
+{
+    // Only conversions without scaling are handled by our own kernels
+    if (frame_->width != frame_rgb.width || frame_->height != frame_rgb.height)
+        return false;
+
+    uint8_t *dst = frame_rgb.frame()->data[0];
+    int dst_stride = frame_rgb.frame()->linesize[0];
+
+    switch (frame_->format) {
+    case AV_PIX_FMT_GBRP:
+        // Output format of the h264 decoder for streams encoded with libx264rgb
+        conv::gbrpToBgra(frame_->data[0], frame_->linesize[0],
+                         frame_->data[1], frame_->linesize[1],
+                         frame_->data[2], frame_->linesize[2],
+                         dst, dst_stride, frame_->width, frame_->height);
+        return true;
+    case AV_PIX_FMT_YUV420P:
+        if (frame_->color_range == AVCOL_RANGE_JPEG)
+            return false;
+        conv::i420ToBgra(frame_->data[0], frame_->linesize[0],
+                         frame_->data[1], frame_->linesize[1],
+                         frame_->data[2], frame_->linesize[2],
+                         dst, dst_stride, frame_->width, frame_->height);
+        return true;
+    case AV_PIX_FMT_NV12:
+        if (frame_->color_range == AVCOL_RANGE_JPEG)
+            return false;
+        conv::nv12ToBgra(frame_->data[0], frame_->linesize[0],
+                         frame_->data[1], frame_->linesize[1],
+                         dst, dst_stride, frame_->width, frame_->height);
+        return true;
+    case AV_PIX_FMT_BGRA:
+    case AV_PIX_FMT_BGR0:
+        conv::copyBgra(frame_->data[0], frame_->linesize[0],
+                       dst, dst_stride, frame_->width, frame_->height);
+        return true;
+    default:
+        return false;
+    }
+}
+
 void VideoDecoder::swsScale()
 {
     frame_rgb.shift();
 
-    if (sws_ctx != nullptr) {
-        // Convert the image from its native format to RGB
+    if (!convertFrame() && sws_ctx != nullptr) {
+        // Scale and convert the image from its native format to RGB
         sws_scale(sws_ctx, static_cast<uint8_t const * const *>(frame_->data),
                   frame_->linesize, 0, codec_ctx->height,
                   frame_rgb.frame()->data, frame_rgb.frame()->linesize);
@@ -390,12 +454,21 @@ void VideoDecoder::resize(const QSize &size)
 
 void VideoDecoder::seek(int n_frame)
 {
-    _eof = n_frame >= _info.framecount;
+    // Frames outside of the video are treated like the end of the file
+    _eof = n_frame < 0 || n_frame >= _info.framecount;
 
     if (_eof)
         return;
 
-    int64_t t_frame = av_q2d({n_frame * video_stream->time_base.den, _info.framerate * video_stream->time_base.num});
+    // With variable frame rate, the frames are found by their own timestamps
+    int64_t t_frame;
+    if (!frame_pts.empty()) {
+        t_frame = frame_pts[static_cast<size_t>(n_frame)];
+    } else {
+        t_frame = av_rescale_q(n_frame, AVRational{1, _info.framerate}, video_stream->time_base);
+        if (video_stream->start_time != AV_NOPTS_VALUE)
+            t_frame += video_stream->start_time;
+    }
 
     av_error = avformat_seek_file(format_ctx, video_stream->index, t_frame, t_frame, t_frame, AVSEEK_FLAG_ANY | AVSEEK_FLAG_BACKWARD);
     if (av_error < 0)
@@ -404,6 +477,138 @@ void VideoDecoder::seek(int n_frame)
     frame_index = n_frame;
 }
 
+int64_t VideoDecoder::frameTimeUs() const
+{
+    int64_t pts = frame_->best_effort_timestamp;
+    if (pts == AV_NOPTS_VALUE)
+        return static_cast<int64_t>(frame_index) * 1000000 / _info.framerate;
+
+    return toMicroseconds(pts);
+}
+
+int64_t VideoDecoder::toMicroseconds(int64_t pts) const
+{
+    if (video_stream->start_time != AV_NOPTS_VALUE)
+        pts -= video_stream->start_time;
+
+    return av_rescale_q(pts, video_stream->time_base, AVRational{1, 1000000});
+}
+
+bool VideoDecoder::scanFrames(std::vector<int64_t> &times, std::vector<int> &key_frames)
+{
+    times.clear();
+    key_frames.clear();
+
+    AVPacket *packet = av_packet_alloc();
+    while (av_read_frame(format_ctx, packet) >= 0) {
+        if (packet->stream_index == video_stream->index) {
+            // A closed GOP starts with its key frame in decoding and display order
+            if (packet->flags & AV_PKT_FLAG_KEY)
+                key_frames.push_back(static_cast<int>(times.size()));
+
+            // Packets without pts (e.g. in avi) count frame intervals
+            if (packet->pts != AV_NOPTS_VALUE)
+                times.push_back(toMicroseconds(packet->pts));
+            else
+                times.push_back(static_cast<int64_t>(times.size()) * 1000000 / _info.framerate);
+        }
+        av_packet_unref(packet);
+    }
+    av_packet_free(&packet);
+
+    // Packets are stored in decoding order
+    std::sort(times.begin(), times.end());
+
+    seekKeyFrame(0);
+    return av_error == 0;
+}
+
+void VideoDecoder::seekKeyFrame(int64_t time_us)
+{
+    int64_t pts = av_rescale_q(time_us, AVRational{1, 1000000}, video_stream->time_base);
+    if (video_stream->start_time != AV_NOPTS_VALUE)
+        pts += video_stream->start_time;
+
+    av_error = avformat_seek_file(format_ctx, video_stream->index, INT64_MIN, pts, pts, 0);
+    if (av_error < 0)
+        return errorMsg("Error seeking key frame");
+    av_error = 0;
+
+    // Frames of the previous position must not be returned
+    avcodec_flush_buffers(codec_ctx);
+    _eof = false;
+}
+
+void VideoDecoder::countFrames()
+{
+    // The pts are kept for seek()
+    bool has_pts = true;
+
+    AVPacket *packet = av_packet_alloc();
+    while (av_read_frame(format_ctx, packet) >= 0) {
+        if (packet->stream_index == video_stream->index) {
+            frame_pts.push_back(packet->pts);
+            has_pts = has_pts && packet->pts != AV_NOPTS_VALUE;
+        }
+        av_packet_unref(packet);
+    }
+    av_packet_free(&packet);
+
+    _info.framecount = static_cast<int>(frame_pts.size());
+
+    // Packets are stored in decoding order, without pts (e.g. in avi), the
+    // frames count frame intervals
+    if (has_pts)
+        std::sort(frame_pts.begin(), frame_pts.end());
+    else
+        frame_pts.clear();
+
+    seekFirstFrame();
+}
+
+bool VideoDecoder::countLastGop()
+{
+    // Continues with the last key frame
+    if (avformat_seek_file(format_ctx, video_stream->index, INT64_MIN, INT64_MAX, INT64_MAX, 0) < 0)
+        return false;
+
+    std::vector<int64_t> gop_pts;
+
+    AVPacket *packet = av_packet_alloc();
+    while (av_read_frame(format_ctx, packet) >= 0) {
+        if (packet->stream_index == video_stream->index)
+            gop_pts.push_back(packet->pts);
+        av_packet_unref(packet);
+    }
+    av_packet_free(&packet);
+
+    seekFirstFrame();
+    if (av_error < 0 || gop_pts.empty() || std::count(gop_pts.begin(), gop_pts.end(), AV_NOPTS_VALUE) > 0)
+        return false;
+
+    std::sort(gop_pts.begin(), gop_pts.end());
+
+    // Frame intervals of the first and the last frame in the GOP
+    AVRational interval = av_inv_q(video_stream->avg_frame_rate);
+    int64_t first = av_rescale_q(toMicroseconds(gop_pts.front()), AVRational{1, 1000000}, interval);
+    int64_t last = av_rescale_q(toMicroseconds(gop_pts.back()), AVRational{1, 1000000}, interval);
+
+    // A gap in the GOP -> the frame rate is variable after all
+    if (last - first + 1 != static_cast<int64_t>(gop_pts.size()))
+        return false;
+
+    _info.framecount = static_cast<int>(last + 1);
+    return true;
+}
+
+void VideoDecoder::seekFirstFrame()
+{
+    av_error = avformat_seek_file(format_ctx, video_stream->index, INT64_MIN, 0, 0, AVSEEK_FLAG_BACKWARD);
+    if (av_error < 0)
+        return errorMsg("Error seeking first frame");
+    av_error = 0;
+}
+
 void VideoDecoder::errorMsg(const char *msg)
 {
     last_error = msg;
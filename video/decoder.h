@@ -87,6 +87,19 @@ public:
 
     void seek(int n_frame);
 
+    // Timestamp of the frame decoded by readFrame() in microseconds since the
+    // start of the stream (call it before swsScale())
+    int64_t frameTimeUs() const;
+
+    // Timestamps of all frames in display order (same unit as frameTimeUs())
+    // and the indices of the key frames
+    // -> reads the packets without decoding them and returns to the first frame
+    bool scanFrames(std::vector<int64_t> &times, std::vector<int> &key_frames);
+
+    // Continues with the key frame at the time -> with closed GOPs (as written
+    // by libx264), readFrame() returns the frames from there in display order
+    void seekKeyFrame(int64_t time_us);
+
     int av_error;
     QString last_error;
 
@@ -95,6 +108,13 @@ private:
 
 private:
     void initialize();
+    void countFrames();
+    // Counts the frames of a stream with constant frame rate from its last
+    // GOP, fails with gaps in there
+    bool countLastGop();
+    void seekFirstFrame();
+    int64_t toMicroseconds(int64_t pts) const;
+    bool convertFrame();
     void cleanUp();
 
     Image image;
@@ -110,6 +130,10 @@ private:
 
     VideoInfo _info;
 
+    // Pts of the frames in display order, only counted for streams with a
+    // variable frame rate (otherwise empty)
+    std::vector<int64_t> frame_pts;
+
     struct AVFrame *frame_;
     DecoderFrame frame_rgb;
 
@@ -1,5 +1,9 @@
 #include "encoder.h"
 
+#include "image/convert.h"
+
+#include <algorithm>
+
 extern "C"
 {
 #include "libavcodec/avcodec.h"
@@ -8,22 +12,242 @@ extern "C"
 #include "libavutil/opt.h"
 }
 
-static const char* format_container = "avi";
 static const AVCodecID codec_id     = AV_CODEC_ID_H264;
-static const char* codec_name       = "libx264rgb";
-static const AVPixelFormat pix_fmt  = AV_PIX_FMT_BGR0;
-static const int linesize_alignment = 1;
+static const int linesize_alignment = 32;
+
+static AVPixelFormat avPixelFormat(VideoEncoder::Profile::PixelFormat pixel_format)
+{
+    switch (pixel_format) {
+    case VideoEncoder::Profile::Yuv420:
+        return AV_PIX_FMT_YUV420P;
+    case VideoEncoder::Profile::Nv12:
+        return AV_PIX_FMT_NV12;
+    default:
+        return AV_PIX_FMT_BGR0;
+    }
+}
+
+VideoEncoder::Profile VideoEncoder::Profile::lossless()
+{
+    // Set optimal compression / speed ratio for this use-case, constant rate
+    // factor 0 is lossless, see https://trac.ffmpeg.org/wiki/Encode/H.264
+    return {"avi", "libx264rgb", Bgr, 12, 2, "fast", "", "0", false};
+}
+
+VideoEncoder::Profile VideoEncoder::Profile::realtime()
+{
+    // Every frame leaves the encoder right away, NV12 saves x264 from
+    // interleaving the chroma planes
+    return {"avi", "libx264", Nv12, 12, 0, "ultrafast", "zerolatency", "18", false};
+}
+
+VideoEncoder::Profile VideoEncoder::Profile::small()
+{
+    return {"mp4", "libx264", Yuv420, 250, 3, "slow", "", "23", true};
+}
+
+VideoEncoder::Profile VideoEncoder::Profile::seekable()
+{
+    return {"avi", "libx264rgb", Bgr, 1, 0, "fast", "", "0", false};
+}
+
+VideoEncoder::Profile VideoEncoder::Profile::vfr()
+{
+    // avi has no timestamps (one frame per interval), matroska stores them
+    // in milliseconds
+    return {"matroska", "libx264rgb", Bgr, 12, 2, "fast", "", "0", true};
+}
+
+bool profileFromName(const std::string &name, VideoEncoder::Profile &profile)
+{
+    if (name == "lossless")
+        profile = VideoEncoder::Profile::lossless();
+    else if (name == "realtime")
+        profile = VideoEncoder::Profile::realtime();
+    else if (name == "small")
+        profile = VideoEncoder::Profile::small();
+    else if (name == "seekable")
+        profile = VideoEncoder::Profile::seekable();
+    else if (name == "vfr")
+        profile = VideoEncoder::Profile::vfr();
+    else
+        return false;
+    return true;
+}
+
+static int alignLinesize(int bytes)
+{
+    return (bytes + linesize_alignment - 1) / linesize_alignment * linesize_alignment;
+}
+
+void YuvFrame::resize(int width, int height)
+{
+    _width = width;
+    _height = height;
+    y_stride = alignLinesize(width);
+    uv_stride = alignLinesize(_layout == Nv12 ? (width + 1) / 2 * 2 : (width + 1) / 2);
+
+    buffer.resize(offset(planeCount()));
+}
+
+size_t YuvFrame::offset(int index) const
+{
+    size_t y_size = static_cast<size_t>(y_stride) * static_cast<size_t>(_height);
+    size_t uv_size = static_cast<size_t>(uv_stride) * static_cast<size_t>((_height + 1) / 2);
+
+    // The offset behind the last plane is the size of the buffer
+    return index == 0 ? 0 : y_size + static_cast<size_t>(index - 1) * uv_size;
+}
+
+void YuvFrame::convertFrom(const Image &img)
+{
+    if (img.width() != _width || img.height() != _height)
+        resize(img.width(), img.height());
+
+    if (_layout == Nv12)
+        conv::bgraToNv12(img.bits(), static_cast<int>(img.bytesPerLine()),
+                         plane(0), stride(0),
+                         plane(1), stride(1),
+                         _width, _height);
+    else
+        conv::bgraToI420(img.bits(), static_cast<int>(img.bytesPerLine()),
+                         plane(0), stride(0),
+                         plane(1), stride(1),
+                         plane(2), stride(2),
+                         _width, _height);
+}
 
 // void(0) is used to enforce semicolon after the macro
 #define errorMsgf(format, ...) \
 { char *buffer = new char[strlen(format) * 2 + 50]; sprintf(buffer, format, __VA_ARGS__); errorMsg(buffer); } (void)0
 
+PacketMuxer::PacketMuxer(QObject *parent) :
+    QThread(parent),
+    format_ctx(nullptr),
+    queued_bytes(0),
+    closed(false),
+    discard(false),
+    av_error(0)
+{
+}
+
+PacketMuxer::~PacketMuxer()
+{
+    abort();
+}
+
+void PacketMuxer::setup(AVFormatContext *format_ctx)
+{
+    this->format_ctx = format_ctx;
+    queued_bytes = 0;
+    closed = false;
+    discard = false;
+    av_error = 0;
+}
+
+bool PacketMuxer::push(AVPacket *pkt)
+{
+    size_t size = static_cast<size_t>(pkt->size);
+
+    AVPacket *queued = av_packet_alloc();
+    av_packet_move_ref(queued, pkt);
+
+    QMutexLocker locker(&mutex);
+
+    // A single packet larger than the limit still passes an empty queue
+    while (queued_bytes > 0 && queued_bytes + size > max_queued_bytes && error() == 0)
+        not_full.wait(&mutex);
+
+    if (error() != 0) {
+        av_packet_free(&queued);
+        return false;
+    }
+
+    packets.push_back(queued);
+    queued_bytes += size;
+    not_empty.wakeAll();
+
+    return true;
+}
+
+void PacketMuxer::close(bool discard)
+{
+    {
+        QMutexLocker locker(&mutex);
+        closed = true;
+        this->discard = this->discard || discard;
+        not_empty.wakeAll();
+    }
+
+    wait();
+
+    // Left over, if the thread never ran or packets were discarded
+    for (AVPacket *queued : packets)
+        av_packet_free(&queued);
+    packets.clear();
+    queued_bytes = 0;
+}
+
+void PacketMuxer::finish()
+{
+    close(false);
+}
+
+void PacketMuxer::abort()
+{
+    close(true);
+}
+
+void PacketMuxer::run()
+{
+    mutex.lock();
+    while (true) {
+        while (packets.empty() && !closed)
+            not_empty.wait(&mutex);
+
+        if (discard || (packets.empty() && closed))
+            break;
+
+        AVPacket *queued = packets.front();
+        packets.pop_front();
+        size_t size = static_cast<size_t>(queued->size);
+        mutex.unlock();
+
+        // Packets are buffered by the muxer, until it can interleave them by dts
+        if (error() == 0) {
+            int ret = av_interleaved_write_frame(format_ctx, queued);
+            if (ret < 0)
+                av_error = ret;
+        }
+        av_packet_free(&queued);
+
+        mutex.lock();
+        queued_bytes -= size;
+        not_full.wakeAll();
+    }
+    bool flush = !discard && error() == 0;
+    mutex.unlock();
+
+    // Writes the packets, which the muxer still holds back
+    if (flush) {
+        int ret = av_interleaved_write_frame(format_ctx, nullptr);
+        if (ret < 0)
+            av_error = ret;
+    }
+}
+
 VideoEncoder::VideoEncoder()
     : av_error(0),
       width(0),
       height(0),
       frame_counter(0),
+      next_pts(0),
+      next_key_pts(0),
       frame_rate(0),
+      profile(Profile::lossless()),
+      segment_count(0),
+      segment_seconds(0),
+      thread_count(0),
       output_fmt(nullptr),
       format_ctx(nullptr),
       video_stream(nullptr),
@@ -37,19 +261,32 @@ VideoEncoder::VideoEncoder()
     av_log_set_level(AV_LOG_ERROR);
 }
 
-void VideoEncoder::open(const VideoFile &video_file, int width, int height, int frame_rate)
+void VideoEncoder::open(const VideoFile &video_file, int width, int height, int frame_rate, const Profile &profile)
 {
     this->video_file = &video_file;
     this->width = width;
     this->height = height;
     this->frame_rate = frame_rate;
+    this->profile = profile;
+
+    yuv_frame = YuvFrame(profile.yuvLayout());
 
     initialize();
 }
 
+void VideoEncoder::setSegments(int count, int seconds, const QString &list_file)
+{
+    segment_count = count;
+    segment_seconds = seconds;
+    segment_list = list_file;
+}
+
 void VideoEncoder::allocFormatContext()
 {
-    output_fmt = av_guess_format(format_container, nullptr, nullptr);
+    // The segment muxer opens the files of the segments itself
+    const char *format_name = segment_count > 0 ? "segment" : profile.container.c_str();
+
+    output_fmt = av_guess_format(format_name, nullptr, nullptr);
     if (output_fmt == nullptr)
         return errorMsg("Could not guess format.");
 
@@ -66,12 +303,20 @@ void VideoEncoder::allocFormatContext()
     video_stream->codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
     video_stream->codecpar->width = width;
     video_stream->codecpar->height = height;
-    video_stream->codecpar->format = pix_fmt;
-    video_stream->time_base = AVRational{1, frame_rate};
+    video_stream->codecpar->format = avPixelFormat(profile.pixel_format);
+
+    // With variable frame rate, the timestamps are independent of the frame rate
+    AVRational stream_time_base = profile.variable_frame_rate ? AVRational{1, 1000} : AVRational{1, frame_rate};
+    video_stream->time_base = stream_time_base;
+
+    // Nominal rate (matroska stores it as the default duration of a frame)
+    video_stream->avg_frame_rate = AVRational{frame_rate, 1};
 }
 
 void VideoEncoder::allocCodecContext()
 {
+    const char *codec_name = profile.codec.c_str();
+
     codec = avcodec_find_encoder_by_name(codec_name);
     if (codec == nullptr) {
         errorMsgf("Codec '%s' not found", codec_name);
@@ -87,28 +332,31 @@ void VideoEncoder::allocCodecContext()
     if (av_error < 0)
         return errorMsg("Could not copy codec parameters to context.");
 
-    codec_ctx->gop_size = 12;
-    codec_ctx->max_b_frames = 2;
-    codec_ctx->time_base = AVRational{1, frame_rate};
+    codec_ctx->gop_size = profile.gop_size;
+    codec_ctx->max_b_frames = profile.max_b_frames;
+    codec_ctx->time_base = video_stream->time_base;
+
+    // Rate control assumes this rate, if the time base is not 1 / frame_rate
+    codec_ctx->framerate = AVRational{frame_rate, 1};
 
-    // Use optimal number of threads
+    // Use optimal number of threads by default
     // see https://superuser.com/questions/155305/how-many-threads-does-ffmpeg-use-by-default
-    codec_ctx->thread_count = 0;
+    codec_ctx->thread_count = thread_count;
 
     if (codec_id == AV_CODEC_ID_H264) {
-        // Set optimal compression / speed ratio for this use-case
-        av_opt_set(codec_ctx->priv_data, "preset", "fast", 0);
-
-        // Set constant rate factor to lossless
-        // see https://trac.ffmpeg.org/wiki/Encode/H.264
-        av_opt_set(codec_ctx->priv_data, "crf",    "0",    0);
+        if (!profile.preset.empty())
+            av_opt_set(codec_ctx->priv_data, "preset", profile.preset.c_str(), 0);
+        if (!profile.tune.empty())
+            av_opt_set(codec_ctx->priv_data, "tune",   profile.tune.c_str(),   0);
+        if (!profile.crf.empty())
+            av_opt_set(codec_ctx->priv_data, "crf",    profile.crf.c_str(),    0);
     }
 
-    // Use global header only if format container is not mp4
+    // Use global header only if format container is not mp4 (segments are
+    // always matroska)
     // see https://stackoverflow.com/questions/46444474/c-ffmpeg-create-mp4-file
     if (format_ctx->oformat->flags & AVFMT_GLOBALHEADER &&
-            strcmp(format_container, "mp4") != 0 &&
-            strcmp(format_container, "mov") != 0)
+            (segment_count > 0 || (profile.container != "mp4" && profile.container != "mov")))
         codec_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
 
     // Copy codec context back to stream parameters
@@ -128,12 +376,26 @@ void VideoEncoder::allocCodecContext()
 void VideoEncoder::writeHeader()
 {
     if (!(format_ctx->oformat->flags & AVFMT_NOFILE)) {
-        av_error = avio_open(&format_ctx->pb, video_file->fileName().toStdString().c_str(), AVIO_FLAG_WRITE);
+        av_error = video_file->openOutput(format_ctx);
         if (av_error < 0)
             return errorMsg("Failed to open file.");
     }
 
-    av_error = avformat_write_header(format_ctx, NULL);
+    AVDictionary *options = nullptr;
+    if (segment_count > 0) {
+        // Segments are remuxed into one file later on -> matroska keeps the
+        // timestamps of the recording, avi would fill the gap before the
+        // first frame of a segment
+        av_dict_set(&options, "segment_format", "matroska", 0);
+        av_dict_set_int(&options, "segment_time", segment_seconds, 0);
+        av_dict_set_int(&options, "segment_wrap", segment_count, 0);
+        av_dict_set(&options, "segment_list", segment_list.toStdString().c_str(), 0);
+        av_dict_set(&options, "segment_list_type", "flat", 0);
+        av_dict_set_int(&options, "segment_list_size", segment_count, 0);
+    }
+
+    av_error = avformat_write_header(format_ctx, &options);
+    av_dict_free(&options);
     if (av_error < 0)
         return errorMsg("Failed to write header.");
 }
@@ -144,18 +406,11 @@ void VideoEncoder::allocFrame()
     if (frame_rgb == nullptr)
         return errorMsg("Could not allocate video frame");
 
-    frame_rgb->format = pix_fmt;
+    frame_rgb->format = avPixelFormat(profile.pixel_format);
     frame_rgb->width  = width;
     frame_rgb->height = height;
 }
 
-void VideoEncoder::allocFrameBuffer(uint8_t *bits)
-{
-    // Write frame into external buffer to avoid to make an extra copy, if possible!
-    av_image_fill_arrays(frame_rgb->data, frame_rgb->linesize, bits, pix_fmt,
-                         width, height, linesize_alignment);
-}
-
 void VideoEncoder::initialize()
 {
     cleanUp();
@@ -176,12 +431,15 @@ void VideoEncoder::initialize()
 
     pkt = av_packet_alloc();
 
-    // The frame buffer is allocated externally to avoid copy
-    connect(&image, &Image::reallocate, this, &VideoEncoder::allocFrameBuffer, Qt::DirectConnection);
+    muxer.setup(format_ctx);
+    muxer.start();
 }
 
 void VideoEncoder::cleanUp()
 {
+    // Stops writing, before the format context is freed
+    muxer.abort();
+
     if (frame_rgb != nullptr)
         av_frame_free(&frame_rgb);
     image.clear();
@@ -190,44 +448,166 @@ void VideoEncoder::cleanUp()
     if (codec_ctx != nullptr)
         avcodec_free_context(&codec_ctx);
     if (format_ctx != nullptr && !(format_ctx->oformat->flags & AVFMT_NOFILE))
-        avio_close(format_ctx->pb);
+        VideoFile::closeOutput(format_ctx);
     if (format_ctx != nullptr) {
         avformat_free_context(format_ctx);
         format_ctx = nullptr;
     }
     frame_counter = 0;
+    next_pts = 0;
+    next_key_pts = 0;
+}
+
+void VideoEncoder::addFrame(const Image &img)
+{
+    addFrame(img, frame_counter);
+}
+
+void VideoEncoder::addFrame(const Image &img, int64_t index)
+{
+    if (!isOpen())
+        return;
+
+    if (index < frame_counter)
+        return errorMsg("Frame index needs to increase.");
+    frame_counter = index + 1;
+
+    encodeImage(img, streamPts(index, frame_rate));
+}
+
+void VideoEncoder::addFrame(const YuvFrame &yuv, int64_t index)
+{
+    if (!isOpen())
+        return;
+
+    if (index < frame_counter)
+        return errorMsg("Frame index needs to increase.");
+    frame_counter = index + 1;
+
+    encodeYuv(yuv, streamPts(index, frame_rate));
+}
+
+void VideoEncoder::addFrameAt(const Image &img, int64_t time_us)
+{
+    if (!isOpen())
+        return;
+
+    encodeImage(img, std::max(streamPts(time_us, 1000000), next_pts));
+}
+
+void VideoEncoder::addFrameAt(const YuvFrame &yuv, int64_t time_us)
+{
+    if (!isOpen())
+        return;
+
+    encodeYuv(yuv, std::max(streamPts(time_us, 1000000), next_pts));
 }
 
-void VideoEncoder::addFrame()
+bool VideoEncoder::isOpen()
 {
     if (format_ctx == nullptr || codec_ctx == nullptr || frame_rgb == nullptr) {
         errorMsg("Error initializing encoder");
-        return;
+        return false;
+    }
+    return true;
+}
+
+int64_t VideoEncoder::streamPts(int64_t time, int units_per_second) const
+{
+    // Frames count in the time base of the codec, packets are rescaled to the
+    // one of the stream (changed by avformat_write_header, e.g. for mp4)
+    return av_rescale_q(time, AVRational{1, units_per_second}, codec_ctx->time_base);
+}
+
+void VideoEncoder::encodeImage(const Image &img, int64_t pts)
+{
+    if (img.width() != width || img.height() != height)
+        return errorMsg("Frame size does not match the size of the video.");
+
+    // Converted on the calling thread
+    if (profile.isYuv()) {
+        yuv_frame.convertFrom(img);
+        return encodeYuv(yuv_frame, pts);
+    }
+
+    // The frame only points to the image (BGR0 has a single plane)
+    // -> libavcodec copies frames, which are not reference counted, before
+    //    avcodec_send_frame returns, so the image may be reused right after
+    frame_rgb->data[0] = const_cast<uint8_t *>(img.bits());
+    frame_rgb->linesize[0] = static_cast<int>(img.bytesPerLine());
+
+    sendFrame(pts);
+}
+
+void VideoEncoder::encodeYuv(const YuvFrame &yuv, int64_t pts)
+{
+    if (!profile.isYuv())
+        return errorMsg("YUV frames can only be encoded with a YUV profile.");
+
+    if (yuv.width() != width || yuv.height() != height)
+        return errorMsg("Frame size does not match the size of the video.");
+
+    if (yuv.layout() != profile.yuvLayout())
+        return errorMsg("Frame layout does not match the profile.");
+
+    int plane;
+    for (plane = 0; plane < 3; plane++) {
+        bool used = plane < yuv.planeCount();
+        frame_rgb->data[plane] = used ? const_cast<uint8_t *>(yuv.plane(plane)) : nullptr;
+        frame_rgb->linesize[plane] = used ? yuv.stride(plane) : 0;
     }
 
+    sendFrame(pts);
+}
+
+void VideoEncoder::sendFrame(int64_t pts)
+{
     pkt->data = nullptr;
     pkt->size = 0;
 
-    // The time_base may be changed by avformat_write_header
-    frame_rgb->pts = static_cast<int64_t>(static_cast<double>(frame_counter++) /
-                                         (static_cast<double>(frame_rate) * av_q2d(video_stream->time_base)));
+    frame_rgb->pts = pts;
+    next_pts = pts + 1;
+
+    // Segments are split at the first key frame after their duration
+    // -> a key frame is forced on every boundary
+    frame_rgb->pict_type = AV_PICTURE_TYPE_NONE;
+    if (segment_count > 0 && pts >= next_key_pts) {
+        frame_rgb->pict_type = AV_PICTURE_TYPE_I;
+
+        int64_t segment_pts = streamPts(segment_seconds, 1);
+        while (next_key_pts <= pts)
+            next_key_pts += segment_pts;
+    }
 
     // Send the frame to the encoder
     av_error = avcodec_send_frame(codec_ctx, frame_rgb);
     if (av_error < 0)
         return errorMsg("Error sending a frame for encoding.");
 
-    av_error = avcodec_receive_packet(codec_ctx, pkt);
-    if (av_error == AVERROR(EAGAIN))
-        return;
-    else if (av_error < 0)
-        return errorMsg("Error during encoding.");
+    receivePackets();
+}
 
-    av_error = av_write_frame(format_ctx, pkt);
-    if (av_error < 0)
-        return errorMsg("Error writing frame.");
+void VideoEncoder::receivePackets()
+{
+    // A frame may complete several packets (e.g. after B-frames), all of them
+    // go to the muxer right away
+    while (true) {
+        av_error = avcodec_receive_packet(codec_ctx, pkt);
+        if (av_error == AVERROR(EAGAIN) || av_error == AVERROR_EOF) {
+            av_error = 0;
+            return;
+        } else if (av_error < 0) {
+            return errorMsg("Error during encoding.");
+        }
 
-    av_packet_unref(pkt);
+        av_packet_rescale_ts(pkt, codec_ctx->time_base, video_stream->time_base);
+        pkt->stream_index = video_stream->index;
+
+        if (!muxer.push(pkt)) {
+            av_error = muxer.error();
+            return errorMsg("Error writing frame.");
+        }
+    }
 }
 
 void VideoEncoder::finish()
@@ -237,27 +617,21 @@ void VideoEncoder::finish()
         return;
     }
 
-    pkt->data = nullptr;
-    pkt->size = 0;
-
-    while (true) {
-        // Enter draining mode by sending empty buffer
-        av_error = avcodec_send_frame(codec_ctx, nullptr);
-        if (av_error < 0 && av_error != AVERROR_EOF)
-            return errorMsg("Error sending a frame encoding (flushing).");
+    // Enter draining mode by sending empty buffer
+    av_error = avcodec_send_frame(codec_ctx, nullptr);
+    if (av_error < 0 && av_error != AVERROR_EOF)
+        return errorMsg("Error sending a frame encoding (flushing).");
 
-        av_error = avcodec_receive_packet(codec_ctx, pkt);
-        if (av_error < 0) {
-            if (av_error == AVERROR_EOF)
-                break;
-            else
-                return errorMsg("Error during encoding (flushing).");
-        }
+    // Receives packets until the codec is empty
+    receivePackets();
+    if (av_error < 0)
+        return;
 
-        av_error = av_write_frame(format_ctx, pkt);
-        if (av_error < 0)
-            return errorMsg("Error writing frame (flushing).");
-        av_packet_unref(pkt);
+    // The trailer follows the last packet
+    muxer.finish();
+    if (muxer.error() < 0) {
+        av_error = muxer.error();
+        return errorMsg("Error writing frame (flushing).");
     }
 
     av_write_trailer(format_ctx);
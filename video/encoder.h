@@ -3,31 +3,199 @@
 
 #include <QObject>
 #include <QImage>
+#include <QMutex>
 #include <QString>
+#include <QThread>
+#include <QWaitCondition>
 
 #include "image/image.h"
 #include "videofile.h"
 
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+// Frame in YUV 4:2:0, as encoded by the YUV profiles
+// -> the planes lie in one buffer, rows are aligned to 32 bytes
+class YuvFrame
+{
+public:
+    enum Layout
+    {
+        I420, // planes Y, U, V
+        Nv12  // planes Y, UV (interleaved) -> the layout x264 works with internally
+    };
+
+    YuvFrame(Layout layout = I420) : _layout(layout), _width(0), _height(0), y_stride(0), uv_stride(0) {}
+
+    void resize(int width, int height);
+
+    Layout layout() const { return _layout; }
+    int width() const { return _width; }
+    int height() const { return _height; }
+
+    int planeCount() const { return _layout == Nv12 ? 2 : 3; }
+
+    uint8_t *plane(int index) { return buffer.data() + offset(index); }
+    const uint8_t *plane(int index) const { return buffer.data() + offset(index); }
+    int stride(int index) const { return index == 0 ? y_stride : uv_stride; }
+
+    // Converts a BGRA image of the same size
+    void convertFrom(const Image &img);
+
+private:
+    size_t offset(int index) const;
+
+    Layout _layout;
+    int _width;
+    int _height;
+    int y_stride;
+    int uv_stride;
+
+    std::vector<uint8_t> buffer;
+};
+
+// Writes encoded packets into the container on its own thread
+// -> disk I/O overlaps with encoding. The encoder only waits for the disk, once
+//    the queued packets exceed max_queued_bytes.
+class PacketMuxer : public QThread
+{
+public:
+    PacketMuxer(QObject *parent = nullptr);
+    ~PacketMuxer() override;
+
+    // The header must be written already
+    void setup(struct AVFormatContext *format_ctx);
+
+    // Takes the data of the packet (pkt is empty afterwards)
+    // -> returns false, if writing failed before
+    bool push(struct AVPacket *pkt);
+
+    // Writes the remaining packets and waits for the thread
+    void finish();
+
+    // Drops the remaining packets and waits for the thread
+    void abort();
+
+    // Error of av_interleaved_write_frame (0 if none)
+    int error() const { return av_error.load(); }
+
+    static const size_t max_queued_bytes = 64 << 20;
+
+protected:
+    void run() override;
+
+private:
+    void close(bool discard);
+
+    struct AVFormatContext *format_ctx;
+
+    std::deque<struct AVPacket *> packets;
+    size_t queued_bytes;
+    bool closed;
+    bool discard;
+
+    std::atomic<int> av_error;
+
+    QMutex mutex;
+    QWaitCondition not_empty;
+    QWaitCondition not_full;
+};
+
 class VideoEncoder : public QObject
 {
     Q_OBJECT
 
 public:
+    // Container and codec settings of a video
+    struct Profile
+    {
+        enum PixelFormat
+        {
+            Bgr,    // lossless with libx264rgb
+            Yuv420, // chroma subsampled, frames can be passed as YuvFrame (I420)
+            Nv12    // same with interleaved chroma (YuvFrame::Nv12)
+        };
+
+        std::string container;
+        std::string codec;
+        PixelFormat pixel_format;
+        int gop_size;     // frames between key frames (1 -> intra-only)
+        int max_b_frames;
+        std::string preset;
+        std::string tune; // empty -> no tuning
+        std::string crf;
+
+        // Frames are stamped with their capture time (mkv / mp4 only)
+        // -> the stream counts milliseconds instead of frame intervals
+        bool variable_frame_rate;
+
+        bool isYuv() const { return pixel_format != Bgr; }
+        YuvFrame::Layout yuvLayout() const { return pixel_format == Nv12 ? YuvFrame::Nv12 : YuvFrame::I420; }
+
+        // Exact copy of the screen, fast preset (default)
+        static Profile lossless();
+
+        // Keeps up with 60 - 120 fps (ultrafast, zerolatency), visually lossless
+        static Profile realtime();
+
+        // Small mp4 files, which play everywhere (slow preset, crf 23)
+        static Profile small();
+
+        // Lossless, every frame is a key frame -> seeking decodes a single frame
+        static Profile seekable();
+
+        // Lossless mkv with variable frame rate -> unchanged frames are not
+        // encoded at all, so idle screens cost next to nothing
+        static Profile vfr();
+    };
+
     VideoEncoder();
     ~VideoEncoder() { cleanUp(); }
 
-    void open(const VideoFile &video_file, int width, int height, int frame_rate);
-    void addFrame();
+    void open(const VideoFile &video_file, int width, int height, int frame_rate, const Profile &profile = Profile::lossless());
+
+    // Splits the video into matroska segments of the given duration, each
+    // starting with a key frame (call before open())
+    // -> the file name passed to open() is a pattern with %d for the segment
+    //    number, which wraps around after count segments, so that only the
+    //    last segments are kept. The list file names them, oldest first.
+    void setSegments(int count, int seconds, const QString &list_file);
+
+    // Threads of the codec, 0 lets the codec decide (call before open())
+    // -> encoders running in parallel use a single thread each
+    void setThreadCount(int count) { thread_count = count; }
+    void addFrame() { addFrame(image); }
     void finish();
 
+    // Encodes the image without copying it into the frame first
+    // -> the image must have the size passed to open(), its rows may be padded
+    void addFrame(const Image &img);
+
+    // Same, but at the given frame index (in units of 1 / frame_rate)
+    // -> indices must increase, gaps are filled by the container with
+    //    the previous frame
+    void addFrame(const Image &img, int64_t index);
+
+    // Profiles with YUV 4:2:0 only -> the frame must have the size passed to open()
+    // and the layout of the profile (images passed to the other functions are
+    // converted first)
+    void addFrame(const YuvFrame &yuv, int64_t index);
+
+    // Same, but at the given time in microseconds (profiles with variable
+    // frame rate) -> the timestamps are rounded to the time base of the
+    // stream, frames with an earlier or equal timestamp than the previous one
+    // are moved behind it
+    void addFrameAt(const Image &img, int64_t time_us);
+    void addFrameAt(const YuvFrame &yuv, int64_t time_us);
+
     Image &frame() { return image; }
 
     int av_error;
     QString last_error;
 
-private slots:
-    void allocFrameBuffer(uint8_t *bits);
-
 private:
     void allocFormatContext();
     void allocCodecContext();
@@ -37,14 +205,30 @@ private:
     void initialize();
     void cleanUp();
 
-    void encodeFrame(bool finish);
+    bool isOpen();
+    int64_t streamPts(int64_t time, int units_per_second) const;
+
+    void encodeImage(const Image &img, int64_t pts);
+    void encodeYuv(const YuvFrame &yuv, int64_t pts);
+
+    void sendFrame(int64_t pts);
+    void receivePackets();
 
     void errorMsg(const char *msg);
 
     int width;
     int height;
-    int frame_counter;
+    int64_t frame_counter;
+    int64_t next_pts;
+    int64_t next_key_pts;
     int frame_rate;
+    Profile profile;
+
+    int segment_count;
+    int segment_seconds;
+    QString segment_list;
+
+    int thread_count;
 
     struct AVOutputFormat *output_fmt;
     struct AVFormatContext *format_ctx;
@@ -56,9 +240,15 @@ private:
     struct AVFrame *frame_rgb;
     struct AVPacket *pkt;
 
+    PacketMuxer muxer;
+
     Image image;
+    YuvFrame yuv_frame;
 
     const VideoFile *video_file;
 };
 
+// Accepts "lossless", "realtime", "small", "seekable" and "vfr"
+bool profileFromName(const std::string &name, VideoEncoder::Profile &profile);
+
 #endif // VIDEO_H
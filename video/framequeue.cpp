@@ -0,0 +1,350 @@
+#include "framequeue.h"
+
+#include <QElapsedTimer>
+#include <QRunnable>
+#include <QThread>
+
+#include <lz4.h>
+
+#include <algorithm>
+#include <cstring>
+
+// Phases of a slot in memory (lower two bits of RecordedFrame::state, the
+// upper bits count the commits, so jobs of reused slots don't match anymore)
+enum SlotPhase : uint64_t
+{
+    Raw = 0,         // image holds the pixels
+    Compressing = 1, // a worker reads the image
+    Compressed = 2,  // compressed holds the pixels, the image is freed
+    Taken = 3        // the consumer reads the slot
+};
+
+static inline uint64_t slotState(uint64_t sequence, SlotPhase phase)
+{
+    return sequence << 2 | phase;
+}
+
+// Only worth the decompression, if it saves at least an eighth of the frame
+static inline bool worthCompressing(size_t compressed_size, size_t raw_size)
+{
+    return compressed_size < raw_size - raw_size / 8;
+}
+
+class CompressRunnable : public QRunnable
+{
+public:
+    CompressRunnable(FrameQueue *queue, RecordedFrame *frame, uint64_t sequence) :
+        queue(queue), frame(frame), sequence(sequence) {}
+
+    void run() override { queue->compress(frame, sequence); }
+
+private:
+    FrameQueue *queue;
+    RecordedFrame *frame;
+    uint64_t sequence;
+};
+
+FrameQueue::FrameQueue(int width, int height) :
+    width(width),
+    height(height),
+    frame_size(static_cast<size_t>((width * 4 + RecordedFrame::linesize_alignment - 1) / RecordedFrame::linesize_alignment * RecordedFrame::linesize_alignment) * static_cast<size_t>(height)),
+    frames(frame_size),
+    writing_record(false),
+    reading_record(false),
+    write_frame(nullptr),
+    read_frame(nullptr),
+    spilled(0),
+    memory_limit(0),
+    memory_used(0),
+    compression(false),
+    sequence(0),
+    producer_waiting(0)
+{
+    stats.frames = 0;
+    stats.raw_bytes = 0;
+    stats.compressed_bytes = 0;
+    stats.incompressible = 0;
+    stats.read_raw = 0;
+    stats.compress_ns = 0;
+    stats.decompress_ns = 0;
+
+    // Leaves cores for capturing and encoding
+    pool.setMaxThreadCount(std::max(1, std::min(4, QThread::idealThreadCount() / 2)));
+}
+
+void FrameQueue::resize(size_t frames, size_t spilled_frames)
+{
+    // Jobs point into the slots
+    pool.waitForDone();
+
+    this->frames.resize(frames);
+
+    spill.close();
+    if (spilled_frames > 0 && !spill.open(record_header_size + frame_size, spilled_frames))
+        fprintf(stderr, "Could not create file for spilling frames to disk\n");
+
+    spilled = 0;
+    memory_limit = static_cast<int64_t>(frames * frame_size);
+    memory_used = 0;
+}
+
+void FrameQueue::setCompression(bool enabled)
+{
+    pool.waitForDone();
+    compression = enabled;
+}
+
+FrameQueue::CompressionStatistics FrameQueue::compressionStatistics() const
+{
+    CompressionStatistics result;
+    result.frames = stats.frames;
+    result.raw_bytes = stats.raw_bytes;
+    result.compressed_bytes = stats.compressed_bytes;
+    result.incompressible = stats.incompressible;
+    result.read_raw = stats.read_raw;
+    result.compress_ns = stats.compress_ns;
+    result.decompress_ns = stats.decompress_ns;
+    return result;
+}
+
+void FrameQueue::setMemoryLimit(int64_t bytes)
+{
+    memory_limit.store(std::max(bytes, static_cast<int64_t>(frame_size)), std::memory_order_relaxed);
+}
+
+RecordedFrame *FrameQueue::wrap(RecordedFrame &frame, uint8_t *record)
+{
+    // The frame starts a cache line after the header, the rows are aligned
+    // like the ones of the images in memory
+    frame.image.assign(record + record_header_size, width, height);
+    frame.version = 0;
+    return &frame;
+}
+
+RecordedFrame *FrameQueue::acquireWrite()
+{
+    writing_record = false;
+
+    if (spill.empty() && memoryWritable()) {
+        write_frame = frames.acquireWrite();
+
+        // The buffer is allocated by the caller
+        if (write_frame->image.bits() == nullptr)
+            memory_used += static_cast<int64_t>(frame_size);
+        return write_frame;
+    }
+
+    uint8_t *record = spill.acquireWrite();
+    if (record == nullptr)
+        return nullptr;
+
+    writing_record = true;
+    return wrap(write_record, record);
+}
+
+void FrameQueue::commitWrite()
+{
+    if (!writing_record) {
+        if (!compression) {
+            frames.commitWrite();
+            return;
+        }
+
+        // Published before the job starts, so the consumer never waits for a
+        // frame, which is not compressed yet
+        sequence++;
+        write_frame->state.store(slotState(sequence, Raw), std::memory_order_release);
+        frames.commitWrite();
+
+        pool.start(new CompressRunnable(this, write_frame, sequence));
+        return;
+    }
+
+    RecordHeader header = {write_record.index, write_record.timestamp, write_record.stop_timestamp, write_record.repeat};
+    memcpy(write_record.image.scanLine(0) - record_header_size, &header, sizeof(RecordHeader));
+
+    spill.commitWrite();
+    spilled++;
+
+    // The consumer might wait for frames in memory
+    frames.wakeAll();
+}
+
+void FrameQueue::compress(RecordedFrame *frame, uint64_t sequence)
+{
+    // The consumer might have taken the frame already
+    uint64_t expected = slotState(sequence, Raw);
+    if (!frame->state.compare_exchange_strong(expected, slotState(sequence, Compressing), std::memory_order_acquire))
+        return;
+
+    QElapsedTimer elapsed_timer;
+    elapsed_timer.start();
+
+    size_t raw_size = frame->image.bytesPerLine() * static_cast<size_t>(frame->image.height());
+
+    // Each worker keeps its scratch buffer -> the stored copy has the exact size
+    static thread_local std::vector<char> scratch;
+    scratch.resize(static_cast<size_t>(LZ4_compressBound(static_cast<int>(raw_size))));
+
+    int compressed_size = LZ4_compress_default(reinterpret_cast<const char *>(frame->image.scanLine(0)),
+                                               scratch.data(),
+                                               static_cast<int>(raw_size),
+                                               static_cast<int>(scratch.size()));
+
+    if (compressed_size > 0 && worthCompressing(static_cast<size_t>(compressed_size), raw_size)) {
+        frame->compressed.assign(scratch.data(), scratch.data() + compressed_size);
+
+        // Not kept by the buffer pool, so that the memory accounting matches
+        // the memory of the process
+        frame->image.discard();
+
+        memory_used += compressed_size - static_cast<int64_t>(frame_size);
+
+        stats.frames++;
+        stats.raw_bytes += static_cast<int64_t>(raw_size);
+        stats.compressed_bytes += compressed_size;
+        stats.compress_ns += elapsed_timer.nsecsElapsed();
+
+        frame->state.store(slotState(sequence, Compressed), std::memory_order_release);
+
+        // The producer might wait for memory below the limit
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (producer_waiting.load(std::memory_order_relaxed) > 0) {
+            QMutexLocker locker(&release_mutex);
+            released.wakeAll();
+        }
+    } else {
+        stats.incompressible++;
+        stats.compress_ns += elapsed_timer.nsecsElapsed();
+
+        frame->state.store(slotState(sequence, Raw), std::memory_order_release);
+    }
+}
+
+RecordedFrame *FrameQueue::decompress(RecordedFrame *frame)
+{
+    QElapsedTimer elapsed_timer;
+    elapsed_timer.start();
+
+    // Allocated once, the encoder reads every decompressed frame from here
+    if (decompressed.image.size() != QSize(width, height))
+        decompressed.image.resize(width, height);
+
+    int size = LZ4_decompress_safe(reinterpret_cast<const char *>(frame->compressed.data()),
+                                   reinterpret_cast<char *>(decompressed.image.scanLine(0)),
+                                   static_cast<int>(frame->compressed.size()),
+                                   static_cast<int>(decompressed.image.bytesPerLine() * static_cast<size_t>(height)));
+    if (size < 0)
+        fprintf(stderr, "Could not decompress frame %lli\n", static_cast<long long>(frame->index));
+
+    decompressed.index = frame->index;
+    decompressed.timestamp = frame->timestamp;
+    decompressed.repeat = frame->repeat;
+    decompressed.stop_timestamp = frame->stop_timestamp;
+
+    stats.decompress_ns += elapsed_timer.nsecsElapsed();
+    return &decompressed;
+}
+
+RecordedFrame *FrameQueue::acquireRead()
+{
+    reading_record = false;
+
+    read_frame = frames.acquireRead();
+    if (read_frame != nullptr) {
+        if (!compression)
+            return read_frame;
+
+        while (true) {
+            uint64_t state = read_frame->state.load(std::memory_order_acquire);
+            uint64_t sequence = state >> 2;
+
+            switch (state & 3) {
+            case Raw:
+                // The job does not touch the frame anymore, once it is taken
+                if (read_frame->state.compare_exchange_weak(state, slotState(sequence, Taken), std::memory_order_acquire)) {
+                    stats.read_raw++;
+                    return read_frame;
+                }
+                break;
+            case Compressing:
+                // Takes less than a millisecond
+                QThread::yieldCurrentThread();
+                break;
+            case Compressed:
+                read_frame->state.store(slotState(sequence, Taken), std::memory_order_relaxed);
+                return decompress(read_frame);
+            default:
+                return read_frame;
+            }
+        }
+    }
+
+    uint8_t *record = spill.acquireRead();
+    if (record == nullptr)
+        return nullptr;
+
+    RecordHeader header;
+    memcpy(&header, record, sizeof(RecordHeader));
+
+    reading_record = true;
+    wrap(read_record, record);
+    read_record.index = header.index;
+    read_record.timestamp = header.timestamp;
+    read_record.repeat = header.repeat;
+    read_record.stop_timestamp = header.stop_timestamp;
+    return &read_record;
+}
+
+void FrameQueue::releaseRead()
+{
+    if (reading_record) {
+        spill.releaseRead();
+    } else {
+        if (!read_frame->compressed.empty()) {
+            memory_used -= static_cast<int64_t>(read_frame->compressed.size());
+            std::vector<uint8_t>().swap(read_frame->compressed);
+        } else if (memoryUsed() > memoryLimit() && read_frame->image.bits() != nullptr) {
+            // Gives memory back, after the limit was lowered (past the buffer pool)
+            read_frame->image.discard();
+            memory_used -= static_cast<int64_t>(frame_size);
+        }
+        frames.releaseRead();
+    }
+
+    // Pairs with the increment in waitNotFull()
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (producer_waiting.load(std::memory_order_relaxed) > 0) {
+        QMutexLocker locker(&release_mutex);
+        released.wakeAll();
+    }
+}
+
+bool FrameQueue::waitNotFull(unsigned long time)
+{
+    if (writable())
+        return true;
+
+    // Without frames in the file, only the memory is full
+    if (spill.empty() && frames.size() == frames.capacity())
+        return frames.waitNotFull(time);
+
+    QMutexLocker locker(&release_mutex);
+
+    producer_waiting++;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!writable())
+        released.wait(&release_mutex, time);
+    producer_waiting--;
+
+    return writable();
+}
+
+void FrameQueue::wakeAll()
+{
+    frames.wakeAll();
+
+    QMutexLocker locker(&release_mutex);
+    released.wakeAll();
+}
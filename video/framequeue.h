@@ -0,0 +1,205 @@
+#ifndef FRAMEQUEUE_H
+#define FRAMEQUEUE_H
+
+#include <QMutex>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+#include "image/image.h"
+#include "utils/circularqueue.hpp"
+#include "utils/spillfile.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// Slot of the frame queue
+// -> the recorder writes into the image in place, its buffer is allocated on
+//    first use and reused afterwards. Frames, in which nothing changed, only
+//    increase the repeat count of the previous slot.
+struct RecordedFrame
+{
+    RecordedFrame() : image(linesize_alignment), version(0), index(0), timestamp(0), repeat(0), stop_timestamp(-1), state(0) {}
+    RecordedFrame(const RecordedFrame &src) :
+        image(src.image), version(src.version), index(src.index), timestamp(src.timestamp), repeat(src.repeat),
+        stop_timestamp(src.stop_timestamp), compressed(src.compressed), state(src.state.load()) {}
+
+    RecordedFrame &operator=(const RecordedFrame &src)
+    {
+        image = src.image;
+        version = src.version;
+        index = src.index;
+        timestamp = src.timestamp;
+        repeat = src.repeat;
+        stop_timestamp = src.stop_timestamp;
+        compressed = src.compressed;
+        state = src.state.load();
+        return *this;
+    }
+
+    Image image;
+    uint64_t version;  // version of the capture in the image (0 if unknown, see IncrementalCapture::copyTo())
+    int64_t index;     // frame interval, in which the image was captured
+    int64_t timestamp; // capture time in microseconds since the start of the recording
+    int repeat;        // number of additional frame intervals, the image is shown
+
+    // Capture time of the last tick of the recording, only set in its last
+    // frame (otherwise -1)
+    int64_t stop_timestamp;
+
+    // With compression enabled, the image is replaced by its LZ4 compressed
+    // pixels in the background -> state tells, whether this happened already
+    std::vector<uint8_t> compressed;
+    std::atomic<uint64_t> state;
+
+    // Rows aligned like in frames allocated by FFmpeg
+    static const int linesize_alignment = 32;
+};
+
+// Frames in memory, which overflow into a file on disk, once the memory budget
+// is used up (same slot protocol as CircularQueue, one producer and one consumer)
+// -> while the file holds frames, new frames are appended to the file as well,
+//    so frames in memory are always older than the ones in the file
+class FrameQueue
+{
+public:
+    struct CompressionStatistics
+    {
+        int64_t frames = 0;           // compressed frames
+        int64_t raw_bytes = 0;        // size of the compressed frames before compression
+        int64_t compressed_bytes = 0;
+        int64_t incompressible = 0;   // frames kept raw, because they did not get smaller
+        int64_t read_raw = 0;         // frames read without decompression (incompressible or not done yet)
+        int64_t compress_ns = 0;      // CPU time of all workers
+        int64_t decompress_ns = 0;
+    };
+
+    FrameQueue(int width, int height);
+
+    // Number of frames in memory / in the file (0 disables spilling)
+    void resize(size_t frames, size_t spilled_frames = 0);
+
+    // Frames in memory are compressed with LZ4 by a small pool of threads
+    // -> the capturing thread only copies the frame, the encoder decompresses it
+    void setCompression(bool enabled);
+    CompressionStatistics compressionStatistics() const;
+
+    // Frames beyond the limit (bytes) go to the file, buffers of released
+    // frames are freed, until the limit is met
+    void setMemoryLimit(int64_t bytes);
+    inline int64_t memoryLimit() const { return memory_limit.load(std::memory_order_relaxed); }
+
+    // Bytes of the frames in memory (raw or compressed)
+    inline int64_t memoryUsed() const { return memory_used.load(std::memory_order_relaxed); }
+
+    RecordedFrame *acquireWrite();
+    void commitWrite();
+    RecordedFrame *acquireRead();
+    void releaseRead();
+
+    inline size_t size() const { return frames.size() + spill.size(); }
+    inline size_t capacity() const { return frames.capacity() + spill.capacity(); }
+
+    // Frames, which the memory budget holds (without compression) -> watermarks
+    // of the backpressure policies
+    inline size_t memoryCapacity() const
+    {
+        size_t budget = static_cast<size_t>(std::max<int64_t>(memoryLimit(), 0)) / frame_size;
+        return std::max<size_t>(1, std::min(frames.capacity(), budget));
+    }
+    inline bool empty() const { return size() == 0; }
+    inline bool full() { return !writable(); }
+
+    inline size_t spilledFrames() const { return spilled; }
+
+    // Waiting for frames in the file may take up to the given time longer
+    bool waitNotFull(unsigned long time);
+    bool waitNotEmpty(unsigned long time) { return !empty() || frames.waitNotEmpty(time) || !empty(); }
+    void wakeAll();
+
+    size_t frameSize() const { return frame_size; }
+
+private:
+    friend class CompressRunnable;
+
+    // Records in the file start with the index / timestamps / repeat count of the frame
+    struct RecordHeader
+    {
+        int64_t index;
+        int64_t timestamp;
+        int64_t stop_timestamp;
+        int32_t repeat;
+    };
+
+    static const size_t record_header_size = 64;
+
+    RecordedFrame *wrap(RecordedFrame &frame, uint8_t *record);
+
+    void compress(RecordedFrame *frame, uint64_t sequence);
+    RecordedFrame *decompress(RecordedFrame *frame);
+
+    // The next slot keeps its buffer or a new buffer fits into the limit
+    // -> only called by the producer, the slot is not handed out yet
+    inline bool memoryWritable()
+    {
+        RecordedFrame *frame = frames.acquireWrite();
+        return frame != nullptr && (frame->image.bits() != nullptr || memoryUsed() + static_cast<int64_t>(frame_size) <= memoryLimit());
+    }
+
+    // True, if acquireWrite() finds a free slot
+    inline bool writable()
+    {
+        bool file_writable = spill.size() < spill.capacity();
+        return spill.empty() ? memoryWritable() || file_writable : file_writable;
+    }
+
+    int width;
+    int height;
+    size_t frame_size;
+
+    CircularQueue<RecordedFrame> frames;
+    SpillFile spill;
+
+    // Images of these point into the records of the file
+    RecordedFrame write_record;
+    RecordedFrame read_record;
+    bool writing_record;
+    bool reading_record;
+
+    RecordedFrame *write_frame;
+    RecordedFrame *read_frame;
+
+    // Target of decompressed frames
+    RecordedFrame decompressed;
+
+    size_t spilled;
+
+    std::atomic<int64_t> memory_limit;
+    std::atomic<int64_t> memory_used;
+
+    bool compression;
+    uint64_t sequence;
+
+    struct
+    {
+        std::atomic<int64_t> frames;
+        std::atomic<int64_t> raw_bytes;
+        std::atomic<int64_t> compressed_bytes;
+        std::atomic<int64_t> incompressible;
+        std::atomic<int64_t> read_raw;
+        std::atomic<int64_t> compress_ns;
+        std::atomic<int64_t> decompress_ns;
+    } stats;
+
+    // Signals released frames, if the producer waits for the file or for
+    // memory below the limit
+    std::atomic<int> producer_waiting;
+    QMutex release_mutex;
+    QWaitCondition released;
+
+    // Declared last -> waits for running jobs, before the frames are destroyed
+    QThreadPool pool;
+};
+
+#endif // FRAMEQUEUE_H
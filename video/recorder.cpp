@@ -1,101 +1,364 @@
 #include "recorder.h"
 
 #include "image/image.h"
+#include "image/incrementalcapture.h"
+#include "utils/framepacer.h"
 #include "utils/memoryusage.h"
 
+#include <QDir>
+#include <QStorageInfo>
+
 #include <iostream>
 
 #ifdef __APPLE__
 #define _RETINA_DISPLAY_
 #endif
 
-FrameQueue::FrameQueue(int width, int height, int linesize_alignment) :
-    CircularQueue<Image>(((width * 4 + linesize_alignment - 1) / linesize_alignment * linesize_alignment) * height)
+// Memory (MB), which is left for the system and other processes
+static const int memory_reserve = 600;
+
+// The memory limit never drops below this number of frames
+static const size_t min_memory_frames = 8;
+
+// Higher frame rates are recorded with the real-time profile by default
+static const int max_lossless_frame_rate = 30;
+
+// Converted frames waiting for the encoder (they are small compared to the frame
+// queue, it only evens out the time of conversion and encoding)
+static const size_t converted_queue_size = 8;
+
+bool policyFromName(const std::string &name, BackpressurePolicy &policy)
 {
+    if (name == "block")
+        policy = Block;
+    else if (name == "drop-newest")
+        policy = DropNewest;
+    else if (name == "drop-oldest")
+        policy = DropOldest;
+    else if (name == "adaptive")
+        policy = Adaptive;
+    else
+        return false;
+    return true;
+}
+
+// With DropOldest, frames are skipped, while the memory of the queue is almost
+// full (frames in the file only wait for the memory to become free)
+static bool aboveHighWatermark(FrameQueue *queue)
+{
+    size_t capacity = queue->memoryCapacity();
+    size_t high_watermark = capacity - std::max<size_t>(1, capacity / 8);
+    return queue->size() >= high_watermark && queue->size() > 1;
+}
+
+// Releases the oldest frame without reading it -> false, if it could not be
+// read from the queue
+static bool dropOldest(FrameQueue *queue)
+{
+    if (queue->acquireRead() == nullptr) {
+        fprintf(stderr, "Could not read a frame from the queue\n");
+        return false;
+    }
+    queue->releaseRead();
+    return true;
 }
 
 RecorderThread::RecorderThread(QObject *parent)
     : QThread(parent),
-      queue(nullptr)
+      queue(nullptr),
+      sampler(nullptr),
+      last_sample(0),
+      policy(Block)
 {
 }
 
-void RecorderThread::setup(FrameQueue *queue, const QRect &rect, int frame_rate)
+void RecorderThread::setup(FrameQueue *queue, const QRect &rect, int frame_rate, BackpressurePolicy policy, const MemorySampler *sampler)
 {
     this->queue = queue;
     screen_rect = rect;
     this->frame_rate = frame_rate;
+    this->policy = policy;
+    this->sampler = sampler;
 }
 
-void RecorderThread::run()
+void RecorderThread::adjustMemoryLimit()
 {
-    setPriority(QThread::HighestPriority);
+    if (sampler == nullptr || sampler->samples() == last_sample)
+        return;
 
-    int captured = 0;
-    qint64 interval;
-    quit = false;
+    last_sample = sampler->samples();
 
+    // The frames, which are allocated already, are not part of the unused memory
+    int64_t spare = static_cast<int64_t>(sampler->unused() - memory_reserve) * 1024 * 1024;
+    int64_t min_bytes = static_cast<int64_t>(min_memory_frames * queue->frameSize());
+
+    queue->setMemoryLimit(std::max(min_bytes, queue->memoryUsed() + spare));
+}
+
+RecordedFrame *RecorderThread::acquireSlot()
+{
+    RecordedFrame *slot = queue->acquireWrite();
+    if (slot != nullptr || policy == DropNewest || policy == Adaptive)
+        return slot;
+
+    // Block until the encoder frees a slot, but keep checking for stop()
+    // -> with DropOldest, the encoder drops frames to catch up, so this only
+    //    lasts until it finished the frame it is working on
+    QElapsedTimer elapsed_timer;
     elapsed_timer.start();
 
-    Image img(0);
+    while ((slot = queue->acquireWrite()) == nullptr) {
+        if (queue->waitNotFull(100))
+            continue;
+
+        QMutexLocker locker(&mutex);
+        if (quit)
+            break;
+    }
+
+    blocked_ms += elapsed_timer.elapsed();
+    return slot;
+}
+
+void RecorderThread::run()
+{
+    setPriority(QThread::HighestPriority);
+
+    quit = false;
+    queued = 0;
+    dropped = 0;
+    reduced = 0;
+    blocked_ms = 0;
+
+    // Only changed tiles are copied into the frame of the capture, and from
+    // there into the slots (which still hold an earlier frame)
+    // -> the first capture arms the buffers (e.g. the shared memory segment),
+    //    before the first deadline
+    IncrementalCapture capture(screen_rect);
+    capture.capture();
+
+    // Slot, which was written last, but is not committed yet
+    // -> it stays writable, so that following unchanged frames only increase
+    //    its repeat count
+    RecordedFrame *pending = nullptr;
+
+    // The content of a dropped frame is not in the queue
+    // -> the next capture is queued, even if it did not change (the same
+    //    applies to the first frame, the warm-up capture is not queued)
+    bool missing = true;
+
+    // Deadlines per capture (only changed by the adaptive policy)
+    int step = 1;
+
+    // Capture time of the last tick -> the end of the recording
+    int64_t last_tick = 0;
+
+    // Frames are captured on absolute deadlines -> the thread sleeps in between
+    FramePacer pacer(frame_rate);
+    pacer.start();
 
     mutex.lock();
     while (!quit) {
         mutex.unlock();
 
-        qint64 t_before_capturing = elapsed_timer.elapsed();
-        fprintf(stderr, "Timer at %llums before capturing\n", elapsed_timer.elapsed());
-        img.captureRect(screen_rect);
+        // Time, at which the screen is read (after waking up on the deadline)
+        int64_t timestamp = pacer.elapsedUs();
+        last_tick = timestamp;
+
+        // If capturing fails, the previous frame is repeated
+        bool changed = capture.capture() && (!capture.unchanged() || missing);
+
+        if (changed) {
+            if (pending != nullptr)
+                queue->commitWrite();
+
+            pending = acquireSlot();
+
+            if (pending != nullptr) {
+                capture.copyTo(pending->image, pending->version);
+                pending->index = pacer.frameIndex();
+                pending->timestamp = timestamp;
+                pending->repeat = 0;
+                pending->stop_timestamp = -1;
+                queued++;
+            } else {
+                // The timestamps of the following frames keep the gap
+                dropped++;
+            }
+            missing = pending == nullptr;
+        } else if (pending != nullptr) {
+            pending->repeat++;
+        }
+
+        // Follow the free memory, e.g. when other processes need more
+        adjustMemoryLimit();
+
+        if (policy == Adaptive) {
+            // Halve the capture rate, while the memory of the queue is more
+            // than half full, and go back to the full rate, once the encoder
+            // caught up
+            size_t fill = queue->size() * 8;
+            size_t capacity = queue->memoryCapacity();
+            if (fill > capacity * 4 && step < 8)
+                step *= 2;
+            else if (fill < capacity && step > 1)
+                step /= 2;
+        }
+
+        int passed = 0;
+        int index;
+        for (index = 0; index < step; index++)
+            passed += pacer.waitForNextFrame();
+        reduced += step - 1;
+
+        // Deadlines, which were missed entirely, repeat the frame, so that the
+        // duration of the video matches the recorded time
+        if (pending != nullptr)
+            pending->repeat += passed - 1;
+
+        mutex.lock();
+    }
+    mutex.unlock();
+
+    if (pending != nullptr) {
+        pending->stop_timestamp = last_tick;
+        queue->commitWrite();
+    }
+
+    const FramePacer::Statistics &stats = pacer.statistics();
+    fprintf(stderr, "Recording done after %llims: %lli frames, %lli late, %lli skipped, jitter mean %.3fms max %.3fms\n",
+            static_cast<long long>(pacer.elapsedMs()),
+            static_cast<long long>(stats.frames),
+            static_cast<long long>(stats.late),
+            static_cast<long long>(stats.skipped),
+            stats.mean_jitter,
+            stats.max_jitter);
+
+    emit finished();
+}
+
+void RecorderThread::stop()
+{
+    QMutexLocker locker(&mutex);
+
+    quit = true;
+    queue->wakeAll();
+}
+
+ConverterThread::ConverterThread(QObject *parent) :
+    QThread(parent),
+    queue(nullptr),
+    converted_queue(nullptr),
+    policy(Block),
+    layout(YuvFrame::I420)
+{
+}
+
+void ConverterThread::setup(FrameQueue *queue, ConvertedQueue *converted_queue, BackpressurePolicy policy, YuvFrame::Layout layout)
+{
+    this->queue = queue;
+    this->converted_queue = converted_queue;
+    this->policy = policy;
+    this->layout = layout;
+}
+
+void ConverterThread::run()
+{
+    setPriority(QThread::HighestPriority);
+
+    int converted = 0;
+    quit = false;
+    dropped = 0;
+    convert_ms = 0;
+
+    QElapsedTimer elapsed_timer;
+
+    mutex.lock();
+    while (true) {
+        while (queue->empty() && !quit) {
+            mutex.unlock();
+            queue->waitNotEmpty(100);
+            mutex.lock();
+        }
 
-        // This loop keeps the focus in this thread
-        // -> It works, but it should be improved!
-        // -> Unfortunately, sleep does not guarantee to return in a specified timeframe
-        //    which makes it impossible to record the screen with a certain framerate
-        fprintf(stderr, "Check if queue is full...\n");
-        while (queue->full()) {}
+        if (queue->empty() && quit)
+            break;
+        mutex.unlock();
 
-        fprintf(stderr, "Pushing image to queue...\n");
-        queue->push(img);
-        fprintf(stderr, "Timer at %llums after capturing (it took %llums)\n", elapsed_timer.elapsed(), elapsed_timer.elapsed() - t_before_capturing);
-        captured++;
+        if (policy == DropOldest && converted > 0 && aboveHighWatermark(queue)) {
+            // The previous frame is shown instead (gap in the timestamps)
+            if (!dropOldest(queue)) {
+                mutex.lock();
+                break;
+            }
+            dropped++;
 
-        // Determine time till next frame should be captured
-        interval = captured * 1000 / frame_rate - elapsed_timer.elapsed();
+            mutex.lock();
+            continue;
+        }
 
-        fprintf(stderr, "Calculated interval to next is: %llims\n", interval);
+        // The encoder runs until this thread finished -> it frees a slot
+        ConvertedFrame *slot;
+        while ((slot = converted_queue->acquireWrite()) == nullptr)
+            converted_queue->waitNotFull(100);
 
-        // Same awful thing as above!!
-        while (interval > 0) {
-            interval = captured * 1000 / frame_rate - elapsed_timer.elapsed();
+        RecordedFrame *frame = queue->acquireRead();
+        if (frame == nullptr) {
+            fprintf(stderr, "Could not read a frame from the queue, conversion stops\n");
+            mutex.lock();
+            break;
         }
 
-        fprintf(stderr, "---------------------------------------------------------------------------\n");
+        // The SIMD kernels convert large frames in bands of rows in parallel
+        if (slot->frame.layout() != layout)
+            slot->frame = YuvFrame(layout);
+
+        elapsed_timer.start();
+        slot->frame.convertFrom(frame->image);
+        convert_ms += elapsed_timer.elapsed();
+
+        slot->index = frame->index;
+        slot->timestamp = frame->timestamp;
+        slot->repeat = frame->repeat;
+        slot->stop_timestamp = frame->stop_timestamp;
+        converted++;
+
+        queue->releaseRead();
+        converted_queue->commitWrite();
 
         mutex.lock();
     }
     mutex.unlock();
 
-    fprintf(stderr, "Recording done...\n");
-
     emit finished();
 }
 
-void RecorderThread::stop()
+void ConverterThread::stop()
 {
     QMutexLocker locker(&mutex);
 
     quit = true;
+    queue->wakeAll();
 }
 
 EncoderThread::EncoderThread(QObject *parent) :
     QThread(parent),
-    queue(nullptr)
+    queue(nullptr),
+    converted_queue(nullptr),
+    policy(Block),
+    frame_rate(0),
+    variable_frame_rate(false)
 {
 }
 
-void EncoderThread::setup(FrameQueue *queue, const VideoFile &video_file, const QRect &rect, int frame_rate)
+void EncoderThread::setup(FrameQueue *queue, const VideoFile &video_file, const QRect &rect, int frame_rate, BackpressurePolicy policy,
+                          const VideoEncoder::Profile &profile, ConvertedQueue *converted_queue)
 {
     this->queue = queue;
+    this->converted_queue = converted_queue;
+    this->policy = policy;
+    this->frame_rate = frame_rate;
+    this->variable_frame_rate = profile.variable_frame_rate;
 
     int width = rect.width();
     int height = rect.height();
@@ -106,29 +369,38 @@ void EncoderThread::setup(FrameQueue *queue, const VideoFile &video_file, const
     height *= 2;
 #endif
 
-    encoder.open(video_file, width, height, frame_rate);
+    encoder.open(video_file, width, height, frame_rate, profile);
 }
 
 void EncoderThread::run()
 {
     setPriority(QThread::HighestPriority);
 
-    int captured = 0;
     quit = false;
+    dropped = 0;
 
-    QElapsedTimer elapsed_timer;
-    elapsed_timer.start();
+    if (converted_queue != nullptr)
+        encodeConvertedFrames();
+    else
+        encodeFrames();
+
+    fprintf(stderr, "Encoding done, flushing...\n");
+
+    encoder.finish();
+
+    emit finished();
+}
+
+void EncoderThread::encodeFrames()
+{
+    int captured = 0;
 
     mutex.lock();
     while (true) {
-        fprintf(stderr, "Checking if queue is empty...\n");
-
         while (queue->empty() && !quit) {
             mutex.unlock();
-            // No problem going to sleep, even if the accuracy
-            // cannot be guaranteed, because the frames are stacked
-            // up in the queue
-            QThread::msleep(1);
+            // Woken up by the next push (or stop())
+            queue->waitNotEmpty(100);
             mutex.lock();
         }
 
@@ -136,25 +408,76 @@ void EncoderThread::run()
             break;
         mutex.unlock();
 
-        fprintf(stderr, "Queue is not empty, has %zu elements -> popping image...\n", queue->size());
+        if (policy == DropOldest && captured > 0 && aboveHighWatermark(queue)) {
+            // The previous frame is shown instead (gap in the timestamps)
+            if (!dropOldest(queue)) {
+                mutex.lock();
+                break;
+            }
+            dropped++;
 
-        qint64 t_before_encoding = elapsed_timer.elapsed();
-        fprintf(stderr, "Timer at %llums before encoding\n", elapsed_timer.elapsed());
+            mutex.lock();
+            continue;
+        }
 
-        queue->pop(encoder.frame());
-        encoder.addFrame();
-        fprintf(stderr, "Timer at %llums after encoding (it took %llums)\n", elapsed_timer.elapsed(), elapsed_timer.elapsed() - t_before_encoding);
-        captured++;
+        // The image is encoded straight from the slot
+        RecordedFrame *frame = queue->acquireRead();
+        if (frame == nullptr) {
+            fprintf(stderr, "Could not read a frame from the queue, encoding stops\n");
+            mutex.lock();
+            break;
+        }
+
+        encodeSlot(frame->image, frame->index, frame->timestamp, frame->repeat, frame->stop_timestamp);
+        captured += frame->repeat + 1;
+        queue->releaseRead();
 
         mutex.lock();
     }
     mutex.unlock();
+}
 
-    fprintf(stderr, "Encoding done, flushing...\n");
+void EncoderThread::encodeConvertedFrames()
+{
+    mutex.lock();
+    while (true) {
+        while (converted_queue->empty() && !quit) {
+            mutex.unlock();
+            converted_queue->waitNotEmpty(100);
+            mutex.lock();
+        }
 
-    encoder.finish();
+        // Only stopped after the converter finished
+        if (converted_queue->empty() && quit)
+            break;
+        mutex.unlock();
 
-    emit finished();
+        ConvertedFrame *frame = converted_queue->acquireRead();
+        encodeSlot(frame->frame, frame->index, frame->timestamp, frame->repeat, frame->stop_timestamp);
+        converted_queue->releaseRead();
+
+        mutex.lock();
+    }
+    mutex.unlock();
+}
+
+template <typename Frame>
+void EncoderThread::encodeSlot(const Frame &frame, int64_t index, int64_t timestamp, int repeat, int64_t stop_timestamp)
+{
+    if (!variable_frame_rate) {
+        // Every interval needs a frame
+        int offset;
+        for (offset = 0; offset <= repeat; offset++)
+            encoder.addFrame(frame, index + offset);
+        return;
+    }
+
+    // The frame is shown until the timestamp of the next one -> repeats are
+    // skipped, only the last frame of the recording is encoded once more at
+    // the last tick, so that a still screen at the end keeps its duration
+    encoder.addFrameAt(frame, timestamp);
+    if (stop_timestamp > timestamp)
+        encoder.addFrameAt(frame, stop_timestamp);
 }
 
 void EncoderThread::stop()
@@ -162,16 +485,33 @@ void EncoderThread::stop()
     QMutexLocker locker(&mutex);
 
     quit = true;
+    queue->wakeAll();
+    if (converted_queue != nullptr)
+        converted_queue->wakeAll();
 }
 
-ScreenRecorder::ScreenRecorder()
+ScreenRecorder::ScreenRecorder() :
+    frame_queue(nullptr),
+    converted_queue(nullptr)
 {
     connect(&hotkey, &QHotkey::activated, &recorder_thread, &RecorderThread::stop);
-    connect(&recorder_thread, &RecorderThread::finished, &encoder_thread, &EncoderThread::stop);
     connect(&encoder_thread, &EncoderThread::finished, &loop, &QEventLoop::quit);
 }
 
-void ScreenRecorder::exec(const VideoFile &video_file, QRect rect, int frame_rate, QString hotkeySequence)
+VideoEncoder::Profile ScreenRecorder::defaultProfile(int frame_rate)
+{
+    return frame_rate > max_lossless_frame_rate ? VideoEncoder::Profile::realtime() : VideoEncoder::Profile::lossless();
+}
+
+void ScreenRecorder::execRing(const SegmentRing &ring, QRect rect, int frame_rate, const VideoEncoder::Profile &profile,
+                              BackpressurePolicy policy, bool compress, QString hotkeySequence)
+{
+    encoder_thread.setSegments(ring);
+    exec(ring.pattern(), rect, frame_rate, profile, policy, compress, hotkeySequence);
+}
+
+void ScreenRecorder::exec(const VideoFile &video_file, QRect rect, int frame_rate, const VideoEncoder::Profile &profile,
+                          BackpressurePolicy policy, bool compress, QString hotkeySequence)
 {
     // Width / height need to be aligned by a factor of 2 for video encoding
     rect.setSize(QSize(rect.width() & 0xfffe, rect.height() & 0xfffe));
@@ -182,22 +522,61 @@ void ScreenRecorder::exec(const VideoFile &video_file, QRect rect, int frame_rat
 
     MemoryUsage usage_stats;
     usage_stats.retrieveInfo();
-    int max_buffer_size = std::max(0, usage_stats.unused() - 600);
+    int max_buffer_size = std::max(0, usage_stats.unused() - memory_reserve);
 
-    frame_queue = new FrameQueue(rect.width(), rect.height(), 32);
+    frame_queue = new FrameQueue(rect.width(), rect.height());
     fprintf(stderr, "The frame size is: %zu bytes\n", frame_queue->frameSize());
     fprintf(stderr, "The remaining RAM size is: %d MB\n", usage_stats.unused());
     int queue_size = std::max(50, (max_buffer_size * 1024) / (static_cast<int>(frame_queue->frameSize()) / 1024));
     fprintf(stderr, "The queue size is: %d\n", queue_size);
-    frame_queue->resize(queue_size);
+
+    // The queue can grow up to the total memory, while memory is freed by
+    // other processes -> the memory limit follows the samples during recording
+    // -> compressed frames take a fraction of the memory, so the same memory
+    //    holds more slots (empty slots cost no memory)
+    size_t max_queue_size = static_cast<size_t>(usage_stats.total()) * 1024 * 1024 / frame_queue->frameSize();
+    if (compress)
+        max_queue_size *= 8;
+    max_queue_size = std::max(static_cast<size_t>(queue_size), std::min<size_t>(max_queue_size, 10000));
+
+    // Frames, which do not fit into memory anymore, go to the disk
+    // -> a few GB of the disk are left untouched
+    QStorageInfo storage(QDir::tempPath());
+    qint64 max_spill_size = std::max<qint64>(0, storage.bytesAvailable() - (static_cast<qint64>(2) << 30));
+    size_t spill_size = static_cast<size_t>(max_spill_size) / (frame_queue->frameSize() + 4096);
+    fprintf(stderr, "Up to %zu frames can be spilled to disk\n", spill_size);
+
+    frame_queue->resize(max_queue_size, spill_size);
+    frame_queue->setMemoryLimit(static_cast<int64_t>(queue_size) * static_cast<int64_t>(frame_queue->frameSize()));
+    frame_queue->setCompression(compress);
+
+    // YUV profiles are recorded in a pipeline of three threads
+    // -> capture, YUV conversion and encoding of consecutive frames overlap
+    bool pipelined = profile.isYuv();
+    if (pipelined) {
+        fprintf(stderr, "Recording in YUV 4:2:0 with preset %s\n", profile.preset.c_str());
+
+        converted_queue = new ConvertedQueue(frame_queue->frameSize() * 3 / 8);
+        converted_queue->resize(converted_queue_size);
+
+        connect(&recorder_thread, &RecorderThread::finished, &converter_thread, &ConverterThread::stop);
+        connect(&converter_thread, &ConverterThread::finished, &encoder_thread, &EncoderThread::stop);
+    } else {
+        connect(&recorder_thread, &RecorderThread::finished, &encoder_thread, &EncoderThread::stop);
+    }
 
     // Prepare recording
     hotkey.setShortcut(hotkeySequence);
-    recorder_thread.setup(frame_queue, rect, frame_rate);
-    encoder_thread.setup(frame_queue, video_file, rect, frame_rate);
+    recorder_thread.setup(frame_queue, rect, frame_rate, policy, &memory_sampler);
+    if (pipelined)
+        converter_thread.setup(frame_queue, converted_queue, policy, profile.yuvLayout());
+    encoder_thread.setup(frame_queue, video_file, rect, frame_rate, policy, profile, converted_queue);
 
     // Start recorder thread and register hotkey to stop thread
+    memory_sampler.start();
     recorder_thread.start();
+    if (pipelined)
+        converter_thread.start();
     encoder_thread.start();
     hotkey.setRegistered(true);
 
@@ -205,8 +584,41 @@ void ScreenRecorder::exec(const VideoFile &video_file, QRect rect, int frame_rat
 
     hotkey.setRegistered(false);
 
+    // The encoder also finishes, if it cannot read the queue anymore
+    recorder_thread.stop();
+
     recorder_thread.wait();
+    converter_thread.wait();
     encoder_thread.wait();
 
+    memory_sampler.stop();
+    memory_sampler.wait();
+
+    fprintf(stderr, "%lli frames queued (%zu spilled to disk), %lli dropped (newest), %lli dropped (oldest), %lli not captured (adaptive), blocked for %llims\n",
+            static_cast<long long>(recorder_thread.queuedFrames()),
+            frame_queue->spilledFrames(),
+            static_cast<long long>(recorder_thread.droppedFrames()),
+            static_cast<long long>(encoder_thread.droppedFrames() + (pipelined ? converter_thread.droppedFrames() : 0)),
+            static_cast<long long>(recorder_thread.reducedFrames()),
+            static_cast<long long>(recorder_thread.blockedMs()));
+
+    if (compress) {
+        FrameQueue::CompressionStatistics stats = frame_queue->compressionStatistics();
+        fprintf(stderr, "%lli frames compressed to %.1f%% (%lli incompressible, %lli read raw), compression took %llims, decompression %llims\n",
+                static_cast<long long>(stats.frames),
+                stats.raw_bytes > 0 ? 100.0 * static_cast<double>(stats.compressed_bytes) / static_cast<double>(stats.raw_bytes) : 0.0,
+                static_cast<long long>(stats.incompressible),
+                static_cast<long long>(stats.read_raw),
+                static_cast<long long>(stats.compress_ns / 1000000),
+                static_cast<long long>(stats.decompress_ns / 1000000));
+    }
+
+    if (pipelined)
+        fprintf(stderr, "Conversion to YUV took %llims\n", static_cast<long long>(converter_thread.convertMs()));
+
+    delete converted_queue;
+    converted_queue = nullptr;
+
     delete frame_queue;
+    frame_queue = nullptr;
 }
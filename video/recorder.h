@@ -8,21 +8,41 @@
 #include <QMutex>
 
 #include "image/image.h"
-#include "utils/circularqueue.hpp"
+#include "utils/memorysampler.h"
 #include "encoder.h"
+#include "framequeue.h"
+#include "segmentring.h"
 
+#include <string>
 #include <vector>
 
 #include "qhotkey.h"
 
-class FrameQueue : public CircularQueue<Image>
+// What the recorder does, when the encoder falls behind and the queue is full
+enum BackpressurePolicy
 {
-public:
-    FrameQueue(int width, int height, int linesize_alignment);
+    Block,      // wait for a free slot, the waiting time is filled with the previous frame
+    DropNewest, // skip the new frame
+    DropOldest, // the encoder skips the oldest frames, before the queue runs full
+    Adaptive    // capture less often while the queue fills up, skip frames if still full
+};
+
+bool policyFromName(const std::string &name, BackpressurePolicy &policy);
 
-    size_t frameSize() const { return obj_size; }
+// Slot of the queue between converter and encoder (YUV profiles)
+struct ConvertedFrame
+{
+    ConvertedFrame() : index(0), timestamp(0), repeat(0), stop_timestamp(-1) {}
+
+    YuvFrame frame;
+    int64_t index;
+    int64_t timestamp;
+    int repeat;
+    int64_t stop_timestamp;
 };
 
+typedef CircularQueue<ConvertedFrame> ConvertedQueue;
+
 class RecorderThread : public QThread
 {
     Q_OBJECT
@@ -30,7 +50,13 @@ class RecorderThread : public QThread
 public:
     RecorderThread(QObject *parent = nullptr);
 
-    void setup(FrameQueue *queue, const QRect &rect, int frame_rate);
+    void setup(FrameQueue *queue, const QRect &rect, int frame_rate, BackpressurePolicy policy, const MemorySampler *sampler = nullptr);
+
+    // Valid after the thread finished
+    int64_t queuedFrames() const { return queued; }
+    int64_t droppedFrames() const { return dropped; }
+    int64_t reducedFrames() const { return reduced; }
+    int64_t blockedMs() const { return blocked_ms; }
 
 public slots:
     void stop();
@@ -42,14 +68,63 @@ protected:
     void run() override;
 
 private:
+    RecordedFrame *acquireSlot();
+    void adjustMemoryLimit();
+
     FrameQueue *queue;
+    const MemorySampler *sampler;
+    int last_sample;
     QRect screen_rect;
     int frame_rate;
+    BackpressurePolicy policy;
+
+    int64_t queued;
+    int64_t dropped;
+    int64_t reduced;
+    int64_t blocked_ms;
+
+    bool quit;
+
+    QMutex mutex;
+};
+
+// Converts the captured frames to YUV for the encoder (YUV profiles)
+// -> takes the conversion off the encoder thread, so capturing, converting
+//    and encoding of consecutive frames overlap
+class ConverterThread : public QThread
+{
+    Q_OBJECT
+
+public:
+    ConverterThread(QObject *parent = nullptr);
+
+    void setup(FrameQueue *queue, ConvertedQueue *converted_queue, BackpressurePolicy policy, YuvFrame::Layout layout);
+
+    // Valid after the thread finished
+    int64_t droppedFrames() const { return dropped; }
+    int64_t convertMs() const { return convert_ms; }
+
+public slots:
+    void stop();
+
+signals:
+    void finished();
+
+protected:
+    void run() override;
+
+private:
+    FrameQueue *queue;
+    ConvertedQueue *converted_queue;
+    BackpressurePolicy policy;
+    YuvFrame::Layout layout;
+
+    int64_t dropped;
+    int64_t convert_ms;
 
     bool quit;
 
     QMutex mutex;
-    QElapsedTimer elapsed_timer;
 };
 
 class EncoderThread : public QThread
@@ -59,7 +134,16 @@ class EncoderThread : public QThread
 public:
     EncoderThread(QObject *parent = nullptr);
 
-    void setup(FrameQueue *queue, const VideoFile &video_file, const QRect &rect, int frame_rate);
+    // With a converted queue, the frames are read from there (the profile
+    // needs to be a YUV profile), otherwise they are read from the frame queue
+    void setup(FrameQueue *queue, const VideoFile &video_file, const QRect &rect, int frame_rate, BackpressurePolicy policy,
+               const VideoEncoder::Profile &profile, ConvertedQueue *converted_queue = nullptr);
+
+    // Writes the segments of the ring instead of a single file (call before setup())
+    void setSegments(const SegmentRing &ring) { encoder.setSegments(ring.count(), ring.seconds(), ring.listFileName()); }
+
+    // Valid after the thread finished
+    int64_t droppedFrames() const { return dropped; }
 
 public slots:
     void stop();
@@ -71,8 +155,21 @@ protected:
     void run() override;
 
 private:
+    void encodeFrames();
+    void encodeConvertedFrames();
+
+    // Encodes the frame for its interval and the repeated intervals
+    template <typename Frame>
+    void encodeSlot(const Frame &frame, int64_t index, int64_t timestamp, int repeat, int64_t stop_timestamp);
+
     FrameQueue *queue;
+    ConvertedQueue *converted_queue;
     VideoEncoder encoder;
+    BackpressurePolicy policy;
+    int frame_rate;
+    bool variable_frame_rate;
+
+    int64_t dropped;
 
     bool quit;
 
@@ -86,13 +183,25 @@ class ScreenRecorder : public QObject
 public:
     ScreenRecorder();
 
-    void exec(const VideoFile &video_file, QRect rect, int frame_rate, QString hotkeySequence = "Ctrl+.");
+    void exec(const VideoFile &video_file, QRect rect, int frame_rate, const VideoEncoder::Profile &profile,
+              BackpressurePolicy policy = Block, bool compress = false, QString hotkeySequence = "Ctrl+.");
+
+    // Rolling recording -> only the last segments of the ring are kept
+    void execRing(const SegmentRing &ring, QRect rect, int frame_rate, const VideoEncoder::Profile &profile,
+                  BackpressurePolicy policy = Block, bool compress = false, QString hotkeySequence = "Ctrl+.");
+
+    // Lossless up to 30 fps, real-time above
+    static VideoEncoder::Profile defaultProfile(int frame_rate);
 
 private:
     FrameQueue *frame_queue;
+    ConvertedQueue *converted_queue;
     RecorderThread recorder_thread;
+    ConverterThread converter_thread;
     EncoderThread encoder_thread;
 
+    MemorySampler memory_sampler;
+
     QHotkey hotkey;
     QEventLoop loop;
 };
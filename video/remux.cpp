@@ -0,0 +1,494 @@
+#include "remux.h"
+
+#include "decoder.h"
+#include "encoder.h"
+#include "transcode.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+extern "C"
+{
+#include "libavcodec/avcodec.h"
+#include "libavformat/avformat.h"
+}
+
+static const AVRational microseconds = {1, 1000000};
+
+// Opens the video and returns the index of its video stream (< 0 on errors)
+static int openInput(const VideoFile &video, AVFormatContext *&input_ctx, QString &error)
+{
+    char ch[AV_ERROR_MAX_STRING_SIZE] = {0};
+
+    input_ctx = nullptr;
+    int av_error = video.openInput(&input_ctx);
+    if (av_error < 0) {
+        error = QString("Could not open video: %1").arg(av_make_error_string(ch, AV_ERROR_MAX_STRING_SIZE, av_error));
+        return av_error;
+    }
+
+    // Matroska stores no dts -> the muxer derives it from the reorder delay
+    // of the stream, which is only known after probing
+    av_error = avformat_find_stream_info(input_ctx, nullptr);
+    if (av_error < 0) {
+        error = QString("Could not find stream information: %1").arg(av_make_error_string(ch, AV_ERROR_MAX_STRING_SIZE, av_error));
+        VideoFile::closeInput(&input_ctx);
+        return av_error;
+    }
+
+    int stream_index = av_find_best_stream(input_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (stream_index < 0) {
+        error = "Video has no video stream";
+        VideoFile::closeInput(&input_ctx);
+    }
+
+    return stream_index;
+}
+
+static bool sameExtradata(const AVCodecParameters *a, const AVCodecParameters *b)
+{
+    if (a->extradata_size != b->extradata_size)
+        return false;
+
+    return a->extradata_size == 0 || memcmp(a->extradata, b->extradata, static_cast<size_t>(a->extradata_size)) == 0;
+}
+
+// H.264 in mp4 / mkv keeps SPS and PPS in an avcC record in the extradata, the
+// packets hold NAL units with a length prefix instead of start codes
+static bool isAvcc(const AVCodecParameters *par)
+{
+    return par->codec_id == AV_CODEC_ID_H264 && par->extradata_size >= 7 && par->extradata[0] == 1;
+}
+
+// SPS and PPS of the avcC record as NAL units, which can be put in front of a
+// packet (empty on errors)
+static std::vector<uint8_t> avccParameterSets(const AVCodecParameters *par)
+{
+    std::vector<uint8_t> units;
+    const uint8_t *data = par->extradata;
+    int size = par->extradata_size;
+    int length_size = (data[4] & 3) + 1;
+    int pos = 5;
+
+    int type;
+    for (type = 0; type < 2; type++) {
+        if (pos >= size)
+            return std::vector<uint8_t>();
+
+        // The number of SPS shares its byte with reserved bits
+        int count = type == 0 ? data[pos] & 0x1f : data[pos];
+        pos++;
+
+        int i;
+        for (i = 0; i < count; i++) {
+            if (pos + 2 > size)
+                return std::vector<uint8_t>();
+            int unit_size = data[pos] << 8 | data[pos + 1];
+            pos += 2;
+            if (pos + unit_size > size)
+                return std::vector<uint8_t>();
+
+            int byte;
+            for (byte = length_size - 1; byte >= 0; byte--)
+                units.push_back(static_cast<uint8_t>(unit_size >> (8 * byte)));
+            units.insert(units.end(), data + pos, data + pos + unit_size);
+            pos += unit_size;
+        }
+    }
+
+    return units;
+}
+
+Remuxer::Remuxer(const VideoFile &target, const std::string &container, int frame_rate) :
+    target(target),
+    container(container),
+    frame_rate(frame_rate),
+    output_ctx(nullptr),
+    output_stream(nullptr),
+    pkt(av_packet_alloc()),
+    shift(AV_NOPTS_VALUE),
+    end_time(AV_NOPTS_VALUE)
+{
+}
+
+Remuxer::~Remuxer()
+{
+    close();
+    av_packet_free(&pkt);
+}
+
+bool Remuxer::begin(const VideoFile &file)
+{
+    AVFormatContext *input_ctx;
+    int stream_index = openInput(file, input_ctx, last_error);
+    if (stream_index < 0)
+        return false;
+
+    bool success = createOutput(input_ctx->streams[stream_index]);
+    VideoFile::closeInput(&input_ctx);
+
+    return success;
+}
+
+bool Remuxer::createOutput(const AVStream *input_stream)
+{
+    int av_error = avformat_alloc_output_context2(&output_ctx, nullptr, container.c_str(), target.fileName().toStdString().c_str());
+    if (av_error < 0) {
+        errorMsg("Could not create the video file", av_error);
+        return false;
+    }
+
+    output_stream = avformat_new_stream(output_ctx, nullptr);
+    av_error = avcodec_parameters_copy(output_stream->codecpar, input_stream->codecpar);
+    output_stream->codecpar->codec_tag = 0;
+    output_stream->time_base = frame_rate > 0 ? AVRational{1, frame_rate} : input_stream->time_base;
+    output_stream->avg_frame_rate = input_stream->avg_frame_rate;
+
+    if (av_error >= 0)
+        av_error = target.openOutput(output_ctx);
+    if (av_error >= 0)
+        av_error = avformat_write_header(output_ctx, nullptr);
+    if (av_error < 0) {
+        errorMsg("Could not create the video file", av_error);
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+bool Remuxer::append(const VideoFile &file, int64_t offset_us, int64_t begin_us, int64_t end_us, int64_t dts_shift_us, bool in_band)
+{
+    if (!last_error.isEmpty())
+        return false;
+
+    AVFormatContext *input_ctx;
+    int stream_index = openInput(file, input_ctx, last_error);
+    if (stream_index < 0)
+        return false;
+
+    const AVStream *input_stream = input_ctx->streams[stream_index];
+
+    if (output_ctx == nullptr && !createOutput(input_stream)) {
+        VideoFile::closeInput(&input_ctx);
+        return false;
+    }
+
+    const AVCodecParameters *input_par = input_stream->codecpar;
+    const AVCodecParameters *output_par = output_stream->codecpar;
+    // The copied packets are decoded with the parameters of the target
+    // (e.g. the SPS / PPS of H.264 in the extradata)
+    const char *mismatch = nullptr;
+    if (input_par->codec_id != output_par->codec_id || input_par->width != output_par->width || input_par->height != output_par->height)
+        mismatch = "Videos need the same size and codec";
+    else if (!in_band && input_par->format != output_par->format)
+        mismatch = "Videos need the same pixel format";
+    else if (!in_band && input_par->profile != output_par->profile)
+        mismatch = "Videos need the same codec profile";
+    else if (!in_band && !sameExtradata(input_par, output_par))
+        mismatch = "Videos need the same codec configuration (encoded with different settings)";
+    else if (in_band && isAvcc(output_par) && (output_par->extradata[4] & 3) != 3)
+        mismatch = "Videos need NAL units with a length of 4 bytes";
+
+    if (mismatch != nullptr) {
+        errorMsg(mismatch);
+        VideoFile::closeInput(&input_ctx);
+        return false;
+    }
+
+    // Packets without duration last a frame interval
+    AVRational frame_rate = input_stream->avg_frame_rate.num != 0 ? input_stream->avg_frame_rate : input_stream->r_frame_rate;
+    int64_t interval_us = frame_rate.num != 0 && frame_rate.den != 0 ? av_rescale_q(1, av_inv_q(frame_rate), microseconds) : 0;
+
+    // Packets of earlier files may have replaced the parameter sets of the
+    // target in the decoder (e.g. the in-band ones of an exact trim, mp4 / mkv
+    // only repeat them in the extradata) -> the first packet restores them
+    std::vector<uint8_t> parameter_sets;
+    if (!in_band && end_time != AV_NOPTS_VALUE && isAvcc(output_par))
+        parameter_sets = avccParameterSets(output_par);
+
+    int av_error;
+    while ((av_error = av_read_frame(input_ctx, pkt)) >= 0) {
+        int64_t timestamp = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+        if (pkt->stream_index != stream_index || timestamp == AV_NOPTS_VALUE) {
+            av_packet_unref(pkt);
+            continue;
+        }
+
+        int64_t time = av_rescale_q(timestamp, input_stream->time_base, microseconds);
+        if (offset_us == follow_previous)
+            offset_us = end_time == AV_NOPTS_VALUE ? -time : end_time - time;
+        time += offset_us;
+
+        if (time < begin_us || time >= end_us) {
+            av_packet_unref(pkt);
+            continue;
+        }
+
+        if (shift == AV_NOPTS_VALUE)
+            shift = -time;
+
+        int64_t duration_us = pkt->duration > 0 ? av_rescale_q(pkt->duration, input_stream->time_base, microseconds) : interval_us;
+        end_time = end_time == AV_NOPTS_VALUE ? time + duration_us : std::max(end_time, time + duration_us);
+
+        // Converted via microseconds, which is exact for frame intervals
+        if (pkt->pts != AV_NOPTS_VALUE)
+            pkt->pts = av_rescale_q(av_rescale_q(pkt->pts, input_stream->time_base, microseconds) + offset_us + shift,
+                                    microseconds, output_stream->time_base);
+        if (pkt->dts != AV_NOPTS_VALUE)
+            pkt->dts = av_rescale_q(av_rescale_q(pkt->dts, input_stream->time_base, microseconds) + offset_us + shift - dts_shift_us,
+                                    microseconds, output_stream->time_base);
+        pkt->duration = av_rescale_q(pkt->duration, input_stream->time_base, output_stream->time_base);
+        pkt->stream_index = output_stream->index;
+        pkt->pos = -1;
+
+        if (!parameter_sets.empty()) {
+            int size = pkt->size;
+            av_error = av_grow_packet(pkt, static_cast<int>(parameter_sets.size()));
+            if (av_error < 0) {
+                av_packet_unref(pkt);
+                break;
+            }
+            memmove(pkt->data + parameter_sets.size(), pkt->data, static_cast<size_t>(size));
+            memcpy(pkt->data, parameter_sets.data(), parameter_sets.size());
+            parameter_sets.clear();
+        }
+
+        av_error = av_interleaved_write_frame(output_ctx, pkt);
+        if (av_error < 0)
+            break;
+    }
+
+    VideoFile::closeInput(&input_ctx);
+
+    if (av_error != AVERROR_EOF) {
+        errorMsg("Could not copy the packets", av_error);
+        return false;
+    }
+
+    return true;
+}
+
+bool Remuxer::finish()
+{
+    if (!last_error.isEmpty())
+        return false;
+
+    if (output_ctx == nullptr) {
+        errorMsg("No frames to write");
+        return false;
+    }
+
+    int av_error = av_write_trailer(output_ctx);
+    close();
+
+    if (av_error < 0) {
+        errorMsg("Could not finish the video file", av_error);
+        return false;
+    }
+
+    return true;
+}
+
+void Remuxer::close()
+{
+    if (output_ctx == nullptr)
+        return;
+
+    if (output_ctx->pb != nullptr)
+        VideoFile::closeOutput(output_ctx);
+    avformat_free_context(output_ctx);
+
+    output_ctx = nullptr;
+    output_stream = nullptr;
+}
+
+void Remuxer::errorMsg(const char *msg, int av_error)
+{
+    last_error = msg;
+    if (av_error < 0) {
+        char ch[AV_ERROR_MAX_STRING_SIZE] = {0};
+        last_error += QString(": ") + av_make_error_string(ch, AV_ERROR_MAX_STRING_SIZE, av_error);
+    }
+}
+
+bool probeRemuxInfo(const VideoFile &video, RemuxInfo &info, QString &error)
+{
+    AVFormatContext *input_ctx;
+    int stream_index = openInput(video, input_ctx, error);
+    if (stream_index < 0)
+        return false;
+
+    const AVStream *stream = input_ctx->streams[stream_index];
+
+    // Demuxers list all names of the format (e.g. "mov,mp4,m4a,3gp,3g2,mj2")
+    info.container = input_ctx->iformat->name;
+    info.container = info.container.substr(0, info.container.find(','));
+    if (info.container == "mov")
+        info.container = "mp4";
+
+    info.pixel_format = stream->codecpar->format;
+    info.start_us = stream->start_time != AV_NOPTS_VALUE ? av_rescale_q(stream->start_time, stream->time_base, microseconds) : 0;
+
+    // The dts of all packets lag behind by the same delay
+    info.delay_us = 0;
+    AVPacket *pkt = av_packet_alloc();
+    while (av_read_frame(input_ctx, pkt) >= 0) {
+        bool found = pkt->stream_index == stream_index;
+        if (found && pkt->pts != AV_NOPTS_VALUE && pkt->dts != AV_NOPTS_VALUE)
+            info.delay_us = av_rescale_q(pkt->pts - pkt->dts, stream->time_base, microseconds);
+        av_packet_unref(pkt);
+        if (found)
+            break;
+    }
+    av_packet_free(&pkt);
+
+    VideoFile::closeInput(&input_ctx);
+
+    return true;
+}
+
+bool remuxVideos(const QStringList &sources, const VideoFile &target, const std::string &container, int frame_rate, QString &error)
+{
+    Remuxer remuxer(target, container, frame_rate);
+
+    for (const QString &source : sources)
+        remuxer.append(source);
+
+    if (!remuxer.finish()) {
+        error = remuxer.last_error;
+        return false;
+    }
+
+    return true;
+}
+
+// Profile to encode the frames at the ends of a trimmed video with
+// -> the packets need the format of the copied ones and carry their own
+//    parameter sets, which differ from the ones of the stream. Containers
+//    without global header (e.g. avi) hold both with start codes, the ones
+//    with global header (e.g. mkv) take the length prefixed packets of mp4,
+//    which is written without global header.
+//    Without B-frames, the dts can be moved below the copied packets.
+static VideoEncoder::Profile boundaryProfile(const RemuxInfo &info)
+{
+    bool rgb = info.pixel_format == AV_PIX_FMT_GBRP || info.pixel_format == AV_PIX_FMT_BGR0 || info.pixel_format == AV_PIX_FMT_BGRA;
+
+    VideoEncoder::Profile profile = rgb ? VideoEncoder::Profile::lossless() : VideoEncoder::Profile::realtime();
+    if (!rgb)
+        profile.pixel_format = info.pixel_format == AV_PIX_FMT_NV12 ? VideoEncoder::Profile::Nv12 : VideoEncoder::Profile::Yuv420;
+
+    const AVOutputFormat *format = av_guess_format(info.container.c_str(), nullptr, nullptr);
+    bool global_header = format != nullptr && (format->flags & AVFMT_GLOBALHEADER) != 0;
+
+    // Only mkv / mp4 store the capture times
+    profile.container = global_header ? "mp4" : info.container;
+    profile.max_b_frames = 0;
+    profile.variable_frame_rate = global_header;
+
+    return profile;
+}
+
+bool trimVideo(const VideoFile &source, const VideoFile &target, int start, int end, bool exact, QString &error)
+{
+    VideoDecoder decoder;
+    decoder.open(source);
+    if (!decoder.last_error.isEmpty()) {
+        error = decoder.last_error;
+        return false;
+    }
+
+    std::vector<int64_t> times;
+    std::vector<int> key_frames;
+    if (!decoder.scanFrames(times, key_frames)) {
+        error = decoder.last_error;
+        return false;
+    }
+
+    int count = static_cast<int>(times.size());
+    if (start < 0 || end > count || start >= end || key_frames.empty()) {
+        error = "Frame range is outside of the video";
+        return false;
+    }
+
+    RemuxInfo info;
+    if (!probeRemuxInfo(source, info, error))
+        return false;
+
+    // Key frame at or before / at or after the frame, the end counts as key frame
+    auto keyBefore = [&](int frame) {
+        std::vector<int>::const_iterator it = std::upper_bound(key_frames.begin(), key_frames.end(), frame);
+        return it == key_frames.begin() ? 0 : *(it - 1);
+    };
+    auto keyAfter = [&](int frame) {
+        std::vector<int>::const_iterator it = std::lower_bound(key_frames.begin(), key_frames.end(), frame);
+        return it == key_frames.end() ? count : *it;
+    };
+    auto timeOf = [&](int frame) {
+        return frame < count ? times[static_cast<size_t>(frame)] : INT64_MAX;
+    };
+
+    // The times of the decoder start at the first frame
+    Remuxer remuxer(target, info.container);
+
+    if (!exact) {
+        remuxer.append(source, -info.start_us, timeOf(keyBefore(start)), timeOf(keyAfter(end)));
+    } else {
+        // Head [start, middle) and tail [tail, end) are encoded again, the
+        // complete GOPs in between are copied
+        int middle = std::min(end, keyAfter(start));
+        int tail = std::max(middle, keyAfter(end) == end ? end : keyBefore(end));
+
+        VideoEncoder::Profile profile = boundaryProfile(info);
+        VideoFile head_file;
+        VideoFile tail_file;
+
+        if (middle > start) {
+            head_file.createTemporary();
+            if (!transcodeRange(source, head_file, profile, times, keyBefore(start), start, middle, error))
+                return false;
+        }
+
+        if (end > tail) {
+            tail_file.createTemporary();
+            if (!transcodeRange(source, tail_file, profile, times, tail, tail, end, error))
+                return false;
+        }
+
+        // The copied packets decide about the stream parameters
+        remuxer.begin(source);
+        if (middle > start)
+            remuxer.append(head_file, timeOf(start), INT64_MIN, INT64_MAX, info.delay_us, true);
+        if (tail > middle)
+            remuxer.append(source, -info.start_us, timeOf(middle), timeOf(tail));
+        if (end > tail)
+            remuxer.append(tail_file, timeOf(tail), INT64_MIN, INT64_MAX, 0, true);
+    }
+
+    if (!remuxer.finish()) {
+        error = remuxer.last_error;
+        return false;
+    }
+
+    return true;
+}
+
+bool concatVideos(const VideoFile &first, const VideoFile &second, const VideoFile &target, QString &error)
+{
+    RemuxInfo info;
+    if (!probeRemuxInfo(first, info, error))
+        return false;
+
+    // The second video starts, when the last frame of the first one ends
+    Remuxer remuxer(target, info.container);
+    remuxer.append(first);
+    remuxer.append(second, Remuxer::follow_previous);
+
+    if (!remuxer.finish()) {
+        error = remuxer.last_error;
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,89 @@
+#ifndef REMUX_H
+#define REMUX_H
+
+#include <QString>
+#include <QStringList>
+
+#include "videofile.h"
+
+#include <cstdint>
+#include <string>
+
+// Copies the packets of one or more videos into a new file without encoding
+// them again -> runs at the speed of the disk
+//
+// Times are in microseconds. Every source is placed on a common timeline with
+// an offset, the target starts with the first packet written at 0.
+class Remuxer
+{
+public:
+    // With a frame rate, the target counts frame intervals (e.g. for avi
+    // targets of matroska sources), otherwise it keeps the time base of the
+    // first source
+    Remuxer(const VideoFile &target, const std::string &container, int frame_rate = 0);
+    ~Remuxer();
+
+    // Creates the target with the stream parameters of the file, otherwise
+    // this happens with the first append()
+    bool begin(const VideoFile &file);
+
+    // Appends the packets, whose time (timestamp in the file plus offset)
+    // lies in [begin_us, end_us)
+    // -> follow_previous as offset places the file right after the previous one
+    // -> dts_shift_us lowers the dts of the packets, so that they can precede
+    //    packets of a stream with a larger reorder delay (B-frames)
+    // -> the pixel format, the profile and the codec configuration (extradata)
+    //    need to match the target, unless the packets carry their own
+    //    parameter sets (in_band). The first packet of any later file
+    //    without them repeats the parameter sets of the target.
+    bool append(const VideoFile &file, int64_t offset_us = 0, int64_t begin_us = INT64_MIN, int64_t end_us = INT64_MAX,
+                int64_t dts_shift_us = 0, bool in_band = false);
+
+    // Writes the trailer and closes the target
+    bool finish();
+
+    QString last_error;
+
+    static const int64_t follow_previous = INT64_MIN;
+
+private:
+    bool createOutput(const struct AVStream *input_stream);
+    void close();
+
+    void errorMsg(const char *msg, int av_error = 0);
+
+    const VideoFile &target;
+    std::string container;
+    int frame_rate;
+
+    struct AVFormatContext *output_ctx;
+    struct AVStream *output_stream;
+    struct AVPacket *pkt;
+
+    int64_t shift;    // moves the first packet to 0
+    int64_t end_time; // end of the last packet on the common timeline
+};
+
+// Stream properties needed to remux a video
+struct RemuxInfo
+{
+    std::string container; // name of the muxer, which writes the same format
+    int pixel_format;      // AVPixelFormat of the stream
+    int64_t start_us;      // timestamp of the first frame
+    int64_t delay_us;      // pts - dts of the first packet (B-frames)
+};
+
+bool probeRemuxInfo(const VideoFile &video, RemuxInfo &info, QString &error);
+
+// Copies the sources one after another, they need to share one timeline
+// (e.g. segments of one recording)
+bool remuxVideos(const QStringList &sources, const VideoFile &target, const std::string &container, int frame_rate, QString &error);
+
+// Keeps the frames [start, end) -> without exact, the range grows to the key
+// frames around it, otherwise the incomplete GOPs at both ends are encoded again
+bool trimVideo(const VideoFile &source, const VideoFile &target, int start, int end, bool exact, QString &error);
+
+// Appends the second video to the first one (same codec and size)
+bool concatVideos(const VideoFile &first, const VideoFile &second, const VideoFile &target, QString &error);
+
+#endif // REMUX_H
@@ -0,0 +1,44 @@
+#include "segmentring.h"
+
+#include "remux.h"
+
+#include <QFile>
+#include <QTextStream>
+
+SegmentRing::SegmentRing(int count, int seconds) :
+    segment_count(count),
+    segment_seconds(seconds),
+    pattern_file(dir.filePath("segment%03d.mkv"))
+{
+}
+
+QStringList SegmentRing::segmentFiles() const
+{
+    QStringList files;
+
+    // The segment muxer lists finished segments only, one name per line
+    QFile list(listFileName());
+    if (!list.open(QIODevice::ReadOnly | QIODevice::Text))
+        return files;
+
+    QTextStream stream(&list);
+    while (!stream.atEnd()) {
+        QString line = stream.readLine().trimmed();
+        if (!line.isEmpty())
+            files.append(dir.filePath(line));
+    }
+
+    return files;
+}
+
+bool SegmentRing::exportTo(const VideoFile &target, QString &error) const
+{
+    QStringList files = segmentFiles();
+    if (files.isEmpty()) {
+        error = "No finished segments";
+        return false;
+    }
+
+    // The segments share the timeline of the recording
+    return remuxVideos(files, target, "matroska", 0, error);
+}
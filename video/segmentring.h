@@ -0,0 +1,42 @@
+#ifndef SEGMENTRING_H
+#define SEGMENTRING_H
+
+#include <QString>
+#include <QStringList>
+#include <QTemporaryDir>
+
+#include "videofile.h"
+
+// Ring of video segments of a rolling recording in a temporary directory
+// -> the encoder reuses the file names after count segments, so the disk
+//    usage is bounded and the ring holds the last count * seconds of video
+class SegmentRing
+{
+public:
+    SegmentRing(int count = 10, int seconds = 60);
+
+    bool isValid() const { return dir.isValid(); }
+
+    int count() const { return segment_count; }
+    int seconds() const { return segment_seconds; }
+
+    // File name pattern and list file to pass to the encoder
+    const VideoFile &pattern() const { return pattern_file; }
+    QString listFileName() const { return dir.filePath("segments.txt"); }
+
+    // Finished segments, oldest first
+    QStringList segmentFiles() const;
+
+    // Copies the packets of all finished segments into one matroska file
+    // without encoding them again -> returns false and sets the error, if
+    // reading or writing fails
+    bool exportTo(const VideoFile &target, QString &error) const;
+
+private:
+    QTemporaryDir dir;
+    int segment_count;
+    int segment_seconds;
+    VideoFile pattern_file;
+};
+
+#endif // SEGMENTRING_H
@@ -0,0 +1,199 @@
+#include "transcode.h"
+
+#include "decoder.h"
+#include "remux.h"
+
+#include "utils/parallel.h"
+
+#include <QThreadPool>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+bool transcodeVideo(const VideoFile &source, const VideoFile &target, const VideoEncoder::Profile &profile, QString &error)
+{
+    VideoDecoder decoder;
+    decoder.open(source);
+    if (!decoder.last_error.isEmpty()) {
+        error = decoder.last_error;
+        return false;
+    }
+
+    const VideoInfo &info = decoder.info();
+
+    VideoEncoder encoder;
+    encoder.open(target, info.width, info.height, info.framerate, profile);
+    if (!encoder.last_error.isEmpty()) {
+        error = encoder.last_error;
+        return false;
+    }
+
+    while (decoder.readFrame()) {
+        // Targets with variable frame rate keep the timing of the source
+        int64_t time_us = decoder.frameTimeUs();
+
+        decoder.swsScale();
+
+        if (profile.variable_frame_rate)
+            encoder.addFrameAt(decoder.frame(), time_us);
+        else
+            encoder.addFrame(decoder.frame());
+        if (!encoder.last_error.isEmpty()) {
+            error = encoder.last_error;
+            return false;
+        }
+    }
+
+    encoder.finish();
+    if (!encoder.last_error.isEmpty()) {
+        error = encoder.last_error;
+        return false;
+    }
+
+    return true;
+}
+
+bool transcodeRange(const VideoFile &source, const VideoFile &target, const VideoEncoder::Profile &profile,
+                    const std::vector<int64_t> &times, int key_frame, int begin, int end, QString &error)
+{
+    VideoDecoder decoder;
+    decoder.open(source);
+    if (!decoder.last_error.isEmpty()) {
+        error = decoder.last_error;
+        return false;
+    }
+
+    decoder.seekKeyFrame(times[static_cast<size_t>(key_frame)]);
+    if (!decoder.last_error.isEmpty()) {
+        error = decoder.last_error;
+        return false;
+    }
+
+    const VideoInfo &info = decoder.info();
+
+    // The chunks run in parallel already
+    VideoEncoder encoder;
+    encoder.setThreadCount(1);
+    encoder.open(target, info.width, info.height, info.framerate, profile);
+    if (!encoder.last_error.isEmpty()) {
+        error = encoder.last_error;
+        return false;
+    }
+
+    bool last = end == static_cast<int>(times.size());
+
+    int index;
+    for (index = key_frame; index < end; index++) {
+        // The decoder may hold back the last frames of the file (like in transcodeVideo)
+        if (!decoder.readFrame()) {
+            if (last)
+                break;
+            error = QString("Could not decode frame %1").arg(index);
+            return false;
+        }
+
+        // Frames between the key frame and the range are only decoded
+        if (index < begin)
+            continue;
+
+        decoder.swsScale();
+
+        // The target starts at 0 with the first frame of the range
+        if (profile.variable_frame_rate)
+            encoder.addFrameAt(decoder.frame(), times[static_cast<size_t>(index)] - times[static_cast<size_t>(begin)]);
+        else
+            encoder.addFrame(decoder.frame(), index - begin);
+        if (!encoder.last_error.isEmpty()) {
+            error = encoder.last_error;
+            return false;
+        }
+    }
+
+    encoder.finish();
+    if (!encoder.last_error.isEmpty()) {
+        error = encoder.last_error;
+        return false;
+    }
+
+    return true;
+}
+
+bool transcodeVideoParallel(const VideoFile &source, const VideoFile &target, const VideoEncoder::Profile &profile, QString &error)
+{
+    VideoDecoder decoder;
+    decoder.open(source);
+    if (!decoder.last_error.isEmpty()) {
+        error = decoder.last_error;
+        return false;
+    }
+
+    std::vector<int64_t> times;
+    std::vector<int> key_frames;
+    if (!decoder.scanFrames(times, key_frames)) {
+        error = decoder.last_error;
+        return false;
+    }
+
+    int frame_rate = decoder.info().framerate;
+
+    // About two chunks per core balance the load, a chunk holds at least a
+    // GOP of the target
+    int threads = std::max(1, QThreadPool::globalInstance()->maxThreadCount());
+    int min_frames = std::max(profile.gop_size, static_cast<int>(times.size()) / (threads * 2));
+
+    std::vector<int> starts;
+    for (int key_frame : key_frames) {
+        if (starts.empty() ? key_frame == 0 : key_frame - starts.back() >= min_frames)
+            starts.push_back(key_frame);
+    }
+
+    if (starts.size() < 2)
+        return transcodeVideo(source, target, profile, error);
+
+    starts.push_back(static_cast<int>(times.size()));
+    int chunks = static_cast<int>(starts.size()) - 1;
+
+    // Chunks are written as matroska, which keeps variable frame rates
+    VideoEncoder::Profile chunk_profile = profile;
+    chunk_profile.container = "matroska";
+
+    std::vector<std::unique_ptr<VideoFile>> chunk_files;
+    std::vector<QString> errors(static_cast<size_t>(chunks));
+
+    int chunk;
+    for (chunk = 0; chunk < chunks; chunk++) {
+        chunk_files.emplace_back(new VideoFile);
+        chunk_files.back()->createTemporary();
+    }
+
+    parallelFor(chunks, 1, [&](int begin, int end) {
+        int index;
+        for (index = begin; index < end; index++) {
+            size_t i = static_cast<size_t>(index);
+            transcodeRange(source, *chunk_files[i], chunk_profile, times, starts[i], starts[i], starts[i + 1], errors[i]);
+        }
+    });
+
+    for (const QString &chunk_error : errors) {
+        if (!chunk_error.isEmpty()) {
+            error = chunk_error;
+            return false;
+        }
+    }
+
+    // Each chunk starts at 0 and is moved to the time of its first frame
+    Remuxer remuxer(target, profile.container, profile.variable_frame_rate ? 0 : frame_rate);
+    for (chunk = 0; chunk < chunks; chunk++) {
+        int first = starts[static_cast<size_t>(chunk)];
+        int64_t offset_us = profile.variable_frame_rate ? times[static_cast<size_t>(first)] : static_cast<int64_t>(first) * 1000000 / frame_rate;
+        remuxer.append(*chunk_files[static_cast<size_t>(chunk)], offset_us);
+    }
+
+    if (!remuxer.finish()) {
+        error = remuxer.last_error;
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,28 @@
+#ifndef TRANSCODE_H
+#define TRANSCODE_H
+
+#include <QString>
+
+#include "encoder.h"
+#include "videofile.h"
+
+#include <cstdint>
+#include <vector>
+
+// Decodes all frames of the source and encodes them into the target with the
+// given profile (same size and frame rate)
+// -> returns false and sets the error, if decoding or encoding fails
+bool transcodeVideo(const VideoFile &source, const VideoFile &target, const VideoEncoder::Profile &profile, QString &error);
+
+// Same, but the frames are split into chunks at key frames of the source,
+// which are encoded by independent encoders on all cores and joined without
+// encoding them again -> each chunk starts with a key frame in the target
+bool transcodeVideoParallel(const VideoFile &source, const VideoFile &target, const VideoEncoder::Profile &profile, QString &error);
+
+// Encodes the frames [begin, end) of the source (times and key frames from
+// VideoDecoder::scanFrames), decoding starts at the key frame before begin
+// -> the target starts at 0 with the frame begin
+bool transcodeRange(const VideoFile &source, const VideoFile &target, const VideoEncoder::Profile &profile,
+                    const std::vector<int64_t> &times, int key_frame, int begin, int end, QString &error);
+
+#endif // TRANSCODE_H
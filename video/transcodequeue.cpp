@@ -0,0 +1,315 @@
+#include "transcodequeue.h"
+
+#include "decoder.h"
+
+#include "utils/circularqueue.hpp"
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QRunnable>
+#include <QThread>
+#include <QWaitCondition>
+
+#include <algorithm>
+#include <atomic>
+
+struct TranscodeJob
+{
+    int id;
+
+    // Opened on enqueue, closed once the job is done
+    std::unique_ptr<VideoDecoder> decoder;
+    QString target;
+    VideoEncoder::Profile profile;
+
+    mutable QMutex mutex;
+    mutable QWaitCondition condition;
+    TranscodeStatus status;
+
+    QElapsedTimer timer;
+    qint64 last_report;
+};
+
+// Slot of the queue between decoder and encoder
+struct DecodedFrame
+{
+    Image image;   // BGR profiles
+    YuvFrame yuv;  // YUV profiles
+    int64_t time_us = 0;
+};
+
+// Frames decoded ahead of the encoder
+static const size_t queued_frames = 8;
+
+// Decodes the frames into the queue and converts them into the pixel format of
+// the profile -> the encoder only waits for frames, if decoding is the slower part
+class FrameReader : public QThread
+{
+public:
+    FrameReader(VideoDecoder &decoder, const VideoEncoder::Profile &profile, CircularQueue<DecodedFrame> &queue) :
+        decoder(decoder), profile(profile), queue(queue), quit(false), done(false) {}
+
+    void stop() { quit = true; queue.wakeAll(); }
+
+    // True, once the last frame is in the queue
+    bool isDone() const { return done.load(); }
+
+protected:
+    void run() override
+    {
+        while (!quit && decoder.readFrame()) {
+            int64_t time_us = decoder.frameTimeUs();
+
+            decoder.swsScale();
+
+            DecodedFrame *frame;
+            while ((frame = queue.acquireWrite()) == nullptr && !quit)
+                queue.waitNotFull(100);
+            if (frame == nullptr)
+                break;
+
+            frame->time_us = time_us;
+
+            if (profile.isYuv()) {
+                const Image &image = decoder.frame();
+                if (frame->yuv.layout() != profile.yuvLayout() || frame->yuv.width() != image.width() || frame->yuv.height() != image.height()) {
+                    frame->yuv = YuvFrame(profile.yuvLayout());
+                    frame->yuv.resize(image.width(), image.height());
+                }
+                frame->yuv.convertFrom(image);
+            } else {
+                frame->image = decoder.frame();
+            }
+
+            queue.commitWrite();
+        }
+
+        done = true;
+        queue.wakeAll();
+    }
+
+private:
+    VideoDecoder &decoder;
+    const VideoEncoder::Profile &profile;
+    CircularQueue<DecodedFrame> &queue;
+
+    std::atomic<bool> quit;
+    std::atomic<bool> done;
+};
+
+class TranscodeRunnable : public QRunnable
+{
+public:
+    TranscodeRunnable(const std::shared_ptr<TranscodeJob> &job) : job(job) {}
+
+    void run() override { TranscodeQueue::instance().run(*job); }
+
+private:
+    std::shared_ptr<TranscodeJob> job;
+};
+
+QString TranscodeStatus::toString() const
+{
+    switch (state) {
+    case Queued:
+        return "queued";
+    case Running:
+        return QString("running: %1 / %2 frames, %3 fps, %4 s left")
+                .arg(frames).arg(total).arg(fps, 0, 'f', 1).arg(eta, 0, 'f', 1);
+    case Finished:
+        return QString("finished: %1 frames").arg(frames);
+    case Failed:
+        return "failed: " + error;
+    }
+
+    return QString();
+}
+
+bool TranscodeHandle::isFinished() const
+{
+    if (job == nullptr)
+        return true;
+
+    QMutexLocker locker(&job->mutex);
+    return job->status.state == TranscodeStatus::Finished || job->status.state == TranscodeStatus::Failed;
+}
+
+int TranscodeHandle::id() const
+{
+    return job != nullptr ? job->id : 0;
+}
+
+TranscodeStatus TranscodeHandle::status() const
+{
+    if (job == nullptr)
+        return TranscodeStatus();
+
+    QMutexLocker locker(&job->mutex);
+    return job->status;
+}
+
+bool TranscodeHandle::wait() const
+{
+    if (job == nullptr)
+        return false;
+
+    QMutexLocker locker(&job->mutex);
+    while (job->status.state == TranscodeStatus::Queued || job->status.state == TranscodeStatus::Running)
+        job->condition.wait(&job->mutex);
+
+    return job->status.state == TranscodeStatus::Finished;
+}
+
+// A quarter of the cores per job -> the encoder keeps 3 of them busy, the
+// decoder 1. On small machines a single job gets all cores.
+TranscodeQueue::TranscodeQueue()
+{
+    int cores = std::max(1, QThread::idealThreadCount());
+    int jobs = std::max(1, cores / 4);
+
+    pool.setMaxThreadCount(jobs);
+    encoder_threads = std::max(1, cores / jobs - 1);
+}
+
+TranscodeQueue &TranscodeQueue::instance()
+{
+    static TranscodeQueue queue;
+    return queue;
+}
+
+TranscodeHandle TranscodeQueue::enqueue(const VideoFile &source, const QString &target, const VideoEncoder::Profile &profile)
+{
+    static std::atomic<int> next_id(1);
+
+    std::shared_ptr<TranscodeJob> job = std::make_shared<TranscodeJob>();
+    job->id = next_id++;
+    job->target = target;
+    job->profile = profile;
+    job->last_report = 0;
+
+    job->decoder.reset(new VideoDecoder);
+    job->decoder->open(source);
+
+    if (!job->decoder->last_error.isEmpty()) {
+        job->status.state = TranscodeStatus::Failed;
+        job->status.error = job->decoder->last_error;
+        job->decoder.reset();
+    } else {
+        job->status.total = job->decoder->info().framecount;
+        pool.start(new TranscodeRunnable(job));
+    }
+
+    TranscodeHandle handle;
+    handle.job = job;
+    return handle;
+}
+
+void TranscodeQueue::waitForAll()
+{
+    pool.waitForDone();
+}
+
+void TranscodeQueue::run(TranscodeJob &job)
+{
+    QMutexLocker locker(&job.mutex);
+    job.status.state = TranscodeStatus::Running;
+    locker.unlock();
+
+    job.timer.start();
+
+    VideoDecoder &decoder = *job.decoder;
+    const VideoInfo &info = decoder.info();
+
+    VideoFile target(job.target);
+
+    VideoEncoder encoder;
+    encoder.setThreadCount(encoder_threads);
+    encoder.open(target, info.width, info.height, info.framerate, job.profile);
+
+    QString error = encoder.last_error;
+    int frames = 0;
+
+    if (error.isEmpty()) {
+        CircularQueue<DecodedFrame> queue(static_cast<size_t>(info.width) * static_cast<size_t>(info.height) * 4);
+        queue.resize(queued_frames);
+
+        FrameReader reader(decoder, job.profile, queue);
+        reader.start();
+
+        while (error.isEmpty()) {
+            DecodedFrame *frame = queue.acquireRead();
+            if (frame == nullptr) {
+                // The reader is done before it publishes the last frame
+                if (reader.isDone() && queue.empty())
+                    break;
+                queue.waitNotEmpty(100);
+                continue;
+            }
+
+            // Targets with variable frame rate keep the timing of the source
+            if (job.profile.isYuv()) {
+                if (job.profile.variable_frame_rate)
+                    encoder.addFrameAt(frame->yuv, frame->time_us);
+                else
+                    encoder.addFrame(frame->yuv, frames);
+            } else {
+                if (job.profile.variable_frame_rate)
+                    encoder.addFrameAt(frame->image, frame->time_us);
+                else
+                    encoder.addFrame(frame->image, frames);
+            }
+
+            queue.releaseRead();
+
+            error = encoder.last_error;
+            frames++;
+            updateStatus(job, frames, false);
+        }
+
+        reader.stop();
+        reader.wait();
+
+        if (error.isEmpty()) {
+            encoder.finish();
+            error = encoder.last_error;
+        }
+    }
+
+    // Releases the source
+    job.decoder.reset();
+
+    updateStatus(job, frames, true);
+
+    // Emitted before the waiters wake up -> once wait() returns, the direct
+    // connections of finished() have run
+    emit finished(job.id, error.isEmpty(), error);
+
+    locker.relock();
+    job.status.state = error.isEmpty() ? TranscodeStatus::Finished : TranscodeStatus::Failed;
+    job.status.error = error;
+    job.status.eta = 0;
+    job.condition.wakeAll();
+}
+
+void TranscodeQueue::updateStatus(TranscodeJob &job, int frames, bool force)
+{
+    qint64 elapsed = std::max<qint64>(1, job.timer.elapsed());
+    double fps = frames * 1000.0 / elapsed;
+
+    QMutexLocker locker(&job.mutex);
+    TranscodeStatus &status = job.status;
+    status.frames = frames;
+    status.fps = fps;
+    status.eta = fps > 0 ? std::max(0, status.total - frames) / fps : 0;
+
+    // Four updates per second are plenty for a progress bar
+    if (!force && elapsed - job.last_report < 250)
+        return;
+
+    job.last_report = elapsed;
+    int total = status.total;
+    double eta = status.eta;
+    locker.unlock();
+
+    emit progress(job.id, frames, total, fps, eta);
+}
@@ -0,0 +1,101 @@
+#ifndef TRANSCODEQUEUE_H
+#define TRANSCODEQUEUE_H
+
+#include <QObject>
+#include <QString>
+#include <QThreadPool>
+
+#include "encoder.h"
+#include "videofile.h"
+
+#include <memory>
+
+struct TranscodeJob;
+
+// Progress of a job in the transcode queue
+struct TranscodeStatus
+{
+    enum State
+    {
+        Queued,
+        Running,
+        Finished,
+        Failed
+    };
+
+    State state = Queued;
+    int frames = 0;   // encoded frames
+    int total = 0;    // frames of the source (estimate for some containers)
+    double fps = 0;   // encoded frames per second
+    double eta = 0;   // seconds until the job is done
+    QString error;
+
+    // Human readable summary, e.g. "running: 120 / 600 frames, 85.3 fps, 5.6 s left"
+    QString toString() const;
+};
+
+// Handle of a video, which is transcoded in the background
+// -> destroying the handle does not cancel the job
+class TranscodeHandle
+{
+public:
+    TranscodeHandle() {}
+
+    bool isValid() const { return job != nullptr; }
+    bool isFinished() const;
+
+    // Number of the job, as passed by the signals of the queue
+    int id() const;
+
+    TranscodeStatus status() const;
+
+    // Blocks until the video is written, returns false on errors
+    bool wait() const;
+
+private:
+    std::shared_ptr<TranscodeJob> job;
+
+    friend class TranscodeQueue;
+};
+
+// Encodes videos again on a bounded pool of workers
+// -> in each job, one thread decodes (and converts the frames to the pixel
+//    format of the profile), while the worker encodes. The jobs running at the
+//    same time share the cores, so their encoders get fewer threads each.
+class TranscodeQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+    static TranscodeQueue &instance();
+
+    // The source is opened right away, so it may be deleted, while the job waits
+    // -> errors opening the source are reported by the handle
+    TranscodeHandle enqueue(const VideoFile &source, const QString &target, const VideoEncoder::Profile &profile);
+
+    // Blocks until every queued video is written
+    void waitForAll();
+
+    int maxJobs() const { return pool.maxThreadCount(); }
+
+    // Threads of the encoder of each job
+    int encoderThreads() const { return encoder_threads; }
+
+signals:
+    // Emitted by the worker threads, at most a few times per second per job
+    void progress(int id, int frames, int total, double fps, double eta);
+    void finished(int id, bool success, const QString &error);
+
+private:
+    TranscodeQueue();
+
+    void run(TranscodeJob &job);
+    void updateStatus(TranscodeJob &job, int frames, bool force);
+
+    QThreadPool pool;
+    int encoder_threads;
+
+    friend class TranscodeRunnable;
+};
+
+#endif // TRANSCODEQUEUE_H
@@ -0,0 +1,429 @@
+#include "videofile.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QtGlobal>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+extern "C"
+{
+#include "libavformat/avformat.h"
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#endif
+
+#if defined(__APPLE__)
+#include <sys/clonefile.h>
+#endif
+
+struct VideoMemory
+{
+    QMutex mutex;
+    std::vector<uint8_t> data;
+    int64_t spill_threshold;
+
+    // Holds the whole video, once it outgrew the threshold
+    std::unique_ptr<QTemporaryFile> spill;
+    QString spill_name;
+};
+
+// Position of an AVIOContext in a video in memory
+struct MemoryCursor
+{
+    std::shared_ptr<VideoMemory> memory;
+    int64_t pos;
+};
+
+static const int io_buffer_size = 64 << 10;
+
+static int readMemory(void *opaque, uint8_t *buf, int buf_size)
+{
+    MemoryCursor *cursor = static_cast<MemoryCursor *>(opaque);
+    VideoMemory &memory = *cursor->memory;
+
+    QMutexLocker locker(&memory.mutex);
+
+    int64_t count;
+    if (memory.spill != nullptr) {
+        count = memory.spill->seek(cursor->pos) ? memory.spill->read(reinterpret_cast<char *>(buf), buf_size) : -1;
+        if (count < 0)
+            return AVERROR(EIO);
+    } else {
+        int64_t size = static_cast<int64_t>(memory.data.size());
+        count = std::max<int64_t>(0, std::min<int64_t>(buf_size, size - cursor->pos));
+        if (count > 0)
+            memcpy(buf, memory.data.data() + cursor->pos, static_cast<size_t>(count));
+    }
+
+    cursor->pos += count;
+    return count > 0 ? static_cast<int>(count) : AVERROR_EOF;
+}
+
+// Moves the video into a temporary file
+static bool spillMemory(VideoMemory &memory)
+{
+    std::unique_ptr<QTemporaryFile> file(new QTemporaryFile);
+    if (!file->open())
+        return false;
+
+    qint64 size = static_cast<qint64>(memory.data.size());
+    if (file->write(reinterpret_cast<const char *>(memory.data.data()), size) != size)
+        return false;
+
+    memory.spill = std::move(file);
+    memory.spill_name = memory.spill->fileName();
+
+    std::vector<uint8_t>().swap(memory.data);
+    return true;
+}
+
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+static int writeMemory(void *opaque, const uint8_t *buf, int buf_size)
+#else
+static int writeMemory(void *opaque, uint8_t *buf, int buf_size)
+#endif
+{
+    MemoryCursor *cursor = static_cast<MemoryCursor *>(opaque);
+    VideoMemory &memory = *cursor->memory;
+
+    QMutexLocker locker(&memory.mutex);
+
+    int64_t end = cursor->pos + buf_size;
+
+    if (memory.spill == nullptr && end > memory.spill_threshold && !spillMemory(memory))
+        return AVERROR(EIO);
+
+    if (memory.spill != nullptr) {
+        if (!memory.spill->seek(cursor->pos) || memory.spill->write(reinterpret_cast<const char *>(buf), buf_size) != buf_size)
+            return AVERROR(EIO);
+    } else {
+        if (static_cast<int64_t>(memory.data.size()) < end)
+            memory.data.resize(static_cast<size_t>(end));
+        memcpy(memory.data.data() + cursor->pos, buf, static_cast<size_t>(buf_size));
+    }
+
+    cursor->pos = end;
+    return buf_size;
+}
+
+static int64_t seekMemory(void *opaque, int64_t offset, int whence)
+{
+    MemoryCursor *cursor = static_cast<MemoryCursor *>(opaque);
+    VideoMemory &memory = *cursor->memory;
+
+    QMutexLocker locker(&memory.mutex);
+
+    int64_t size = memory.spill != nullptr ? memory.spill->size() : static_cast<int64_t>(memory.data.size());
+
+    switch (whence & ~AVSEEK_FORCE) {
+    case AVSEEK_SIZE:
+        return size;
+    case SEEK_SET:
+        break;
+    case SEEK_CUR:
+        offset += cursor->pos;
+        break;
+    case SEEK_END:
+        offset += size;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+
+    if (offset < 0)
+        return AVERROR(EINVAL);
+
+    cursor->pos = offset;
+    return offset;
+}
+
+static AVIOContext *createMemoryIo(const std::shared_ptr<VideoMemory> &memory, bool write)
+{
+    uint8_t *buffer = static_cast<uint8_t *>(av_malloc(io_buffer_size));
+    if (buffer == nullptr)
+        return nullptr;
+
+    MemoryCursor *cursor = new MemoryCursor{memory, 0};
+
+    AVIOContext *io = avio_alloc_context(buffer, io_buffer_size, write ? 1 : 0, cursor,
+                                         readMemory, write ? writeMemory : nullptr, seekMemory);
+    if (io == nullptr) {
+        av_free(buffer);
+        delete cursor;
+    }
+
+    return io;
+}
+
+static void freeMemoryIo(AVIOContext *io)
+{
+    if (io == nullptr)
+        return;
+
+    if (io->write_flag)
+        avio_flush(io);
+
+    delete static_cast<MemoryCursor *>(io->opaque);
+    av_freep(&io->buffer);
+    avio_context_free(&io);
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+
+// Shares the blocks of the source (btrfs, XFS, APFS), the copy only takes up
+// space, once one of the files is changed
+static bool cloneFile(const QByteArray &source, const QByteArray &target)
+{
+#if defined(__linux__)
+    int in = open(source.constData(), O_RDONLY | O_CLOEXEC);
+    if (in < 0)
+        return false;
+
+    int out = open(target.constData(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (out < 0) {
+        close(in);
+        return false;
+    }
+
+    bool success = ioctl(out, FICLONE, in) == 0;
+
+    close(out);
+    close(in);
+
+    if (!success)
+        unlink(target.constData());
+
+    return success;
+#elif defined(__APPLE__)
+    return clonefile(source.constData(), target.constData(), 0) == 0;
+#else
+    Q_UNUSED(source)
+    Q_UNUSED(target)
+    return false;
+#endif
+}
+
+#if defined(__linux__)
+
+// Copies the data inside of the kernel -> copy_file_range() lets the file
+// system copy on the server or the device, sendfile() works across file systems
+static bool copyFile(const QByteArray &source, const QByteArray &target)
+{
+    int in = open(source.constData(), O_RDONLY | O_CLOEXEC);
+    if (in < 0)
+        return false;
+
+    struct stat st;
+    int out = fstat(in, &st) == 0 ? open(target.constData(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666) : -1;
+    if (out < 0) {
+        close(in);
+        return false;
+    }
+
+    off_t left = st.st_size;
+    bool use_sendfile = false;
+
+    while (left > 0) {
+        size_t count = static_cast<size_t>(std::min<off_t>(left, 1 << 30));
+        ssize_t written = use_sendfile ? sendfile(out, in, nullptr, count) : copy_file_range(in, nullptr, out, nullptr, count, 0);
+
+        if (written < 0 && errno == EINTR)
+            continue;
+
+        // Older kernels do not copy across file systems
+        if (written < 0 && !use_sendfile && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP)) {
+            use_sendfile = true;
+            continue;
+        }
+
+        if (written <= 0)
+            break;
+
+        left -= written;
+    }
+
+    bool success = left == 0;
+    if (close(out) != 0)
+        success = false;
+    close(in);
+
+    if (!success)
+        unlink(target.constData());
+
+    return success;
+}
+
+#endif
+
+#endif
+
+bool VideoFile::save(const QString &file_name) const
+{
+    // Removing the target first would delete the video
+    if (file_name == fileName())
+        return true;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QString source_name = fileName();
+    QByteArray source = QFile::encodeName(source_name);
+    QByteArray target = QFile::encodeName(file_name);
+
+    // The file, into which a video in memory moved, belongs to this object as well
+    bool owned = isTemporary() || memory != nullptr;
+
+    const char *method = nullptr;
+
+    if (isInMemory()) {
+        QMutexLocker locker(&memory->mutex);
+
+        QFile file(file_name);
+        qint64 size = static_cast<qint64>(memory->data.size());
+        if (file.open(QIODevice::WriteOnly) && file.write(reinterpret_cast<const char *>(memory->data.data()), size) == size)
+            method = "writing the memory";
+    } else {
+#if defined(__unix__) || defined(__APPLE__)
+        // Replaces the target atomically, fails across file systems
+        if (isTemporary() && ::rename(source.constData(), target.constData()) == 0)
+            method = "rename";
+#else
+        if (isTemporary()) {
+            QFile::remove(file_name);
+            if (temp_file.rename(file_name))
+                method = "rename";
+        }
+#endif
+
+        if (method != nullptr) {
+            // The saved file belongs to the user now
+            temp_file.setAutoRemove(false);
+            file_path = file_name;
+        } else {
+            QFile::remove(file_name);
+
+#if defined(__unix__) || defined(__APPLE__)
+            // Files of the user are not linked, changing one of them would change both
+            if (cloneFile(source, target))
+                method = "reflink";
+            else if (owned && ::link(source.constData(), target.constData()) == 0)
+                method = "hardlink";
+#endif
+
+#if defined(__linux__)
+            if (method == nullptr && copyFile(source, target))
+                method = "kernel copy";
+#endif
+
+            if (method == nullptr && QFile::copy(source_name, file_name))
+                method = "copy";
+        }
+    }
+
+    if (method == nullptr) {
+        qWarning("Could not save video to %s", qUtf8Printable(file_name));
+        return false;
+    }
+
+    qInfo("Saved video to %s by %s in %lld ms", qUtf8Printable(file_name), method, static_cast<long long>(timer.elapsed()));
+    return true;
+}
+
+void VideoFile::createInMemory(int64_t spill_threshold)
+{
+    memory = std::make_shared<VideoMemory>();
+    memory->spill_threshold = spill_threshold;
+    file_path.clear();
+}
+
+bool VideoFile::isInMemory() const
+{
+    if (memory == nullptr)
+        return false;
+
+    QMutexLocker locker(&memory->mutex);
+    return memory->spill == nullptr;
+}
+
+QString VideoFile::fileName() const
+{
+    if (memory == nullptr)
+        return file_path;
+
+    QMutexLocker locker(&memory->mutex);
+    return memory->spill_name;
+}
+
+int VideoFile::openInput(AVFormatContext **format_ctx) const
+{
+    if (memory == nullptr)
+        return avformat_open_input(format_ctx, file_path.toStdString().c_str(), nullptr, nullptr);
+
+    // The format context does not close custom I/O
+    AVIOContext *io = createMemoryIo(memory, false);
+    *format_ctx = avformat_alloc_context();
+    if (io == nullptr || *format_ctx == nullptr) {
+        freeMemoryIo(io);
+        avformat_free_context(*format_ctx);
+        *format_ctx = nullptr;
+        return AVERROR(ENOMEM);
+    }
+
+    (*format_ctx)->pb = io;
+
+    int av_error = avformat_open_input(format_ctx, nullptr, nullptr, nullptr);
+    if (av_error < 0)
+        freeMemoryIo(io);
+
+    return av_error;
+}
+
+int VideoFile::openOutput(AVFormatContext *format_ctx) const
+{
+    if (memory == nullptr)
+        return avio_open(&format_ctx->pb, file_path.toStdString().c_str(), AVIO_FLAG_WRITE);
+
+    format_ctx->pb = createMemoryIo(memory, true);
+    if (format_ctx->pb == nullptr)
+        return AVERROR(ENOMEM);
+
+    // Marks the I/O as ours for closeOutput()
+    format_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+    return 0;
+}
+
+void VideoFile::closeInput(AVFormatContext **format_ctx)
+{
+    if (*format_ctx == nullptr)
+        return;
+
+    AVIOContext *io = ((*format_ctx)->flags & AVFMT_FLAG_CUSTOM_IO) ? (*format_ctx)->pb : nullptr;
+    avformat_close_input(format_ctx);
+    freeMemoryIo(io);
+}
+
+void VideoFile::closeOutput(AVFormatContext *format_ctx)
+{
+    if (format_ctx->flags & AVFMT_FLAG_CUSTOM_IO)
+        freeMemoryIo(format_ctx->pb);
+    else
+        avio_close(format_ctx->pb);
+
+    format_ctx->pb = nullptr;
+}
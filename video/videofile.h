@@ -4,6 +4,11 @@
 #include <QString>
 #include <QTemporaryFile>
 
+#include <cstdint>
+#include <memory>
+
+struct VideoMemory;
+
 class VideoFile
 {
 public:
@@ -12,13 +17,46 @@ public:
 
     void createTemporary() { temp_file.open(); file_path = temp_file.fileName(); }
 
-    const QString &fileName() const { return file_path; }
-    void save(const QString &file_name) const { QFile::copy(file_path, file_name); }
+    // Keeps the video in memory -> short clips cause no file I/O at all. Once
+    // the video grows beyond the threshold (bytes), it moves into a temporary
+    // file and continues there.
+    void createInMemory(int64_t spill_threshold = default_spill_threshold);
+
+    // True, while the video is held in memory (not moved into a file yet)
+    bool isInMemory() const;
+
+    // Empty for videos in memory
+    QString fileName() const;
+
+    // Writes the video to the file (an existing one is replaced) without
+    // copying the data, if possible: a temporary file is moved there, otherwise
+    // the data is shared by a reflink or a hardlink of the temporary file.
+    // Only then, the file is copied (by the kernel on Linux).
+    // -> after moving, the video refers to the saved file, which stays on disk
+    bool save(const QString &file_name) const;
+
+    // Open the video for libavformat like avformat_open_input() / avio_open(),
+    // videos in memory are accessed through a custom AVIOContext
+    // -> return an AVERROR code on errors
+    int openInput(struct AVFormatContext **format_ctx) const;
+    int openOutput(struct AVFormatContext *format_ctx) const;
+
+    // Close contexts opened by the functions above
+    static void closeInput(struct AVFormatContext **format_ctx);
+    static void closeOutput(struct AVFormatContext *format_ctx);
+
+    static const int64_t default_spill_threshold = 256 << 20;
 
 private:
-    QTemporaryFile temp_file;
-    QString file_path;
+    // True, while the file is the temporary file of this object
+    bool isTemporary() const { return temp_file.autoRemove() && !temp_file.fileName().isEmpty() && temp_file.fileName() == file_path; }
+
+    // Moving the file changes the path, not the video
+    mutable QTemporaryFile temp_file;
+    mutable QString file_path;
+
+    // Shared with the AVIOContexts, so that open decoders keep the data alive
+    std::shared_ptr<VideoMemory> memory;
 };
 
 #endif // VIDEOFILE_H
-